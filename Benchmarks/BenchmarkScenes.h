@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <utility>
+#include <vector>
+
+#include "Scene/Scene.h"
+#include "Utils/UtilsMath.h"
+
+// Synthetic scene graphs for the scene benchmarks
+
+// Every node gets 1 to 2 * fanOut - 1 children, breadth-first, until the scene has numNodes nodes. The nodes are then
+// added depth-first, like the converters traverse the assimp scenes
+inline void makeHierarchy(Scene &scene, uint32_t numNodes, uint32_t fanOut)
+{
+    std::vector<std::vector<uint32_t>> children(1);
+    for (uint32_t head = 0; head < children.size() && children.size() < numNodes; head++)
+    {
+        const uint32_t numChildren = 1 + rand() % (2 * fanOut - 1);
+        for (uint32_t i = 0; i != numChildren && children.size() < numNodes; i++)
+        {
+            children[head].push_back((uint32_t)children.size());
+            children.emplace_back();
+        }
+    }
+
+    scene = Scene();
+
+    // (shape node, its scene node)
+    std::vector<std::pair<uint32_t, int>> stack = {{0, addNode(scene, -1, 0)}};
+    while (!stack.empty())
+    {
+        const auto [shapeNode, node] = stack.back();
+        stack.pop_back();
+
+        for (uint32_t child : children[shapeNode])
+            stack.emplace_back(child, addNode(scene, node, scene.hierarchy_[node].level_ + 1));
+    }
+
+    for (glm::mat4 &m : scene.localTransform_)
+        m = glm::translate(glm::mat4(1.0f), randVec());
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// The benchmarks are plain executables printing their timings, they are built with the tests but ctest does not run them.
+// Build them in Release, the numbers of a Debug build say nothing
+
+// Runs fn() a few times and returns the median time in milliseconds. The median ignores the first (cold) run
+// and the occasional run interrupted by the scheduler
+template <typename Fn>
+double measureMs(Fn fn, int runs = 7)
+{
+    std::vector<double> times;
+    times.reserve(runs);
+
+    for (int i = 0; i != runs; i++)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        fn();
+        const auto end = std::chrono::high_resolution_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+// The same, but before() runs ahead of every measured run without being timed, i.e. to evict a file from the page cache
+template <typename Before, typename Fn>
+double measureMsAfter(Before before, Fn fn, int runs = 7)
+{
+    std::vector<double> times;
+    times.reserve(runs);
+
+    for (int i = 0; i != runs; i++)
+    {
+        before();
+        const auto start = std::chrono::high_resolution_clock::now();
+        fn();
+        const auto end = std::chrono::high_resolution_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
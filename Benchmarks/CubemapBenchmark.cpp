@@ -0,0 +1,48 @@
+// Times the conversion of equirectangular HDR maps into cube map faces: the two passes through the vertical cross
+// against the direct multithreaded convertEquirectangularMapToCubeMapFaces(). The maps are loaded as RGBA floats,
+// like loadCubeMap() does, so the SSE path is the one measured
+//
+// Usage: CubemapBenchmark [file.hdr ...], run from the repository root for the default files
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "Utils/UtilsCubemap.h"
+#include "Utils/UtilsMath.h"
+
+#include "BenchmarkUtils.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+int main(int argc, char *argv[])
+{
+    std::vector<const char *> files(argv + 1, argv + argc);
+    if (files.empty())
+        files = {"data/immenstadter_horn_2k.hdr", "data/immenstadter_horn_2k_irradiance.hdr", "data/piazza_bologni_1k.hdr"};
+
+    printf("USE_SSE_MATH = %d\n", USE_SSE_MATH);
+
+    for (const char *fileName : files)
+    {
+        int w, h, comp;
+        float *img = stbi_loadf(fileName, &w, &h, &comp, 4);
+        if (!img)
+        {
+            printf("%s: cannot load, skipped\n", fileName);
+            continue;
+        }
+
+        const Bitmap in(w, h, 4, eBitmapFormat_Float, img);
+        stbi_image_free(img);
+
+        const double crossMs = measureMs([&]() { convertVerticalCrossToCubeMapFaces(convertEquirectangularMapToVerticalCross(in)); }, 5);
+        const double directMs = measureMs([&]() { convertEquirectangularMapToCubeMapFaces(in); }, 5);
+
+        printf("%s (%dx%d): through the vertical cross %.1f ms, direct %.1f ms, %.1fx\n", fileName, w, h, crossMs, directMs, crossMs / directMs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+// Measures the CPU frustum culling of MultiRenderer without a window or a GPU: the linear isBoxInFrustum() loop
+// the renderer used to have, the same loop over the precomputed CullingFrustum, the batched cullBoxes() and the BVH.
+// The scene is a city-like grid of buildings with smaller props scattered around them, seen from street level
+//
+// Usage: CullingBenchmark [number of boxes]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <bit>
+#include <vector>
+
+#include "Scene/BVH.h"
+#include "Utils/UtilsMath.h"
+
+#include "BenchmarkUtils.h"
+
+static std::vector<BoundingBox> makeCity(uint32_t numBoxes, float worldSize)
+{
+    std::vector<BoundingBox> boxes;
+    boxes.reserve(numBoxes);
+
+    // a quarter of the boxes are buildings on a regular grid
+    const uint32_t gridSize = (uint32_t)sqrtf((float)(numBoxes / 4));
+    const float cellSize = 2.0f * worldSize / (float)std::max(gridSize, 1u);
+
+    for (uint32_t z = 0; z != gridSize; z++)
+        for (uint32_t x = 0; x != gridSize; x++)
+        {
+            const vec3 corner(-worldSize + x * cellSize, 0.0f, -worldSize + z * cellSize);
+            const vec3 size(cellSize * 0.6f, randomFloat(5.0f, 60.0f), cellSize * 0.6f);
+            boxes.emplace_back(corner, corner + size);
+        }
+
+    while (boxes.size() < numBoxes)
+    {
+        const vec3 center = randomVec(vec3(-worldSize, 0.0f, -worldSize), vec3(worldSize, 3.0f, worldSize));
+        const vec3 halfSize = 0.5f * randomVec(vec3(0.2f), vec3(2.0f));
+        boxes.emplace_back(center - halfSize, center + halfSize);
+    }
+
+    return boxes;
+}
+
+int main(int argc, char *argv[])
+{
+    srand(12345);
+
+    const uint32_t numBoxes = (argc > 1) ? (uint32_t)atoi(argv[1]) : 100000;
+    const float worldSize = 1000.0f;
+    const int kNumCameras = 64;
+
+    const std::vector<BoundingBox> boxes = makeCity(numBoxes, worldSize);
+
+    BoundingBoxesSoA boxesSoA;
+    boxesSoA.resize(boxes.size());
+    for (size_t i = 0; i != boxes.size(); i++)
+        boxesSoA.set(i, boxes[i]);
+
+    std::vector<glm::mat4> viewProjs;
+    for (int i = 0; i != kNumCameras; i++)
+    {
+        const vec3 eye = randomVec(vec3(-worldSize, 1.7f, -worldSize), vec3(worldSize, 30.0f, worldSize));
+        const vec3 target = eye + glm::normalize(randomVec(vec3(-1.0f, -0.2f, -1.0f), vec3(1.0f, 0.1f, 1.0f)));
+        viewProjs.push_back(glm::perspective(1.0f, 16.0f / 9.0f, 0.1f, 500.0f) * glm::lookAt(eye, target, vec3(0.0f, 1.0f, 0.0f)));
+    }
+
+    BVH bvh;
+    const double buildMs = measureMs([&]() { buildBVH(bvh, boxes); }, 3);
+    const double refitMs = measureMs([&]() { refitBVH(bvh, boxes); });
+
+    printf("%u boxes, %d cameras, BVH of %zu nodes: build %.2f ms, full refit %.2f ms\n\n", (uint32_t)boxes.size(), kNumCameras, bvh.nodes_.size(), buildMs, refitMs);
+
+    // the visible counts of all the variants must be the same, they are printed to make sure nothing got optimized away
+    uint64_t visible = 0;
+
+    const double planesMs = measureMs([&]() {
+        visible = 0;
+        for (const glm::mat4 &viewProj : viewProjs)
+        {
+            glm::vec4 planes[6], corners[8];
+            getFrustumPlanes(viewProj, planes);
+            getFrustumCorners(viewProj, corners);
+            for (const BoundingBox &box : boxes)
+                visible += isBoxInFrustum(planes, corners, box) ? 1 : 0;
+        }
+    });
+    printf("%-40s %8.3f ms per frame, %llu visible\n", "isBoxInFrustum(planes, corners)", planesMs / kNumCameras, (unsigned long long)visible);
+
+    const double frustumMs = measureMs([&]() {
+        visible = 0;
+        for (const glm::mat4 &viewProj : viewProjs)
+        {
+            const CullingFrustum frustum = getCullingFrustum(viewProj);
+            for (const BoundingBox &box : boxes)
+                visible += isBoxInFrustum(frustum, box) ? 1 : 0;
+        }
+    });
+    printf("%-40s %8.3f ms per frame, %llu visible\n", "isBoxInFrustum(CullingFrustum)", frustumMs / kNumCameras, (unsigned long long)visible);
+
+    std::vector<uint32_t> visibility((boxes.size() + 31) / 32);
+
+    const double batchedMs = measureMs([&]() {
+        visible = 0;
+        for (const glm::mat4 &viewProj : viewProjs)
+        {
+            cullBoxes(getCullingFrustum(viewProj), boxesSoA, visibility.data());
+            for (uint32_t bits : visibility)
+                visible += std::popcount(bits);
+        }
+    });
+    printf("%-40s %8.3f ms per frame, %llu visible (USE_SSE_MATH = %d)\n", "cullBoxes()", batchedMs / kNumCameras, (unsigned long long)visible, USE_SSE_MATH);
+
+    std::vector<uint32_t> visibleItems;
+
+    const double bvhMs = measureMs([&]() {
+        visible = 0;
+        for (const glm::mat4 &viewProj : viewProjs)
+        {
+            cullBVH(bvh, getCullingFrustum(viewProj), visibleItems);
+            visible += visibleItems.size();
+        }
+    });
+    printf("%-40s %8.3f ms per frame, %llu visible\n", "cullBVH()", bvhMs / kNumCameras, (unsigned long long)visible);
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+// Times deleteSceneNodes() on a synthetic 500k-node scene with meshes, materials and names, deleting 10%, 50% and 90%
+// of the nodes. The deleted nodes are random ones, their subtrees go with them, so random nodes are picked until
+// the subtrees cover the requested fraction. Every run deletes from a fresh copy of the scene, the copy is not timed
+//
+// Usage: DeleteNodesBenchmark [number of nodes]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Scene/Scene.h"
+
+#include "BenchmarkScenes.h"
+#include "BenchmarkUtils.h"
+
+// the number of nodes in the subtree of every node. The children always come after their parents
+static std::vector<uint32_t> getSubtreeSizes(const Scene &scene)
+{
+    std::vector<uint32_t> sizes(scene.hierarchy_.size(), 1);
+    for (size_t i = scene.hierarchy_.size() - 1; i > 0; i--)
+        sizes[scene.hierarchy_[i].parent_] += sizes[i];
+    return sizes;
+}
+
+static std::vector<uint32_t> pickNodesToDelete(const Scene &scene, float fraction)
+{
+    const std::vector<uint32_t> subtreeSizes = getSubtreeSizes(scene);
+    const uint32_t numNodes = (uint32_t)scene.hierarchy_.size();
+    const uint32_t target = (uint32_t)(fraction * numNodes);
+
+    std::vector<uint8_t> deleted(numNodes, 0);
+    std::vector<uint32_t> nodes;
+    std::vector<int> stack;
+
+    // the subtrees of the picked nodes are marked, so the nodes already inside them are not counted twice
+    uint32_t covered = 0;
+    while (covered < target)
+    {
+        const uint32_t n = 1 + rand() % (numNodes - 1);
+        if (deleted[n] || covered + subtreeSizes[n] > target + numNodes / 100)
+            continue;
+
+        nodes.push_back(n);
+
+        stack.push_back((int)n);
+        while (!stack.empty())
+        {
+            const int node = stack.back();
+            stack.pop_back();
+
+            covered += deleted[node] ? 0 : 1;
+            deleted[node] = 1;
+
+            for (int c = scene.hierarchy_[node].firstChild_; c != -1; c = scene.hierarchy_[c].nextSibling_)
+                stack.push_back(c);
+        }
+    }
+
+    return nodes;
+}
+
+int main(int argc, char *argv[])
+{
+    srand(12345);
+
+    const uint32_t numNodes = (argc > 1) ? (uint32_t)atoi(argv[1]) : 500000;
+
+    Scene scene;
+    makeHierarchy(scene, numNodes, 4);
+
+    // like the converted scenes, the leaves have meshes and materials and every node has a name
+    for (uint32_t i = 0; i != numNodes; i++)
+    {
+        if (scene.hierarchy_[i].firstChild_ == -1)
+        {
+            scene.meshes_[i] = i % 1000;
+            scene.materialForNode_[i] = i % 100;
+        }
+        scene.nameForNode_[i] = (uint32_t)scene.names_.size();
+        scene.names_.push_back("Node" + std::to_string(i));
+    }
+    buildNameIndex(scene);
+
+    printf("%u nodes, %zu with meshes\n", numNodes, scene.meshes_.size());
+
+    for (float fraction : {0.1f, 0.5f, 0.9f})
+    {
+        const std::vector<uint32_t> nodesToDelete = pickNodesToDelete(scene, fraction);
+
+        Scene copy;
+        const double ms = measureMsAfter([&]() { copy = scene; }, [&]() { deleteSceneNodes(copy, nodesToDelete); }, 5);
+
+        printf("  %2.0f%% of the nodes (%zu subtrees): %8.2f ms, %zu nodes left\n", fraction * 100.0f, nodesToDelete.size(), ms, copy.hierarchy_.size());
+    }
+
+    return 0;
+}
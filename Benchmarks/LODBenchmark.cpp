@@ -0,0 +1,153 @@
+// Measures what the screen-space error LOD selection saves: the triangles submitted per frame (before culling) against
+// the allowed error in pixels, and the time the selection of all the shapes takes per frame. The shapes instance a bumpy
+// sphere whose LOD chain is built by processLods() with the default settings of the converters, or the meshes of a .meshes
+// file converted with calculate_LODs. The camera flies low over a field of shapes, the screen is 1080 pixels high
+//
+// Usage: LODBenchmark [file.meshes]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "../Tool/MeshProcessing.h"
+#include "Scene/VtxData.h"
+#include "Utils/UtilsMath.h"
+
+static void makeBumpySphere(MeshData &m)
+{
+    const uint32_t kRings = 128;
+    const uint32_t kSegments = 256;
+
+    std::vector<float> positions;
+    for (uint32_t r = 0; r <= kRings; r++)
+        for (uint32_t s = 0; s <= kSegments; s++)
+        {
+            const float theta = Math::PI * (float)r / kRings;
+            const float phi = 2.0f * Math::PI * (float)s / kSegments;
+            const float radius = 1.0f + 0.05f * sinf(8.0f * theta) * sinf(8.0f * phi);
+            positions.push_back(radius * sinf(theta) * cosf(phi));
+            positions.push_back(radius * cosf(theta));
+            positions.push_back(radius * sinf(theta) * sinf(phi));
+        }
+
+    std::vector<uint32_t> indices;
+    for (uint32_t r = 0; r != kRings; r++)
+        for (uint32_t s = 0; s != kSegments; s++)
+        {
+            const uint32_t i0 = r * (kSegments + 1) + s;
+            const uint32_t i1 = i0 + kSegments + 1;
+            indices.insert(indices.end(), {i0, i1, i0 + 1, i0 + 1, i1, i1 + 1});
+        }
+
+    std::vector<std::vector<uint32_t>> lods;
+    std::vector<float> errors;
+    processLods(positions, indices, MeshOptimizationConfig(), lods, errors);
+
+    Mesh mesh;
+    mesh.lodCount = (uint32_t)lods.size();
+    mesh.vertexCount = (uint32_t)positions.size() / 3;
+    for (uint32_t l = 0; l != lods.size(); l++)
+    {
+        mesh.lodOffset[l] = (uint32_t)m.indexData_.size();
+        mesh.lodError[l] = errors[l];
+        m.indexData_.insert(m.indexData_.end(), lods[l].begin(), lods[l].end());
+    }
+    mesh.lodOffset[lods.size()] = (uint32_t)m.indexData_.size();
+
+    m.meshes_.push_back(mesh);
+    m.boxes_.emplace_back(vec3(-1.05f), vec3(1.05f));
+}
+
+int main(int argc, char *argv[])
+{
+    srand(12345);
+
+    MeshData m;
+    if (argc > 1)
+        loadMeshData(argv[1], m);
+    else
+        makeBumpySphere(m);
+
+    for (const Mesh &mesh : m.meshes_)
+        if (mesh.lodCount < 2)
+            printf("Warning: some of the meshes have no LODs\n");
+
+    if (m.meshes_.size() == 1)
+    {
+        const Mesh &mesh = m.meshes_[0];
+        for (uint32_t l = 0; l != mesh.lodCount; l++)
+            printf("LOD %u: %7u triangles, error %.5f\n", l, mesh.getLODIndicesCount(l) / 3, mesh.lodError[l]);
+    }
+
+    // a 64x64 field of shapes, 4 mesh sizes apart, with random rotations and scales
+    const uint32_t kFieldSize = 64;
+
+    std::vector<uint32_t> meshForShape;
+    std::vector<BoundingBox> shapeBoxes;
+    std::vector<float> shapeScales;
+
+    for (uint32_t z = 0; z != kFieldSize; z++)
+        for (uint32_t x = 0; x != kFieldSize; x++)
+        {
+            const uint32_t meshIndex = (uint32_t)(meshForShape.size() % m.meshes_.size());
+            const BoundingBox &meshBox = m.boxes_[meshIndex];
+            const float spacing = 4.0f * glm::length(meshBox.max_ - meshBox.min_);
+
+            glm::mat4 t = glm::translate(glm::mat4(1.0f), vec3((float)x * spacing, 0.0f, (float)z * spacing));
+            t = glm::rotate(t, randomFloat(0.0f, 2.0f * Math::PI), vec3(0.0f, 1.0f, 0.0f));
+            t = glm::scale(t, vec3(randomFloat(0.5f, 2.0f)));
+
+            meshForShape.push_back(meshIndex);
+            shapeBoxes.push_back(meshBox.getTransformed(t));
+            shapeScales.push_back(getMaxScale(t));
+        }
+
+    const vec3 fieldMin = shapeBoxes.front().min_;
+    const vec3 fieldMax = shapeBoxes.back().max_;
+
+    // 1080 pixels for a vertical field of view of 60 degrees
+    const float pixelsPerUnit = 0.5f * 1080.0f / tanf(Math::PI / 6.0f);
+
+    const uint32_t kNumFrames = 256;
+
+    uint64_t lod0Triangles = 0;
+    for (uint32_t meshIndex : meshForShape)
+        lod0Triangles += m.meshes_[meshIndex].getLODIndicesCount(0) / 3;
+
+    printf("%zu shapes, %llu triangles at LOD 0\n", meshForShape.size(), (unsigned long long)lod0Triangles);
+
+    for (float maxPixelError : {0.0f, 0.25f, 0.5f, 1.0f, 2.0f, 4.0f, 8.0f})
+    {
+        const LODSelectionConfig cfg = {.maxPixelError = maxPixelError};
+
+        std::vector<uint32_t> lods(meshForShape.size(), 0);
+        uint64_t triangles = 0;
+        double selectionMs = 0.0;
+
+        for (uint32_t frame = 0; frame != kNumFrames; frame++)
+        {
+            // from one corner of the field to the other, a few meters above it
+            const float t = (float)frame / (float)(kNumFrames - 1);
+            const vec3 cameraPos = fieldMin + t * (fieldMax - fieldMin) + vec3(0.0f, fieldMax.y + 2.0f, 0.0f);
+
+            const auto start = std::chrono::high_resolution_clock::now();
+
+            for (size_t s = 0; s != lods.size(); s++)
+                lods[s] = selectLOD(m.meshes_[meshForShape[s]], lods[s], getLODErrorScale(shapeBoxes[s], shapeScales[s], cameraPos, pixelsPerUnit), cfg);
+
+            selectionMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+            for (size_t s = 0; s != lods.size(); s++)
+                triangles += m.meshes_[meshForShape[s]].getLODIndicesCount(lods[s]) / 3;
+        }
+
+        printf("  max error %5.2f pixels: %10.0f triangles per frame, %5.1f%% of LOD 0, selection %.3f ms per frame\n", maxPixelError,
+               (double)triangles / kNumFrames, 100.0 * (double)triangles / ((double)lod0Triangles * kNumFrames), selectionMs / kNumFrames);
+    }
+
+    return 0;
+}
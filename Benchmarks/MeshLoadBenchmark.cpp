@@ -0,0 +1,193 @@
+// Times the loading of a .meshes file up to the point where its index and vertex data are in the (emulated) staging
+// memory of the GPU upload: the memory-mapped MeshDataView of VKSceneData::loadMeshes() against the previous path,
+// which fread() every chunk into its own std::vector and copied the vectors again into the staging buffer.
+// Warm runs read the file from the page cache. Cold runs evict the file from it before every run (Linux only)
+//
+// Usage: MeshLoadBenchmark [file.meshes], without a file a synthetic one of about 200 MB is written and used
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "Scene/VtxData.h"
+
+#include "BenchmarkUtils.h"
+
+const char *const kSyntheticFile = "MeshLoadBenchmark.meshes";
+
+static bool fileExists(const char *fileName)
+{
+    FILE *f = fopen(fileName, "rb");
+    if (f)
+        fclose(f);
+    return f != nullptr;
+}
+
+static bool seekFile(FILE *f, uint64_t offset)
+{
+#if defined(_WIN32)
+    return _fseeki64(f, (int64_t)offset, SEEK_SET) == 0;
+#else
+    return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+// 4M vertices in 1000 meshes, 3 indices per vertex
+static void writeSyntheticMeshFile(const char *fileName)
+{
+    const uint32_t kNumMeshes = 1000;
+    const uint32_t kVerticesPerMesh = 4096;
+
+    MeshData m;
+    for (uint32_t i = 0; i != kNumMeshes; i++)
+    {
+        Mesh mesh;
+        mesh.streamCount = 1;
+        mesh.indexOffset = (uint32_t)m.indexData_.size();
+        mesh.vertexOffset = i * kVerticesPerMesh;
+        mesh.vertexCount = kVerticesPerMesh;
+        mesh.lodOffset[1] = kVerticesPerMesh * 3;
+        mesh.streamElementSize[0] = 8 * sizeof(float);
+        m.meshes_.push_back(mesh);
+
+        for (uint32_t v = 0; v != kVerticesPerMesh * 3; v++)
+            m.indexData_.push_back((v * 7919) % kVerticesPerMesh);
+    }
+
+    m.vertexData_.resize((size_t)kNumMeshes * kVerticesPerMesh * 8);
+    for (size_t i = 0; i != m.vertexData_.size(); i++)
+        m.vertexData_[i] = (i % 8 >= 5) ? 0.57735f : (float)(i % 1013) * 0.01f;
+
+    recalculateBoundingBoxes(m);
+    saveMeshData(fileName, m);
+}
+
+// Drops the cached pages of the file, so the next read goes to the disk
+static bool evictFromPageCache(const char *fileName)
+{
+#if defined(__linux__)
+    const int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return false;
+    const bool evicted = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return evicted;
+#else
+    (void)fileName;
+    return false;
+#endif
+}
+
+template <typename T>
+static void freadChunk(FILE *f, const std::vector<ChunkDesc> &chunks, uint32_t id, std::vector<T> &out)
+{
+    for (const ChunkDesc &c : chunks)
+        if (c.id_ == id)
+        {
+            out.resize(c.size_ / sizeof(T));
+            if (!seekFile(f, c.offset_) || fread(out.data(), 1, c.size_, f) != c.size_)
+                exit(EXIT_FAILURE);
+            return;
+        }
+
+    out.clear();
+}
+
+// the previous path: every chunk is read into its own vector, and the vectors are copied into the staging memory
+static void loadWithFread(const char *fileName, std::vector<uint8_t> &staging)
+{
+    FILE *f = fopen(fileName, "rb");
+    if (!f)
+        exit(EXIT_FAILURE);
+
+    ChunkFileHeader header;
+    if (fread(&header, sizeof(header), 1, f) != 1)
+        exit(EXIT_FAILURE);
+
+    std::vector<ChunkDesc> chunks(header.chunkCount_);
+    if (!seekFile(f, header.chunkTableOffset_) || fread(chunks.data(), sizeof(ChunkDesc), chunks.size(), f) != chunks.size())
+        exit(EXIT_FAILURE);
+
+    MeshData m;
+    std::vector<uint32_t> vertices;
+    freadChunk(f, chunks, kMeshChunk_Meshes, m.meshes_);
+    freadChunk(f, chunks, kMeshChunk_Boxes, m.boxes_);
+    freadChunk(f, chunks, kMeshChunk_Indices, m.indexData_);
+    freadChunk(f, chunks, kMeshChunk_Vertices, vertices);
+
+    fclose(f);
+
+    const size_t vertexSize = vertices.size() * sizeof(uint32_t);
+    staging.resize(vertexSize + m.indexData_.size() * sizeof(uint32_t));
+    memcpy(staging.data(), vertices.data(), vertexSize);
+    memcpy(staging.data() + vertexSize, m.indexData_.data(), m.indexData_.size() * sizeof(uint32_t));
+}
+
+// VKSceneData::loadMeshes(): the small arrays are copied, the bulk data goes from the file pages into the staging memory
+static void loadWithView(const char *fileName, std::vector<uint8_t> &staging)
+{
+    MeshDataView view;
+    loadMeshDataView(fileName, view);
+
+    MeshData m;
+    m.meshes_.assign(view.meshes_.begin(), view.meshes_.end());
+    m.boxes_.assign(view.boxes_.begin(), view.boxes_.end());
+
+    staging.resize(view.vertexData_.size_bytes() + view.indexData_.size_bytes());
+    memcpy(staging.data(), view.vertexData_.data(), view.vertexData_.size_bytes());
+    memcpy(staging.data() + view.vertexData_.size_bytes(), view.indexData_.data(), view.indexData_.size_bytes());
+
+    releaseMeshDataView(view);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *fileName = (argc > 1) ? argv[1] : kSyntheticFile;
+
+    if (argc <= 1 && !fileExists(fileName))
+    {
+        printf("Writing %s...\n", fileName);
+        writeSyntheticMeshFile(fileName);
+    }
+
+    // both paths must deliver the same bytes
+    std::vector<uint8_t> stagingFread, stagingView;
+    loadWithFread(fileName, stagingFread);
+    loadWithView(fileName, stagingView);
+    if (stagingFread != stagingView)
+    {
+        printf("The two loaders disagree on %s\n", fileName);
+        return EXIT_FAILURE;
+    }
+
+    printf("%s: %.1f MB of index and vertex data\n", fileName, (double)stagingView.size() / (1024.0 * 1024.0));
+
+    std::vector<uint8_t> staging;
+    // the staging memory is allocated once by the renderer as well, its page faults are not what is measured
+    staging.resize(stagingView.size());
+
+    const double warmFreadMs = measureMs([&]() { loadWithFread(fileName, staging); });
+    const double warmViewMs = measureMs([&]() { loadWithView(fileName, staging); });
+    printf("  warm: fread() into vectors %8.1f ms, mapped view %8.1f ms, %.2fx\n", warmFreadMs, warmViewMs, warmFreadMs / warmViewMs);
+
+    if (!evictFromPageCache(fileName))
+    {
+        printf("  cold: cannot evict the file from the page cache on this platform, skipped\n");
+        return 0;
+    }
+
+    auto evict = [fileName]() { evictFromPageCache(fileName); };
+    const double coldFreadMs = measureMsAfter(evict, [&]() { loadWithFread(fileName, staging); }, 5);
+    const double coldViewMs = measureMsAfter(evict, [&]() { loadWithView(fileName, staging); }, 5);
+    printf("  cold: fread() into vectors %8.1f ms, mapped view %8.1f ms, %.2fx\n", coldFreadMs, coldViewMs, coldFreadMs / coldViewMs);
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+// Times the texture resampler of the converter against stb_image_resize, single-threaded like one texture job:
+// the stbir_resize_uint8() call the converter used before, its gamma-correct variant, and stbir_resize_float_generic()
+// on the same linear float images our resampleImage() filters. stb_image_resize has no Kaiser filter, Mitchell is its
+// default for downsampling and the closest match
+//
+// Usage: ResamplingBenchmark [source size]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "../Tool/ImageResampling.h"
+#include "Utils/UtilsMath.h"
+
+#include "BenchmarkUtils.h"
+
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include "stb_image_resize.h"
+
+static std::vector<uint8_t> makeTexture(uint32_t w, uint32_t h)
+{
+    std::vector<uint8_t> rgba((size_t)w * h * 4);
+
+    for (uint32_t y = 0; y != h; y++)
+        for (uint32_t x = 0; x != w; x++)
+        {
+            uint8_t *t = &rgba[((size_t)y * w + x) * 4];
+            t[0] = (uint8_t)(x * 255 / w);
+            t[1] = (uint8_t)(y * 255 / h);
+            t[2] = (uint8_t)(rand() & 255);
+            // foliage-like alpha: opaque blobs with a soft edge
+            t[3] = (uint8_t)(((x / 8 + y / 8) % 3) ? 255 : rand() & 255);
+        }
+
+    return rgba;
+}
+
+static void printResult(const char *name, double ms, double baselineMs)
+{
+    printf("  %-52s %8.2f ms  %5.2fx\n", name, ms, baselineMs / ms);
+}
+
+int main(int argc, char *argv[])
+{
+    srand(12345);
+
+    const uint32_t srcSize = (argc > 1) ? (uint32_t)atoi(argv[1]) : 4096;
+
+    const std::vector<uint8_t> src = makeTexture(srcSize, srcSize);
+
+    // the converter downscales to its maximal size first, the MIP chain then halves the images
+    for (uint32_t dstSize : {srcSize / 4, srcSize / 2})
+    {
+        printf("%ux%u -> %ux%u RGBA (USE_SSE_MATH = %d), the speed-ups are relative to stbir_resize_uint8()\n", srcSize, srcSize, dstSize, dstSize, USE_SSE_MATH);
+
+        std::vector<uint8_t> dst((size_t)dstSize * dstSize * 4);
+
+        const double stbirMs = measureMs([&]() { stbir_resize_uint8(src.data(), srcSize, srcSize, 0, dst.data(), dstSize, dstSize, 0, 4); }, 5);
+        printResult("stbir_resize_uint8 (sRGB values, the old converter)", stbirMs, stbirMs);
+
+        const double stbirSrgbMs = measureMs([&]() { stbir_resize_uint8_srgb(src.data(), srcSize, srcSize, 0, dst.data(), dstSize, dstSize, 0, 4, 3, 0); }, 5);
+        printResult("stbir_resize_uint8_srgb (linear)", stbirSrgbMs, stbirMs);
+
+        for (ResampleFilter filter : {ResampleFilter_Box, ResampleFilter_Kaiser})
+        {
+            const ResampleConfig cfg = {.filter = filter, .srgb = true, .alphaTest = 0.5f};
+            const double ms = measureMs([&]() { resampleImage(src.data(), srcSize, srcSize, dst.data(), dstSize, dstSize, cfg); }, 5);
+            printResult(filter == ResampleFilter_Box ? "resampleImage, RGBA8, box, alpha coverage" : "resampleImage, RGBA8, Kaiser, alpha coverage", ms, stbirMs);
+        }
+
+        // the float paths without the sRGB conversions: only the filters are compared
+        const ResampleConfig linearCfg = {.srgb = false};
+
+        FloatImage srcFloat;
+        decodeImage(src.data(), srcSize, srcSize, linearCfg, srcFloat);
+
+        FloatImage dstFloat;
+        dstFloat.data_.resize((size_t)dstSize * dstSize * 4);
+
+        const double stbirBoxMs = measureMs([&]() {
+            stbir_resize_float_generic(srcFloat.data_.data(), srcSize, srcSize, 0, dstFloat.data_.data(), dstSize, dstSize, 0, 4,
+                                       STBIR_ALPHA_CHANNEL_NONE, 0, STBIR_EDGE_CLAMP, STBIR_FILTER_BOX, STBIR_COLORSPACE_LINEAR, nullptr);
+        }, 5);
+        printResult("stbir_resize_float_generic, box", stbirBoxMs, stbirMs);
+
+        const double stbirMitchellMs = measureMs([&]() {
+            stbir_resize_float_generic(srcFloat.data_.data(), srcSize, srcSize, 0, dstFloat.data_.data(), dstSize, dstSize, 0, 4,
+                                       STBIR_ALPHA_CHANNEL_NONE, 0, STBIR_EDGE_CLAMP, STBIR_FILTER_MITCHELL, STBIR_COLORSPACE_LINEAR, nullptr);
+        }, 5);
+        printResult("stbir_resize_float_generic, Mitchell", stbirMitchellMs, stbirMs);
+
+        for (ResampleFilter filter : {ResampleFilter_Box, ResampleFilter_Kaiser})
+        {
+            const ResampleConfig cfg = {.filter = filter, .srgb = false};
+            const double ms = measureMs([&]() { resampleImage(srcFloat, dstSize, dstSize, cfg, dstFloat); }, 5);
+            printResult(filter == ResampleFilter_Box ? "resampleImage, float, box" : "resampleImage, float, Kaiser", ms, stbirMs);
+        }
+
+        printf("\n");
+    }
+
+    return 0;
+}
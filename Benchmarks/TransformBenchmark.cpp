@@ -0,0 +1,77 @@
+// Times the global transform update of synthetic scene graphs from 10k to 1M nodes: recalculateGlobalTransforms()
+// against recalculateGlobalTransformsParallel(), for the whole scene and for 1% of random subtrees being changed,
+// in the depth-first node order of the converters and after reorderNodesByLevel().
+// A fan-out of 8 gives a few large levels, a fan-out of 2 twice as many levels, the smaller of which stay below the
+// parallel threshold
+//
+// Usage: TransformBenchmark [number of threads]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <thread>
+#include <vector>
+
+#include <taskflow/taskflow.hpp>
+
+#include "Scene/Scene.h"
+#include "Utils/UtilsMath.h"
+
+#include "BenchmarkScenes.h"
+#include "BenchmarkUtils.h"
+
+static void markRandomNodes(Scene &scene, uint32_t count)
+{
+    for (uint32_t i = 0; i != count; i++)
+        markAsChanged(scene, rand() % (int)scene.hierarchy_.size());
+}
+
+static void benchmarkScene(Scene &scene, tf::Executor &executor, const char *order)
+{
+    const uint32_t numNodes = (uint32_t)scene.hierarchy_.size();
+
+    const double serialMs = measureMsAfter([&]() { markAsChanged(scene, 0); }, [&]() { recalculateGlobalTransforms(scene); });
+    const double parallelMs = measureMsAfter([&]() { markAsChanged(scene, 0); }, [&]() { recalculateGlobalTransformsParallel(scene, executor); });
+
+    // the same random nodes for both variants
+    const unsigned int seed = rand();
+    srand(seed);
+    const double partialSerialMs = measureMsAfter([&]() { markRandomNodes(scene, numNodes / 100); }, [&]() { recalculateGlobalTransforms(scene); });
+    srand(seed);
+    const double partialParallelMs = measureMsAfter([&]() { markRandomNodes(scene, numNodes / 100); }, [&]() { recalculateGlobalTransformsParallel(scene, executor); });
+
+    printf("    %-12s all nodes: %8.2f ms serial, %8.2f ms parallel (%.2fx)   1%% of the subtrees: %7.2f ms serial, %7.2f ms parallel (%.2fx)\n", order,
+           serialMs, parallelMs, serialMs / parallelMs, partialSerialMs, partialParallelMs, partialSerialMs / partialParallelMs);
+}
+
+int main(int argc, char *argv[])
+{
+    srand(12345);
+
+    const size_t numThreads = (argc > 1) ? (size_t)atoi(argv[1]) : std::thread::hardware_concurrency();
+    tf::Executor executor(numThreads);
+
+    printf("%zu worker threads, USE_SSE_MATH = %d\n", executor.num_workers(), USE_SSE_MATH);
+
+    for (uint32_t numNodes : {10000u, 100000u, 1000000u})
+    {
+        for (uint32_t fanOut : {8u, 2u})
+        {
+            Scene scene;
+            makeHierarchy(scene, numNodes, fanOut);
+
+            int maxLevel = 0;
+            for (const Hierarchy &h : scene.hierarchy_)
+                maxLevel = std::max(maxLevel, h.level_);
+
+            printf("%u nodes, fan-out %u, %d levels\n", numNodes, fanOut, maxLevel + 1);
+
+            benchmarkScene(scene, executor, "depth-first");
+            reorderNodesByLevel(scene);
+            benchmarkScene(scene, executor, "by level");
+        }
+    }
+
+    return 0;
+}
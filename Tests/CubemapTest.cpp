@@ -0,0 +1,90 @@
+// Compares convertEquirectangularMapToCubeMapFaces() with the two-pass conversion through the vertical cross
+// it replaces. The scalar code does the same arithmetic, so its faces must be bitwise identical. The SSE code
+// computes the angles in single precision with a polynomial atan2(), which moves the bilinear weights by a few ULPs
+// of the texel coordinates: for texel values in [0, 1] the colors may differ by at most kSSETolerance
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "Utils/UtilsCubemap.h"
+#include "Utils/UtilsMath.h"
+
+#include "TestUtils.h"
+
+const float kSSETolerance = 8.7e-4f;
+
+// a smooth gradient with noise on top of it, so the neighbouring texels differ by up to the whole [0, 1] range
+static Bitmap makeEquirectangularMap(int w, int h, int comp, eBitmapFormat fmt)
+{
+    Bitmap b(w, h, comp, fmt);
+
+    for (int y = 0; y != h; y++)
+        for (int x = 0; x != w; x++)
+        {
+            const vec4 gradient(float(x) / w, float(y) / h, 0.5f, 1.0f);
+            const vec4 noise(randomVec(vec3(0.0f), vec3(1.0f)), random01());
+            const float weight = ((x / 16 + y / 16) % 2) ? 0.1f : 1.0f;
+            b.setPixel(x, y, gradient + (noise - gradient) * weight);
+        }
+
+    return b;
+}
+
+static float getMaxDifference(const Bitmap &a, const Bitmap &b)
+{
+    CHECK(a.w_ == b.w_ && a.h_ == b.h_ && a.d_ == b.d_ && a.comp_ == b.comp_ && a.fmt_ == b.fmt_);
+    CHECK(a.type_ == eBitmapType_Cube && b.type_ == eBitmapType_Cube);
+
+    float maxDiff = 0.0f;
+    for (int y = 0; y != a.h_ * a.d_; y++)
+        for (int x = 0; x != a.w_; x++)
+        {
+            const vec4 d = glm::abs(a.getPixel(x, y) - b.getPixel(x, y));
+            maxDiff = std::max(maxDiff, std::max(std::max(d.x, d.y), std::max(d.z, d.w)));
+        }
+
+    return maxDiff;
+}
+
+// the face sizes which are not a multiple of 4 go through the scalar tail of the SSE rows
+static float testConversion(int w, int h, int comp, eBitmapFormat fmt, bool exact)
+{
+    const Bitmap b = makeEquirectangularMap(w, h, comp, fmt);
+
+    const Bitmap expected = convertVerticalCrossToCubeMapFaces(convertEquirectangularMapToVerticalCross(b));
+    const Bitmap result = convertEquirectangularMapToCubeMapFaces(b);
+
+    if (exact)
+    {
+        CHECK(result.data_.size() == expected.data_.size());
+        CHECK(memcmp(result.data_.data(), expected.data_.data(), expected.data_.size()) == 0);
+        return 0.0f;
+    }
+
+    const float maxDiff = getMaxDifference(result, expected);
+    CHECK(maxDiff <= kSSETolerance);
+    return maxDiff;
+}
+
+int main()
+{
+    srand(12345);
+
+    // only the RGBA float bitmaps have an SSE path
+    const bool exactFloat4 = !USE_SSE_MATH;
+
+    float maxDiff = 0.0f;
+    for (int w : {2048, 1024, 200, 36})
+        maxDiff = std::max(maxDiff, testConversion(w, w / 2, 4, eBitmapFormat_Float, exactFloat4));
+
+    testConversion(1024, 512, 3, eBitmapFormat_Float, true);
+    testConversion(1024, 512, 4, eBitmapFormat_UnsignedByte, true);
+    testConversion(200, 100, 3, eBitmapFormat_UnsignedByte, true);
+
+    printf("CubemapTest passed (USE_SSE_MATH = %d), the largest RGBA float difference is %g\n", USE_SSE_MATH, maxDiff);
+    return 0;
+}
@@ -0,0 +1,125 @@
+// Checks that the batched frustum culling gives exactly the same results as the scalar isBoxInFrustum():
+// cullBoxes() on its own and through the BVH traversal, for random boxes and cameras
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "Scene/BVH.h"
+#include "Utils/UtilsMath.h"
+
+#include "TestUtils.h"
+
+static BoundingBox randomBox(float worldSize, float maxBoxSize)
+{
+    const vec3 center = randomVec(vec3(-worldSize), vec3(worldSize));
+    const vec3 halfSize = 0.5f * randomVec(vec3(0.0f), vec3(maxBoxSize));
+    return BoundingBox(center - halfSize, center + halfSize);
+}
+
+static glm::mat4 randomViewProj(float worldSize)
+{
+    const vec3 eye = randomVec(vec3(-worldSize), vec3(worldSize));
+    const vec3 target = randomVec(vec3(-worldSize), vec3(worldSize));
+    const glm::mat4 view = glm::lookAt(eye, target, vec3(0.0f, 1.0f, 0.0f));
+
+    // every other camera is an orthographic one, like the light projections of the shadow caster culling
+    static int counter = 0;
+    if (counter++ % 2)
+        return glm::ortho(-worldSize * 0.3f, worldSize * 0.2f, -worldSize * 0.25f, worldSize * 0.3f, 0.1f, worldSize) * view;
+
+    return glm::perspective(randomFloat(0.3f, 1.5f), randomFloat(0.5f, 2.0f), 0.1f, randomFloat(worldSize * 0.2f, worldSize * 2.0f)) * view;
+}
+
+int main()
+{
+    srand(12345);
+
+    const float worldSize = 100.0f;
+
+    std::vector<BoundingBox> boxes(1001);
+    for (auto &b : boxes)
+        b = randomBox(worldSize, 20.0f);
+
+    BoundingBoxesSoA boxesSoA;
+    boxesSoA.resize(boxes.size());
+    for (size_t i = 0; i != boxes.size(); i++)
+        boxesSoA.set(i, boxes[i]);
+
+    BVH bvh;
+    buildBVH(bvh, boxes);
+
+    std::vector<uint32_t> visibility((boxes.size() + 31) / 32);
+    std::vector<uint32_t> visibleItems;
+
+    uint32_t totalVisible = 0;
+
+    for (int camera = 0; camera != 200; camera++)
+    {
+        const glm::mat4 viewProj = randomViewProj(worldSize);
+        const CullingFrustum frustum = getCullingFrustum(viewProj);
+
+        glm::vec4 planes[6], corners[8];
+        getFrustumPlanes(viewProj, planes);
+        getFrustumCorners(viewProj, corners);
+
+        cullBoxes(frustum, boxesSoA, visibility.data());
+
+        std::vector<uint32_t> expected;
+        for (uint32_t i = 0; i != (uint32_t)boxes.size(); i++)
+        {
+            const bool visible = isBoxInFrustum(planes, corners, boxes[i]);
+            CHECK(isBoxInFrustum(frustum, boxes[i]) == visible);
+            CHECK(((visibility[i / 32] >> (i % 32)) & 1) == (visible ? 1u : 0u));
+            if (visible)
+                expected.push_back(i);
+        }
+
+        // a range which is not aligned to 4 boxes goes through the scalar tail as well
+        const size_t first = 3 + camera % 5;
+        const size_t count = 37;
+        uint32_t rangeVisibility[2];
+        cullBoxes(frustum, boxesSoA, first, count, rangeVisibility);
+        for (size_t i = 0; i != count; i++)
+            CHECK(((rangeVisibility[i / 32] >> (i % 32)) & 1) == ((visibility[(first + i) / 32] >> ((first + i) % 32)) & 1));
+
+        cullBVH(bvh, frustum, visibleItems);
+        std::sort(visibleItems.begin(), visibleItems.end());
+        CHECK(visibleItems == expected);
+
+        totalVisible += (uint32_t)expected.size();
+    }
+
+    // the cameras must see something, or the comparisons above prove nothing
+    CHECK(totalVisible > 0);
+
+    // moving some of the boxes only refits the tree, the traversal uses the new boxes
+    std::vector<uint32_t> moved;
+    for (uint32_t i = 0; i < (uint32_t)boxes.size(); i += 17)
+    {
+        boxes[i] = randomBox(worldSize, 20.0f);
+        boxesSoA.set(i, boxes[i]);
+        moved.push_back(i);
+    }
+    refitBVH(bvh, boxes, moved);
+
+    for (int camera = 0; camera != 50; camera++)
+    {
+        const CullingFrustum frustum = getCullingFrustum(randomViewProj(worldSize));
+
+        std::vector<uint32_t> expected;
+        for (uint32_t i = 0; i != (uint32_t)boxes.size(); i++)
+            if (isBoxInFrustum(frustum, boxes[i]))
+                expected.push_back(i);
+
+        cullBVH(bvh, frustum, visibleItems);
+        std::sort(visibleItems.begin(), visibleItems.end());
+        CHECK(visibleItems == expected);
+    }
+
+    printf("CullingTest passed, %u visible boxes in total\n", totalVisible);
+    return 0;
+}
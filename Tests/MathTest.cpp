@@ -0,0 +1,114 @@
+// Compares the SSE math of UtilsMath.h with glm: mulMat4() must be bitwise identical to operator*,
+// and the Arvo box transform must stay within a few ULPs of transforming the 8 corners
+
+#include <float.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "Utils/UtilsMath.h"
+
+#include "TestUtils.h"
+
+static glm::mat4 randomMatrix()
+{
+    glm::mat4 m;
+    for (int c = 0; c != 4; c++)
+        for (int r = 0; r != 4; r++)
+            m[c][r] = randomFloat(-10.0f, 10.0f);
+    return m;
+}
+
+// the kind of matrices a scene graph is made of
+static glm::mat4 randomAffineMatrix()
+{
+    glm::mat4 m = glm::translate(glm::mat4(1.0f), randVec() * 20.0f);
+    m = glm::rotate(m, randomFloat(-Math::PI, Math::PI), glm::normalize(randVec() + vec3(0.01f)));
+    return glm::scale(m, randomVec(vec3(0.1f), vec3(4.0f)));
+}
+
+// Arvo's method adds the products in another order than the corner transform. Each output coordinate is a sum of
+// 4 terms, so the difference of the two is bounded by a few roundings of the largest partial sum
+static float getRoundingBound(const glm::mat4 &t, const BoundingBox &box, int axis)
+{
+    float magnitude = fabsf(t[3][axis]);
+    for (int j = 0; j != 3; j++)
+        magnitude += std::max(fabsf(t[j][axis] * box.min_[j]), fabsf(t[j][axis] * box.max_[j]));
+    return 4.0f * FLT_EPSILON * magnitude;
+}
+
+int main()
+{
+    srand(12345);
+
+    const int kNumCases = 100000;
+
+    // mulMat4() vs glm::operator*
+    for (int i = 0; i != kNumCases; i++)
+    {
+        const glm::mat4 a = (i % 2) ? randomMatrix() : randomAffineMatrix();
+        const glm::mat4 b = (i % 3) ? randomMatrix() : randomAffineMatrix();
+
+        const glm::mat4 expected = a * b;
+        const glm::mat4 result = mulMat4(a, b);
+        CHECK(memcmp(glm::value_ptr(expected), glm::value_ptr(result), sizeof(glm::mat4)) == 0);
+    }
+
+    // a chain of products, as in a deep hierarchy
+    glm::mat4 expected(1.0f), result(1.0f);
+    for (int i = 0; i != 64; i++)
+    {
+        const glm::mat4 local = randomAffineMatrix();
+        expected = expected * local;
+        result = mulMat4(result, local);
+    }
+    CHECK(memcmp(glm::value_ptr(expected), glm::value_ptr(result), sizeof(glm::mat4)) == 0);
+
+    // BoundingBox::transform() vs transformCorners()
+    float maxRelativeError = 0.0f;
+
+    for (int i = 0; i != kNumCases; i++)
+    {
+        const glm::mat4 t = randomAffineMatrix();
+        const BoundingBox box(randVec(), randVec());
+
+        CHECK(isAffine(t));
+
+        BoundingBox arvo = box;
+        arvo.transform(t);
+
+        BoundingBox corners = box;
+        corners.transformCorners(t);
+
+        for (int axis = 0; axis != 3; axis++)
+        {
+            const float bound = getRoundingBound(t, box, axis);
+            CHECK(fabsf(arvo.min_[axis] - corners.min_[axis]) <= bound);
+            CHECK(fabsf(arvo.max_[axis] - corners.max_[axis]) <= bound);
+            maxRelativeError = std::max(maxRelativeError, std::max(fabsf(arvo.min_[axis] - corners.min_[axis]), fabsf(arvo.max_[axis] - corners.max_[axis])) / bound);
+        }
+    }
+
+    // the perspective matrices are not affine, they take the corner path and give the same result
+    for (int i = 0; i != 1000; i++)
+    {
+        const glm::mat4 t = glm::perspective(randomFloat(0.5f, 1.5f), randomFloat(0.5f, 2.0f), 0.1f, 100.0f) * randomAffineMatrix();
+        const BoundingBox box(randVec(), randVec());
+
+        CHECK(!isAffine(t));
+
+        BoundingBox transformed = box;
+        transformed.transform(t);
+
+        BoundingBox corners = box;
+        corners.transformCorners(t);
+
+        CHECK(memcmp(&transformed, &corners, sizeof(BoundingBox)) == 0);
+    }
+
+    printf("MathTest passed (USE_SSE_MATH = %d), the largest box difference is %.3f of the rounding bound\n", USE_SSE_MATH, maxRelativeError);
+    return 0;
+}
@@ -0,0 +1,232 @@
+// Compares the MIP chains of buildMipChain() with a straightforward reference: a direct 2D filter in double precision
+// with the sRGB conversions written out, one level from the previous unrounded one. The box and the Kaiser filters
+// are checked on the sRGB (color) and the linear (data) paths, on square, non-square and odd sizes.
+// Every texel of every level must be within one 8-bit code of the reference. The alpha coverage of the alpha-tested
+// textures is checked separately, it changes the stored alpha on purpose
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../Tool/TextureProcessing.h"
+
+#include "TestUtils.h"
+
+// the Kaiser window of ImageResampling.cpp: 3 destination texels on each side, alpha = 4
+const double kKaiserWidth = 3.0;
+const double kKaiserAlpha = 4.0;
+
+const double kPi = 3.14159265358979323846;
+
+struct ReferenceImage
+{
+    uint32_t w_ = 0;
+    uint32_t h_ = 0;
+    std::vector<double> data_;
+};
+
+static double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k != 64; k++)
+    {
+        term *= (x * x * 0.25) / (double)(k * k);
+        sum += term;
+    }
+    return sum;
+}
+
+static double referenceWeight(ResampleFilter filter, double t)
+{
+    if (filter == ResampleFilter_Box)
+        return (fabs(t) <= 0.5) ? 1.0 : 0.0;
+
+    if (fabs(t) >= kKaiserWidth)
+        return 0.0;
+
+    const double sinc = (t == 0.0) ? 1.0 : sin(kPi * t) / (kPi * t);
+    const double r = t / kKaiserWidth;
+    return sinc * besselI0(kKaiserAlpha * sqrt(1.0 - r * r)) / besselI0(kKaiserAlpha);
+}
+
+// the weights of all the source texels (the ones outside the image repeat the edge texels) for one destination texel
+static std::vector<double> referenceWeights(uint32_t srcSize, uint32_t dstSize, uint32_t i, ResampleFilter filter)
+{
+    std::vector<double> weights(srcSize, 0.0);
+
+    if (srcSize == dstSize)
+    {
+        weights[i] = 1.0;
+        return weights;
+    }
+
+    const double scale = (double)srcSize / (double)dstSize;
+    const double center = ((double)i + 0.5) * scale;
+
+    double sum = 0.0;
+    for (int j = -16 * (int)srcSize; j <= 16 * (int)srcSize; j++)
+    {
+        const double weight = referenceWeight(filter, ((double)j + 0.5 - center) / scale);
+        weights[std::clamp(j, 0, (int)srcSize - 1)] += weight;
+        sum += weight;
+    }
+
+    for (double &w : weights)
+        w /= sum;
+
+    return weights;
+}
+
+static ReferenceImage referenceDownsample(const ReferenceImage &src, ResampleFilter filter)
+{
+    ReferenceImage dst;
+    dst.w_ = std::max(src.w_ / 2, 1u);
+    dst.h_ = std::max(src.h_ / 2, 1u);
+    dst.data_.resize(dst.w_ * dst.h_ * 4);
+
+    for (uint32_t y = 0; y != dst.h_; y++)
+    {
+        const std::vector<double> wy = referenceWeights(src.h_, dst.h_, y, filter);
+
+        for (uint32_t x = 0; x != dst.w_; x++)
+        {
+            const std::vector<double> wx = referenceWeights(src.w_, dst.w_, x, filter);
+
+            for (uint32_t c = 0; c != 4; c++)
+            {
+                double v = 0.0;
+                for (uint32_t sy = 0; sy != src.h_; sy++)
+                    for (uint32_t sx = 0; sx != src.w_; sx++)
+                        v += wx[sx] * wy[sy] * src.data_[(sy * src.w_ + sx) * 4 + c];
+
+                dst.data_[(y * dst.w_ + x) * 4 + c] = std::clamp(v, 0.0, 1.0);
+            }
+        }
+    }
+
+    return dst;
+}
+
+static double srgbToLinear(double c)
+{
+    return (c <= 0.04045) ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+}
+
+static double linearToSrgb(double c)
+{
+    return (c <= 0.0031308) ? c * 12.92 : 1.055 * pow(c, 1.0 / 2.4) - 0.055;
+}
+
+static int toByte(double v)
+{
+    return (int)floor(std::clamp(v, 0.0, 1.0) * 255.0 + 0.5);
+}
+
+static std::vector<uint8_t> makeTexture(uint32_t w, uint32_t h, bool alphaTested)
+{
+    std::vector<uint8_t> rgba(w * h * 4);
+
+    for (uint32_t i = 0; i != w * h; i++)
+    {
+        for (uint32_t c = 0; c != 3; c++)
+            rgba[i * 4 + c] = (uint8_t)(rand() & 255);
+
+        // leaves: opaque or fully transparent blobs with a soft edge
+        const uint32_t x = i % w, y = i / w;
+        rgba[i * 4 + 3] = alphaTested ? (uint8_t)((((x / 3) ^ (y / 2)) & 1) ? 255 - (rand() & 31) : rand() & 31) : (uint8_t)(rand() & 255);
+    }
+
+    return rgba;
+}
+
+static void checkAgainstReference(uint32_t w, uint32_t h, TextureUsage usage, ResampleFilter filter)
+{
+    const std::vector<uint8_t> rgba = makeTexture(w, h, false);
+
+    const TextureProcessingConfig cfg = {.usage = usage, .mipFilter = filter, .compress = false};
+
+    std::vector<std::vector<uint8_t>> levels;
+    buildMipChain(rgba.data(), w, h, cfg, levels);
+
+    const bool srgb = (usage == TextureUsage_Color);
+
+    ReferenceImage level{.w_ = w, .h_ = h};
+    level.data_.resize(w * h * 4);
+    for (uint32_t i = 0; i != w * h * 4; i++)
+        level.data_[i] = (srgb && (i % 4) != 3) ? srgbToLinear(rgba[i] / 255.0) : rgba[i] / 255.0;
+
+    uint32_t numLevels = 1;
+    while (level.w_ > 1 || level.h_ > 1)
+    {
+        level = referenceDownsample(level, filter);
+
+        CHECK(numLevels < levels.size());
+        const std::vector<uint8_t> &result = levels[numLevels++];
+        CHECK(result.size() == level.w_ * level.h_ * 4);
+
+        for (uint32_t i = 0; i != result.size(); i++)
+        {
+            const double v = level.data_[i];
+            const int expected = (srgb && (i % 4) != 3) ? toByte(linearToSrgb(v)) : toByte(v);
+            CHECK(abs((int)result[i] - expected) <= 1);
+        }
+    }
+
+    CHECK(numLevels == levels.size());
+}
+
+static float getCoverage(const std::vector<uint8_t> &rgba, float alphaTest)
+{
+    const uint32_t numTexels = (uint32_t)rgba.size() / 4;
+
+    uint32_t passed = 0;
+    for (uint32_t i = 0; i != numTexels; i++)
+        if (rgba[i * 4 + 3] >= alphaTest * 255.0f)
+            passed++;
+
+    return (float)passed / (float)numTexels;
+}
+
+static void checkAlphaCoverage(uint32_t w, uint32_t h, ResampleFilter filter)
+{
+    const std::vector<uint8_t> rgba = makeTexture(w, h, true);
+    const float alphaTest = 0.5f;
+
+    const TextureProcessingConfig cfg = {.usage = TextureUsage_Color, .alphaTest = alphaTest, .mipFilter = filter, .compress = false};
+
+    std::vector<std::vector<uint8_t>> levels;
+    buildMipChain(rgba.data(), w, h, cfg, levels);
+
+    const float coverage = getCoverage(levels[0], alphaTest);
+
+    // one texel is the finest step of the coverage, and the bytes round the scaled alpha
+    for (const std::vector<uint8_t> &level : levels)
+        if (level.size() / 4 >= 64)
+            CHECK(fabsf(getCoverage(level, alphaTest) - coverage) <= 0.05f);
+}
+
+int main()
+{
+    srand(12345);
+
+    for (ResampleFilter filter : {ResampleFilter_Box, ResampleFilter_Kaiser})
+    {
+        for (TextureUsage usage : {TextureUsage_Color, TextureUsage_Data})
+        {
+            checkAgainstReference(32, 32, usage, filter);
+            // 40x24 -> 20x12 -> 10x6 -> 5x3 -> 2x1 -> 1x1: the odd sizes and the 1-texel dimension
+            checkAgainstReference(40, 24, usage, filter);
+            checkAgainstReference(1, 16, usage, filter);
+        }
+
+        checkAlphaCoverage(64, 64, filter);
+    }
+
+    printf("MipChainTest passed\n");
+    return 0;
+}
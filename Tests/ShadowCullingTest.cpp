@@ -0,0 +1,232 @@
+// Checks which shapes findShadowCasters() keeps: every box reaching into the caster volume (the visible receivers
+// extended up to the top of the scene) must be kept, and none whose light-space box misses it. Also checks that the
+// light projection covers the visible receivers and stays on the shadow map texel grid while the camera moves
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "Scene/BVH.h"
+#include "Utils/UtilsMath.h"
+
+#include "TestUtils.h"
+
+static const uint32_t kShadowMapSize = 2048;
+
+static BoundingBox randomBox(float worldSize, float maxBoxSize)
+{
+    const vec3 center = randomVec(vec3(-worldSize), vec3(worldSize));
+    const vec3 halfSize = 0.5f * randomVec(vec3(0.0f), vec3(maxBoxSize));
+    return BoundingBox(center - halfSize, center + halfSize);
+}
+
+static glm::mat4 getLightView(const vec3 &lightDir)
+{
+    const vec3 up = fabsf(lightDir.z) < 0.9f ? vec3(0.0f, 0.0f, 1.0f) : vec3(1.0f, 0.0f, 0.0f);
+    return glm::lookAt(vec3(0.0f), lightDir, up);
+}
+
+static bool isNearInteger(float x, float tolerance)
+{
+    return fabsf(x - roundf(x)) <= tolerance;
+}
+
+struct CasterVolume
+{
+    BoundingBox receivers_;
+    float top_;
+};
+
+static bool isInside(const CasterVolume &v, const vec3 &p, float margin)
+{
+    return p.x > v.receivers_.min_.x + margin && p.x < v.receivers_.max_.x - margin && p.y > v.receivers_.min_.y + margin &&
+           p.y < v.receivers_.max_.y - margin && p.z > v.receivers_.min_.z + margin && p.z < v.top_ - margin;
+}
+
+static bool overlaps(const CasterVolume &v, const BoundingBox &b, float margin)
+{
+    return b.max_.x >= v.receivers_.min_.x - margin && b.min_.x <= v.receivers_.max_.x + margin && b.max_.y >= v.receivers_.min_.y - margin &&
+           b.min_.y <= v.receivers_.max_.y + margin && b.max_.z >= v.receivers_.min_.z - margin && b.min_.z <= v.top_ + margin;
+}
+
+// The texel size and the extent of the snapped bounds along one axis. The extent spans shadowMapSize texels, and
+// shadowMapSize - 1 of them are a power of 2^(1/8)
+static void checkSnapped(float minValue, float maxValue)
+{
+    const float texel = (maxValue - minValue) / (float)kShadowMapSize;
+    CHECK(texel > 0.0f);
+    CHECK(isNearInteger(minValue / texel, 1e-2f));
+    CHECK(isNearInteger(log2f(texel * (float)(kShadowMapSize - 1)) * 8.0f, 1e-3f));
+}
+
+int main()
+{
+    srand(12345);
+
+    const float worldSize = 100.0f;
+    const float margin = 1e-3f * worldSize;
+
+    std::vector<BoundingBox> boxes(1001);
+    for (auto &b : boxes)
+        b = randomBox(worldSize, 20.0f);
+
+    BVH bvh;
+    buildBVH(bvh, boxes);
+
+    BoundingBox receivers;
+    std::vector<uint32_t> candidates;
+
+    uint32_t totalKept = 0, totalRejected = 0;
+
+    for (int camera = 0; camera != 500; camera++)
+    {
+        const vec3 eye = randomVec(vec3(-worldSize), vec3(worldSize));
+        const vec3 target = randomVec(vec3(-worldSize), vec3(worldSize));
+        const glm::mat4 viewProj = glm::perspective(randomFloat(0.3f, 1.5f), randomFloat(0.5f, 2.0f), 0.1f, randomFloat(10.0f, 100.0f)) *
+                                   glm::lookAt(eye, target, vec3(0.0f, 1.0f, 0.0f));
+
+        const glm::mat4 lightView = getLightView(glm::normalize(randVec() + vec3(0.0f, -0.5f, 0.0f)));
+
+        // the visible receivers, computed the slow way: the camera frustum clipped by the scene box, in light space
+        glm::vec4 corners[8];
+        getFrustumCorners(viewProj, corners);
+
+        BoundingBox visible(vec3(lightView * corners[0]), vec3(lightView * corners[0]));
+        for (int i = 1; i != 8; i++)
+            visible.combinePoint(vec3(lightView * corners[i]));
+
+        // like the root of the BVH, the world-space box of the whole scene
+        BoundingBox sceneBox = boxes[0];
+        for (const BoundingBox &b : boxes)
+            sceneBox = BoundingBox(glm::min(sceneBox.min_, b.min_), glm::max(sceneBox.max_, b.max_));
+        sceneBox.transform(lightView);
+
+        const bool seesScene = visible.min_.x <= sceneBox.max_.x && visible.max_.x >= sceneBox.min_.x && visible.min_.y <= sceneBox.max_.y &&
+                               visible.max_.y >= sceneBox.min_.y && visible.min_.z <= sceneBox.max_.z && visible.max_.z >= sceneBox.min_.z;
+
+        const bool found = findShadowCasters(bvh, viewProj, lightView, kShadowMapSize, receivers, candidates);
+
+        // the cameras near the edge of the scene are decided by rounding, skip them
+        const vec3 overlap = glm::min(visible.max_, sceneBox.max_) - glm::max(visible.min_, sceneBox.min_);
+        const bool isClear = std::min({overlap.x, overlap.y, overlap.z}) > margin || std::min({overlap.x, overlap.y, overlap.z}) < -margin;
+
+        if (isClear)
+            CHECK(found == seesScene);
+
+        if (!found)
+        {
+            CHECK(candidates.empty());
+            continue;
+        }
+
+        // the snapped bounds cover the visible receivers, at most one rounding step and a texel larger
+        for (int axis = 0; axis != 2; axis++)
+        {
+            const float visibleMin = std::max(visible.min_[axis], sceneBox.min_[axis]);
+            const float visibleMax = std::min(visible.max_[axis], sceneBox.max_[axis]);
+            CHECK(receivers.min_[axis] <= visibleMin + margin);
+            CHECK(receivers.max_[axis] >= visibleMax - margin);
+            CHECK(receivers.max_[axis] - receivers.min_[axis] <= std::max(visibleMax - visibleMin, 1e-4f) * 1.1f + margin);
+        }
+
+        checkSnapped(receivers.min_.x, receivers.max_.x);
+        checkSnapped(receivers.min_.y, receivers.max_.y);
+
+        const CasterVolume volume = {receivers, sceneBox.max_.z};
+
+        std::vector<bool> kept(boxes.size(), false);
+        for (uint32_t s : candidates)
+            kept[s] = true;
+
+        for (size_t i = 0; i != boxes.size(); i++)
+        {
+            // a box with a corner inside the caster volume must be kept...
+            bool cornerInside = false;
+            for (int c = 0; c != 8; c++)
+            {
+                const vec3 corner((c & 1) ? boxes[i].max_.x : boxes[i].min_.x, (c & 2) ? boxes[i].max_.y : boxes[i].min_.y, (c & 4) ? boxes[i].max_.z : boxes[i].min_.z);
+                cornerInside = cornerInside || isInside(volume, vec3(lightView * glm::vec4(corner, 1.0f)), margin);
+            }
+            if (cornerInside)
+                CHECK(kept[i]);
+
+            // ...and a box whose light-space box misses it must not
+            if (!overlaps(volume, boxes[i].getTransformed(lightView), margin))
+                CHECK(!kept[i]);
+
+            totalKept += kept[i] ? 1 : 0;
+            totalRejected += kept[i] ? 0 : 1;
+        }
+    }
+
+    // both outcomes must occur, or the checks above prove nothing
+    CHECK(totalKept > 0 && totalRejected > 0);
+
+    // A light shining straight down onto a camera looking down at the ground. The light-space Z is the world Y
+    {
+        std::vector<BoundingBox> scene = {
+            BoundingBox(vec3(-100.0f, -1.0f, -100.0f), vec3(100.0f, 0.0f, 100.0f)), // ground
+            BoundingBox(vec3(2.0f, 0.0f, 2.0f), vec3(3.0f, 50.0f, 3.0f)),           // a pole in the view, reaching far above the camera
+            BoundingBox(vec3(60.0f, 0.0f, 60.0f), vec3(61.0f, 50.0f, 61.0f)),       // a pole outside the view
+            BoundingBox(vec3(0.0f, -90.0f, 0.0f), vec3(1.0f, -80.0f, 1.0f)),        // below everything the camera sees
+        };
+
+        BVH sceneBVH;
+        buildBVH(sceneBVH, scene);
+
+        const glm::mat4 lightView = getLightView(vec3(0.0f, -1.0f, 0.0f));
+        const glm::mat4 viewProj = glm::perspective(1.0f, 1.0f, 0.1f, 40.0f) * glm::lookAt(vec3(0.0f, 20.0f, 0.0f), vec3(0.0f), vec3(0.0f, 0.0f, 1.0f));
+
+        CHECK(findShadowCasters(sceneBVH, viewProj, lightView, kShadowMapSize, receivers, candidates));
+        std::sort(candidates.begin(), candidates.end());
+        CHECK(candidates == std::vector<uint32_t>({0, 1}));
+
+        // looking at the sky
+        const glm::mat4 skyViewProj = glm::perspective(1.0f, 1.0f, 0.1f, 10.0f) * glm::lookAt(vec3(0.0f, 200.0f, 0.0f), vec3(0.0f, 300.0f, 0.0f), vec3(0.0f, 0.0f, 1.0f));
+        CHECK(!findShadowCasters(sceneBVH, skyViewProj, lightView, kShadowMapSize, receivers, candidates));
+        CHECK(candidates.empty());
+    }
+
+    // A camera sliding over a large scene in sub-texel steps: the extent stays the same and the bounds move by whole texels
+    {
+        const std::vector<BoundingBox> scene = {BoundingBox(vec3(-1000.0f, -1.0f, -1000.0f), vec3(1000.0f, 0.0f, 1000.0f))};
+
+        BVH sceneBVH;
+        buildBVH(sceneBVH, scene);
+
+        const glm::mat4 lightView = getLightView(glm::normalize(vec3(0.3f, -1.0f, 0.2f)));
+        const glm::mat4 proj = glm::perspective(1.0f, 1.5f, 0.1f, 30.0f);
+
+        BoundingBox first;
+        float texel[2] = {};
+
+        for (int frame = 0; frame != 200; frame++)
+        {
+            const vec3 eye = vec3(0.0f, 10.0f, 0.0f) + vec3(0.013f, 0.0f, 0.007f) * (float)frame;
+            const glm::mat4 viewProj = proj * glm::lookAt(eye, eye + vec3(1.0f, -0.5f, 0.3f), vec3(0.0f, 1.0f, 0.0f));
+
+            CHECK(findShadowCasters(sceneBVH, viewProj, lightView, kShadowMapSize, receivers, candidates));
+
+            if (!frame)
+            {
+                first = receivers;
+                texel[0] = (receivers.max_.x - receivers.min_.x) / (float)kShadowMapSize;
+                texel[1] = (receivers.max_.y - receivers.min_.y) / (float)kShadowMapSize;
+                continue;
+            }
+
+            for (int axis = 0; axis != 2; axis++)
+            {
+                CHECK(fabsf((receivers.max_[axis] - receivers.min_[axis]) - (first.max_[axis] - first.min_[axis])) <= 1e-3f * texel[axis]);
+                CHECK(isNearInteger((receivers.min_[axis] - first.min_[axis]) / texel[axis], 1e-2f));
+            }
+        }
+    }
+
+    printf("ShadowCullingTest passed, %u boxes kept and %u rejected in total\n", totalKept, totalRejected);
+    return 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// The tests are plain executables run by CTest. A failed check prints where it failed and ends the test
+#define CHECK(cond)                                                               \
+    do                                                                            \
+    {                                                                             \
+        if (!(cond))                                                              \
+        {                                                                         \
+            printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #cond);      \
+            exit(EXIT_FAILURE);                                                   \
+        }                                                                         \
+    } while (0)
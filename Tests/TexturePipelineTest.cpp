@@ -0,0 +1,99 @@
+// Runs the texture pipeline over a small job set with a memory budget smaller than some of the textures,
+// checks that the reservations stay within the budget and that the broken opacity maps are handled
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "../Tool/TexturePipeline.h"
+
+#include "TestUtils.h"
+
+// SceneConverter.cpp has these for the converter
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+namespace fs = std::filesystem;
+
+const char *const kTestDir = "TexturePipelineTest/";
+
+static std::string writeTestImage(const char *name, uint32_t width, uint32_t height, int channels)
+{
+    std::vector<uint8_t> pixels((size_t)width * height * channels);
+    for (size_t i = 0; i != pixels.size(); i++)
+        pixels[i] = (uint8_t)((i * 7) ^ (i >> 9));
+
+    const std::string fileName = kTestDir + std::string(name);
+    CHECK(stbi_write_png(fileName.c_str(), width, height, channels, pixels.data(), 0));
+    return fileName;
+}
+
+static TextureJob makeJob(const std::string &srcFile, const std::string &opacityFile, const char *outputName, bool ktxOutput)
+{
+    TextureJob job = {
+        .srcFile = srcFile,
+        .opacityFile = opacityFile,
+        .outputFile = kTestDir + std::string(outputName),
+        .maxSize = 256,
+        .ktxOutput = ktxOutput,
+        .settingsKey = 1,
+    };
+    job.textureCfg.compress = ktxOutput;
+    return job;
+}
+
+int main()
+{
+    fs::remove_all(kTestDir);
+    fs::create_directories(kTestDir);
+
+    const std::string large = writeTestImage("large.png", 1024, 1024, 4);
+    const std::string wide = writeTestImage("wide.png", 1024, 128, 3);
+    const std::string small = writeTestImage("small.png", 200, 100, 4);
+    const std::string mask = writeTestImage("mask.png", 200, 100, 1);
+    const std::string halfMask = writeTestImage("half_mask.png", 100, 50, 1);
+
+    std::vector<TextureJob> jobs = {
+        makeJob(large, std::string(), "large.ktx", true),
+        makeJob(wide, std::string(), "wide_rescaled.png", false),
+        makeJob(small, mask, "masked.ktx", true),
+        // the mask is scaled to the size of the texture
+        makeJob(small, halfMask, "half_masked.ktx", true),
+        // the texture keeps its own alpha
+        makeJob(small, kTestDir + std::string("missing_mask.png"), "missing_mask.ktx", true),
+    };
+
+    for (uint32_t i = 0; i != 8; i++)
+        jobs.push_back(makeJob(wide, std::string(), ("copy" + std::to_string(i) + ".ktx").c_str(), true));
+
+    // the large texture alone needs more than this
+    const TexturePipelineConfig cfg = {.workers = 3, .memoryBudget = 4 * 1024 * 1024};
+
+    const TexturePipelineStats stats = runTexturePipeline(jobs, cfg);
+
+    CHECK(stats.converted == jobs.size());
+    CHECK(stats.upToDate == 0);
+    CHECK(stats.failed == 1);
+    CHECK(stats.peakMemory > 0);
+    CHECK(stats.peakMemory <= cfg.memoryBudget);
+
+    for (const TextureJob &job : jobs)
+        CHECK(fs::exists(job.outputFile) && fs::exists(job.outputFile + ".hash"));
+
+    // nothing changed, so everything is reused
+    const TexturePipelineStats rerun = runTexturePipeline(jobs, cfg);
+
+    CHECK(rerun.converted == 0);
+    CHECK(rerun.upToDate == jobs.size());
+    CHECK(rerun.peakMemory <= cfg.memoryBudget);
+
+    fs::remove_all(kTestDir);
+
+    printf("TexturePipelineTest passed, peak memory %zu of %zu bytes\n", stats.peakMemory, cfg.memoryBudget);
+    return 0;
+}
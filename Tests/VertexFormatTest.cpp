@@ -0,0 +1,139 @@
+// Saves random vertices in every VertexFormat and loads them back: the float format must be lossless, the packed
+// and quantized ones must stay within the error bounds of their encodings (half uvs, 16-bit octahedral normals
+// and 16-bit positions relative to the bounds of the file)
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "Scene/VtxData.h"
+
+#include "TestUtils.h"
+
+const char *const kTestFile = "VertexFormatTest.meshes";
+
+static void addVertex(std::vector<float> &v, const vec3 &pos, const glm::vec2 &uv, const vec3 &normal)
+{
+    v.insert(v.end(), {pos.x, pos.y, pos.z, uv.x, uv.y, normal.x, normal.y, normal.z});
+}
+
+static MeshData makeMeshData()
+{
+    MeshData m;
+
+    // the seams of the octahedral encoding: the axes, the equator where the lower half is folded and the diagonals
+    const vec3 normals[] = {vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1),
+                            vec3(1, 1, 0), vec3(-1, 1, 0), vec3(1, -1, 0), vec3(-1, -1, 0), vec3(1, 1, 1), vec3(-1, -1, -1), vec3(1, -1, -1)};
+    for (const vec3 &n : normals)
+        addVertex(m.vertexData_, vec3(0.0f), glm::vec2(0.0f, 1.0f), glm::normalize(n));
+
+    for (int i = 0; i != 20000; i++)
+    {
+        const vec3 pos = randomVec(vec3(-50.0f, -2.0f, -300.0f), vec3(50.0f, 30.0f, 10.0f));
+        // tiling uvs outside [0, 1] and tiny ones near zero, where the half floats are denormal
+        const glm::vec2 uv = (i % 8) ? glm::vec2(randomFloat(-4.0f, 4.0f), randomFloat(-4.0f, 4.0f)) : glm::vec2(randomFloat(-1e-5f, 1e-5f), randomFloat(0.0f, 1.0f));
+        addVertex(m.vertexData_, pos, uv, glm::normalize(randomVec(vec3(-1.0f), vec3(1.0f)) + vec3(0.0f, 0.0f, 1e-6f)));
+    }
+
+    const uint32_t numVertices = (uint32_t)(m.vertexData_.size() / 8);
+
+    Mesh mesh;
+    mesh.streamCount = 1;
+    mesh.streamElementSize[0] = 8 * sizeof(float);
+    mesh.vertexCount = numVertices;
+    mesh.lodOffset[1] = numVertices;
+
+    for (uint32_t i = 0; i != numVertices; i++)
+        m.indexData_.push_back(i);
+
+    m.meshes_.push_back(mesh);
+    m.boxes_.emplace_back(vec3(-50.0f, -2.0f, -300.0f), vec3(50.0f, 30.0f, 10.0f));
+
+    return m;
+}
+
+// the angle between two unit vectors in degrees, accurate for tiny angles unlike acos(dot)
+static float getAngle(const vec3 &a, const vec3 &b)
+{
+    return 2.0f * asinf(std::min(0.5f * glm::length(a - b), 1.0f)) * 180.0f / Math::PI;
+}
+
+int main()
+{
+    srand(12345);
+
+    const MeshData original = makeMeshData();
+    const std::vector<float> &v = original.vertexData_;
+
+    for (VertexFormat format : {VertexFormat_Float, VertexFormat_Packed, VertexFormat_Quantized})
+    {
+        saveMeshData(kTestFile, original, format);
+
+        MeshData loaded;
+        VertexFormat loadedFormat = VertexFormat_Float;
+        const MeshFileHeader header = loadMeshData(kTestFile, loaded, &loadedFormat);
+
+        CHECK(loadedFormat == format);
+        CHECK(header.meshCount == 1);
+        CHECK(loaded.indexData_ == original.indexData_);
+        CHECK(loaded.meshes_[0].streamElementSize[0] == 8 * sizeof(float));
+        CHECK(loaded.vertexData_.size() == v.size());
+
+        const std::vector<float> &r = loaded.vertexData_;
+
+        if (format == VertexFormat_Float)
+        {
+            CHECK(memcmp(r.data(), v.data(), v.size() * sizeof(float)) == 0);
+            continue;
+        }
+
+        float maxPosError = 0.0f, maxUVError = 0.0f, maxNormalAngle = 0.0f;
+
+        for (size_t i = 0; i < v.size(); i += 8)
+        {
+            for (int c = 0; c != 3; c++)
+            {
+                if (format == VertexFormat_Packed)
+                {
+                    CHECK(r[i + c] == v[i + c]);
+                    continue;
+                }
+
+                // half a step of 16 bits over the extent of the file, plus the rounding of the float arithmetic
+                const float extent = original.boxes_[0].max_[c] - original.boxes_[0].min_[c];
+                const float error = fabsf(r[i + c] - v[i + c]);
+                CHECK(error <= 0.5f * extent / 65535.0f + 4.0f * FLT_EPSILON * extent);
+                maxPosError = std::max(maxPosError, error / extent);
+            }
+
+            // half floats keep 11 significant bits; below 2^-14 the step is a constant 2^-24
+            for (int c = 3; c != 5; c++)
+            {
+                const float error = fabsf(r[i + c] - v[i + c]);
+                CHECK(error <= std::max(fabsf(v[i + c]) * 0x1p-11f, 0x1p-25f));
+                maxUVError = std::max(maxUVError, error);
+            }
+
+            // 16-bit octahedral normals: the grid step of 2/65534 on the octahedron is at most about 0.005 degrees on the sphere
+            const vec3 n(v[i + 5], v[i + 6], v[i + 7]);
+            const vec3 decoded(r[i + 5], r[i + 6], r[i + 7]);
+            CHECK(fabsf(glm::length(decoded) - 1.0f) <= 1e-6f);
+            const float angle = getAngle(n, decoded);
+            CHECK(angle <= 0.005f);
+            maxNormalAngle = std::max(maxNormalAngle, angle);
+        }
+
+        printf("format %u: position error %g of the extent, uv error %g, normal error %g degrees\n", format, maxPosError, maxUVError, maxNormalAngle);
+    }
+
+    remove(kTestFile);
+
+    printf("VertexFormatTest passed\n");
+    return 0;
+}
@@ -0,0 +1,398 @@
+#include "ImageResampling.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "Utils/UtilsMath.h"
+
+constexpr float kPi = 3.14159265358979f;
+
+// the half-width of the Kaiser window, in the destination texels, and its shape parameter
+constexpr float kKaiserWidth = 3.0f;
+constexpr float kKaiserAlpha = 4.0f;
+
+/* Filter taps */
+
+// The zeroth-order modified Bessel function of the first kind. The power series converges quickly for the arguments of the window
+static float besselI0(float x)
+{
+    const float halfX2 = x * x * 0.25f;
+
+    float sum = 1.0f;
+    float term = 1.0f;
+    for (int k = 1; k != 32 && term > sum * 1e-7f; k++)
+    {
+        term *= halfX2 / (float)(k * k);
+        sum += term;
+    }
+
+    return sum;
+}
+
+static float sinc(float x)
+{
+    if (fabsf(x) < 1e-6f)
+        return 1.0f;
+
+    x *= kPi;
+    return sinf(x) / x;
+}
+
+// t is the distance from the center of the filtered texel in the destination texels (or in the source ones when magnifying),
+// so the sinc cuts off everything the smaller image cannot represent
+static float filterWeight(ResampleFilter filter, float t)
+{
+    if (filter == ResampleFilter_Box)
+        return (fabsf(t) <= 0.5f) ? 1.0f : 0.0f;
+
+    if (fabsf(t) >= kKaiserWidth)
+        return 0.0f;
+
+    const float r = t / kKaiserWidth;
+    return sinc(t) * besselI0(kKaiserAlpha * sqrtf(1.0f - r * r)) / besselI0(kKaiserAlpha);
+}
+
+// The source texels contributing to every destination texel along one axis, stored flat:
+// the taps of texel i are [start_[i], start_[i + 1]) in src_ and weight_
+struct FilterTaps
+{
+    std::vector<uint32_t> start_;
+    std::vector<uint32_t> src_;
+    std::vector<float> weight_;
+};
+
+// The footprint is scaled by the actual size ratio, so the odd sizes (5 -> 2) are handled as well
+static FilterTaps computeFilterTaps(uint32_t srcSize, uint32_t dstSize, ResampleFilter filter)
+{
+    FilterTaps taps;
+    taps.start_.reserve(dstSize + 1);
+    taps.start_.push_back(0);
+
+    // the 1-texel dimension of a non-square texture stays as it is
+    if (srcSize == dstSize)
+    {
+        for (uint32_t i = 0; i != dstSize; i++)
+        {
+            taps.src_.push_back(i);
+            taps.weight_.push_back(1.0f);
+            taps.start_.push_back(i + 1);
+        }
+        return taps;
+    }
+
+    const float scale = (float)srcSize / (float)dstSize;
+    // magnification interpolates between the source texels, the filter is not widened
+    const float filterScale = std::max(scale, 1.0f);
+    const float support = ((filter == ResampleFilter_Box) ? 0.5f : kKaiserWidth) * filterScale;
+
+    for (uint32_t i = 0; i != dstSize; i++)
+    {
+        const float center = ((float)i + 0.5f) * scale;
+        const uint32_t first = (uint32_t)taps.src_.size();
+
+        float sum = 0.0f;
+        for (int j = (int)floorf(center - support); j <= (int)ceilf(center + support); j++)
+        {
+            const float weight = filterWeight(filter, ((float)j + 0.5f - center) / filterScale);
+            if (weight == 0.0f)
+                continue;
+
+            taps.src_.push_back((uint32_t)std::clamp(j, 0, (int)srcSize - 1));
+            taps.weight_.push_back(weight);
+            sum += weight;
+        }
+
+        // a box narrower than a source texel may miss all the texel centers, the nearest one is taken then
+        if (sum == 0.0f)
+        {
+            taps.src_.push_back((uint32_t)std::clamp((int)center, 0, (int)srcSize - 1));
+            taps.weight_.push_back(1.0f);
+            sum = 1.0f;
+        }
+
+        for (uint32_t t = first; t != (uint32_t)taps.weight_.size(); t++)
+            taps.weight_[t] /= sum;
+
+        taps.start_.push_back((uint32_t)taps.src_.size());
+    }
+
+    return taps;
+}
+
+/* Texel arithmetic */
+
+// All four channels of a texel are filtered at once. The operations are the same multiply-adds
+// in the same order in both versions, only the number of instructions differs
+#if USE_SSE_MATH
+using Texel4 = __m128;
+
+static inline Texel4 zeroTexel() { return _mm_setzero_ps(); }
+static inline Texel4 loadTexel(const float *p) { return _mm_loadu_ps(p); }
+static inline void storeTexel(float *p, Texel4 v) { _mm_storeu_ps(p, v); }
+static inline Texel4 mulAddTexel(Texel4 acc, Texel4 v, float w) { return _mm_add_ps(acc, _mm_mul_ps(v, _mm_set1_ps(w))); }
+// the negative lobes of the sinc overshoot near sharp edges
+static inline Texel4 saturateTexel(Texel4 v) { return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f)); }
+#else
+struct Texel4
+{
+    float v_[4];
+};
+
+static inline Texel4 zeroTexel() { return {0.0f, 0.0f, 0.0f, 0.0f}; }
+static inline Texel4 loadTexel(const float *p) { return {p[0], p[1], p[2], p[3]}; }
+static inline void storeTexel(float *p, Texel4 v) { memcpy(p, v.v_, sizeof(v.v_)); }
+
+static inline Texel4 mulAddTexel(Texel4 acc, Texel4 v, float w)
+{
+    for (int c = 0; c != 4; c++)
+        acc.v_[c] += v.v_[c] * w;
+    return acc;
+}
+
+static inline Texel4 saturateTexel(Texel4 v)
+{
+    for (int c = 0; c != 4; c++)
+        v.v_[c] = std::clamp(v.v_[c], 0.0f, 1.0f);
+    return v;
+}
+#endif
+
+/* Color conversion */
+
+static float srgbToLinear(float c)
+{
+    return (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+// Both directions go through tables: the source is 8-bit, and so is the result.
+// byteToFloat_ decodes a byte, srgbToLinear_ an sRGB byte. srgbThreshold_[b] is the smallest linear value
+// which is encoded as b, so encoding is a binary search instead of a powf() per channel
+struct ColorTables
+{
+    float byteToFloat_[256];
+    float srgbToLinear_[256];
+    float srgbThreshold_[256];
+
+    ColorTables()
+    {
+        for (int i = 0; i != 256; i++)
+        {
+            byteToFloat_[i] = (float)i / 255.0f;
+            srgbToLinear_[i] = srgbToLinear((float)i / 255.0f);
+            srgbThreshold_[i] = srgbToLinear(((float)i - 0.5f) / 255.0f);
+        }
+    }
+};
+
+static const ColorTables &getColorTables()
+{
+    static const ColorTables tables;
+    return tables;
+}
+
+static uint8_t linearToByte(float v)
+{
+    return (uint8_t)(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+static uint8_t linearToSrgbByte(const ColorTables &tables, float v)
+{
+    uint32_t b = 0;
+    for (uint32_t step = 128; step != 0; step >>= 1)
+        if (v >= tables.srgbThreshold_[b + step])
+            b += step;
+
+    return (uint8_t)b;
+}
+
+// one row of RGBA8 texels into floats, alpha is always linear
+static void decodeRow(const ColorTables &tables, const uint8_t *rgba, uint32_t numTexels, bool srgb, float *out)
+{
+    const float *toColor = srgb ? tables.srgbToLinear_ : tables.byteToFloat_;
+
+    for (uint32_t i = 0; i != numTexels; i++)
+    {
+        out[i * 4 + 0] = toColor[rgba[i * 4 + 0]];
+        out[i * 4 + 1] = toColor[rgba[i * 4 + 1]];
+        out[i * 4 + 2] = toColor[rgba[i * 4 + 2]];
+        out[i * 4 + 3] = tables.byteToFloat_[rgba[i * 4 + 3]];
+    }
+}
+
+static void encodeTexels(const FloatImage &img, const ResampleConfig &cfg, float alphaScale, uint8_t *out)
+{
+    const ColorTables &tables = getColorTables();
+
+    for (uint32_t i = 0; i != img.w_ * img.h_; i++)
+    {
+        const float *texel = &img.data_[i * 4];
+
+        for (uint32_t c = 0; c != 3; c++)
+            out[i * 4 + c] = cfg.srgb ? linearToSrgbByte(tables, texel[c]) : linearToByte(texel[c]);
+        out[i * 4 + 3] = linearToByte(texel[3] * alphaScale);
+    }
+}
+
+void decodeImage(const uint8_t *rgba, uint32_t width, uint32_t height, const ResampleConfig &cfg, FloatImage &out)
+{
+    out.w_ = width;
+    out.h_ = height;
+    out.data_.resize(width * height * 4);
+
+    decodeRow(getColorTables(), rgba, width * height, cfg.srgb, out.data_.data());
+}
+
+void encodeImage(const FloatImage &img, const ResampleConfig &cfg, float alphaScale, std::vector<uint8_t> &out)
+{
+    out.resize(img.w_ * img.h_ * 4);
+    encodeTexels(img, cfg, alphaScale, out.data());
+}
+
+/* Resampling */
+
+// averaged unit vectors become shorter, which flattens the lighting of the distant surfaces
+static void renormalize(float *rgb)
+{
+    float n[3];
+    for (int c = 0; c != 3; c++)
+        n[c] = rgb[c] * 2.0f - 1.0f;
+
+    const float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (len <= 0.0f)
+        return;
+
+    for (int c = 0; c != 3; c++)
+        rgb[c] = n[c] / len * 0.5f + 0.5f;
+}
+
+static void filterRow(const float *src, const FilterTaps &taps, uint32_t dstWidth, float *dst)
+{
+    for (uint32_t x = 0; x != dstWidth; x++)
+    {
+        Texel4 acc = zeroTexel();
+        for (uint32_t t = taps.start_[x]; t != taps.start_[x + 1]; t++)
+            acc = mulAddTexel(acc, loadTexel(src + taps.src_[t] * 4), taps.weight_[t]);
+
+        storeTexel(dst + x * 4, acc);
+    }
+}
+
+// rows holds the horizontally filtered rows, dstWidth texels each. Every destination row is accumulated
+// one tap at a time, so the source rows are read sequentially
+static void filterColumns(const std::vector<float> &rows, const FilterTaps &taps, const ResampleConfig &cfg, FloatImage &dst)
+{
+    const uint32_t rowSize = dst.w_ * 4;
+
+    for (uint32_t y = 0; y != dst.h_; y++)
+    {
+        float *out = &dst.data_[y * rowSize];
+        std::fill(out, out + rowSize, 0.0f);
+
+        for (uint32_t t = taps.start_[y]; t != taps.start_[y + 1]; t++)
+        {
+            const float *src = &rows[taps.src_[t] * rowSize];
+            const float weight = taps.weight_[t];
+
+            for (uint32_t x = 0; x != rowSize; x += 4)
+                storeTexel(out + x, mulAddTexel(loadTexel(out + x), loadTexel(src + x), weight));
+        }
+
+        for (uint32_t x = 0; x != rowSize; x += 4)
+        {
+            storeTexel(out + x, saturateTexel(loadTexel(out + x)));
+
+            if (cfg.normals)
+                renormalize(out + x);
+        }
+    }
+}
+
+void resampleImage(const FloatImage &src, uint32_t dstWidth, uint32_t dstHeight, const ResampleConfig &cfg, FloatImage &dst)
+{
+    const FilterTaps tapsX = computeFilterTaps(src.w_, dstWidth, cfg.filter);
+    const FilterTaps tapsY = computeFilterTaps(src.h_, dstHeight, cfg.filter);
+
+    std::vector<float> rows(dstWidth * src.h_ * 4);
+    for (uint32_t y = 0; y != src.h_; y++)
+        filterRow(&src.data_[y * src.w_ * 4], tapsX, dstWidth, &rows[y * dstWidth * 4]);
+
+    dst.w_ = dstWidth;
+    dst.h_ = dstHeight;
+    dst.data_.resize(dstWidth * dstHeight * 4);
+    filterColumns(rows, tapsY, cfg, dst);
+}
+
+/* Alpha coverage */
+
+float getAlphaCoverage(const FloatImage &img, float alphaTest, float alphaScale)
+{
+    uint32_t passed = 0;
+    for (uint32_t i = 0; i != img.w_ * img.h_; i++)
+        if (std::min(img.data_[i * 4 + 3] * alphaScale, 1.0f) >= alphaTest)
+            passed++;
+
+    return (float)passed / (float)(img.w_ * img.h_);
+}
+
+// The coverage only grows with the scale, so the smallest scale reaching the given coverage is found by bisection
+float findAlphaScale(const FloatImage &img, float alphaTest, float coverage)
+{
+    float lo = 0.0f;
+    float hi = 16.0f;
+
+    for (int i = 0; i != 16; i++)
+    {
+        const float mid = (lo + hi) * 0.5f;
+        if (getAlphaCoverage(img, alphaTest, mid) < coverage)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return hi;
+}
+
+void resampleImage(const uint8_t *src, uint32_t srcWidth, uint32_t srcHeight, uint8_t *dst, uint32_t dstWidth, uint32_t dstHeight, const ResampleConfig &cfg)
+{
+    if (srcWidth == dstWidth && srcHeight == dstHeight)
+    {
+        memcpy(dst, src, srcWidth * srcHeight * 4);
+        return;
+    }
+
+    const ColorTables &tables = getColorTables();
+    const FilterTaps tapsX = computeFilterTaps(srcWidth, dstWidth, cfg.filter);
+    const FilterTaps tapsY = computeFilterTaps(srcHeight, dstHeight, cfg.filter);
+
+    // only one source row at a time is decoded
+    std::vector<float> srcRow(srcWidth * 4);
+    std::vector<float> rows(dstWidth * srcHeight * 4);
+
+    uint32_t passed = 0;
+    const uint32_t alphaTestByte = (uint32_t)ceilf(cfg.alphaTest * 255.0f);
+
+    for (uint32_t y = 0; y != srcHeight; y++)
+    {
+        const uint8_t *rgba = src + y * srcWidth * 4;
+
+        decodeRow(tables, rgba, srcWidth, cfg.srgb, srcRow.data());
+        filterRow(srcRow.data(), tapsX, dstWidth, &rows[y * dstWidth * 4]);
+
+        if (cfg.alphaTest > 0.0f)
+            for (uint32_t x = 0; x != srcWidth; x++)
+                if (rgba[x * 4 + 3] >= alphaTestByte)
+                    passed++;
+    }
+
+    FloatImage img{.w_ = dstWidth, .h_ = dstHeight};
+    img.data_.resize(dstWidth * dstHeight * 4);
+    filterColumns(rows, tapsY, cfg, img);
+
+    const float coverage = (float)passed / (float)(srcWidth * srcHeight);
+    const float alphaScale = (cfg.alphaTest > 0.0f) ? findAlphaScale(img, cfg.alphaTest, coverage) : 1.0f;
+
+    encodeTexels(img, cfg, alphaScale, dst);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+// Image resampling for the texture conversion: the downscaling of the source textures and their MIP chains.
+// Unlike stbir_resize_uint8(), which filters the stored sRGB values directly and darkens every edge between
+// bright and dark texels, the color channels are converted to linear space first and re-encoded afterwards.
+// Filtering also smooths alpha, which thins out alpha-tested foliage. The alpha channel can therefore
+// be rescaled to keep the fraction of texels passing the alpha test ("Computing Alpha Mipmaps" by Ignacio Castano, 2010).
+//
+// The filters are separable: the rows are filtered first, then the columns of the intermediate image. All four channels
+// of a texel are filtered at once in an SSE register. The horizontal pass reads the 8-bit source rows directly,
+// so a large source texture is never expanded into floating point as a whole
+
+enum ResampleFilter
+{
+    // average over the footprint of the destination texel, cheap and blurry
+    ResampleFilter_Box = 0,
+    // windowed sinc (Kaiser window, 3 destination texels on each side). Keeps the small images sharp,
+    // the ringing is clamped away
+    ResampleFilter_Kaiser = 1,
+};
+
+struct ResampleConfig
+{
+    ResampleFilter filter = ResampleFilter_Kaiser;
+    // the RGB channels are sRGB-encoded, they are filtered in linear space
+    bool srgb = true;
+    // the RGB channels are tangent-space normals, they are renormalized after filtering
+    bool normals = false;
+    // Non-zero values keep the fraction of texels with alpha >= alphaTest the same as in the source image.
+    // This is the alphaTest_ of the materials using the texture
+    float alphaTest = 0.0f;
+};
+
+// An image in floating point, 4 channels per texel. The color channels of sRGB images are linear
+struct FloatImage
+{
+    uint32_t w_ = 0;
+    uint32_t h_ = 0;
+    std::vector<float> data_;
+};
+
+void decodeImage(const uint8_t *rgba, uint32_t width, uint32_t height, const ResampleConfig &cfg, FloatImage &out);
+
+// alphaScale multiplies the stored alpha, see findAlphaScale()
+void encodeImage(const FloatImage &img, const ResampleConfig &cfg, float alphaScale, std::vector<uint8_t> &out);
+
+// The destination may be smaller or larger in every dimension. The texels outside the source image repeat the edge ones:
+// this is not exact for the tiling textures, but it never bleeds unrelated texels of atlases
+void resampleImage(const FloatImage &src, uint32_t dstWidth, uint32_t dstHeight, const ResampleConfig &cfg, FloatImage &dst);
+
+// The fraction of texels passing the alpha test once their alpha is multiplied by alphaScale
+float getAlphaCoverage(const FloatImage &img, float alphaTest, float alphaScale = 1.0f);
+
+// The smallest alpha scale for which the coverage of img reaches the given one
+float findAlphaScale(const FloatImage &img, float alphaTest, float coverage);
+
+// Resamples a tightly packed RGBA8 image into another one. Only one source row at a time is converted to floating point,
+// the alpha coverage is measured on the source bytes
+void resampleImage(const uint8_t *src, uint32_t srcWidth, uint32_t srcHeight, uint8_t *dst, uint32_t dstWidth, uint32_t dstHeight, const ResampleConfig &cfg);
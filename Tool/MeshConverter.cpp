@@ -3,7 +3,7 @@
 #include <assimp/cimport.h>
 #include "Scene/VtxData.h"
 
-#include <meshoptimizer.h>
+#include "MeshProcessing.h"
 
 MeshData g_meshData;
 
@@ -20,79 +20,24 @@ bool g_calculateLODs = false;
 // The LOD meshes are represented as a collection of indices that construct a new
 // simplified mesh from the same vertices that are used for the original mesh. This
 // way, we only have to store one set of vertices and can render the corresponding
-// LODs by simply switching the index buffer data.
-void processLods(std::vector<uint32_t> &indices, std::vector<float> &vertices,
-                 std::vector<std::vector<uint32_t>> &outLods)
-{
-    size_t verticesCountIn = vertices.size() / 3;
-    size_t targetIndicesCount = indices.size();
-
-    // The first "zero" LOD corresponds to the original mesh indices. Push it as-is into the resulting container
-    uint8_t LOD = 1;
-    printf("\n   LOD0: %i indices", int(indices.size()));
-    outLods.push_back(indices);
-
-    while (targetIndicesCount > 1024 && LOD < 8)
-    {
-        targetIndicesCount = indices.size() / 2;
-
-        bool sloppy = false;
-
-        // tries to follow the topology of the original mesh.
-        // This is so that the attribute seams, borders, and overall appearance can be preserved.
-        // The target error value of 0.02 corresponds to the 2% deviation from the original mesh
-        size_t numOptIndices = meshopt_simplify(
-            indices.data(),
-            indices.data(), (uint32_t)indices.size(),
-            vertices.data(), verticesCountIn,
-            sizeof(float) * 3,
-            targetIndicesCount, 0.02f);
-
-        // cannot simplify further
-        // meshopt_simplifySloppy does not follow the topology of the original mesh.
-        // This means it can be more aggressive by collapsing internal mesh details that are too
-        // small to matter because they are topologically disjointed but spatially close
-        if (static_cast<size_t>(numOptIndices * 1.1f) > indices.size())
-        {
-            if (LOD > 1)
-            {
-                // try harder
-                numOptIndices = meshopt_simplifySloppy(
-                    indices.data(),
-                    indices.data(), indices.size(),
-                    vertices.data(), verticesCountIn,
-                    sizeof(float) * 3,
-                    targetIndicesCount, 0.02f);
-                sloppy = true;
-                if (numOptIndices == indices.size())
-                    break;
-            }
-            else
-                break;
-        }
-
-        indices.resize(numOptIndices);
-        // optimize each LOD for the vertex cache
-        meshopt_optimizeVertexCache(indices.data(), indices.data(), indices.size(), verticesCountIn);
-        printf("\n   LOD%i: %i indices %s", int(LOD), int(numOptIndices), sloppy ? "[sloppy]" : "");
-
-        LOD++;
-        outLods.push_back(indices);
-    }
-}
+// LODs by simply switching the index buffer data. See processLods() in MeshProcessing.h
+MeshOptimizationConfig g_meshOptimization;
 
 Mesh convertAIMesh(const aiMesh *m)
 {
     const bool hasTexCoords = m->HasTextureCoords(0);
     const uint32_t streamElementSize = static_cast<uint32_t>(g_numElementsToStore * sizeof(float));
 
-    // Original data for LOD calculation
+    // Original positions for the optimization stage
     std::vector<float> srcVertices;
     std::vector<uint32_t> srcIndices;
 
     std::vector<std::vector<uint32_t>> outLods;
+    std::vector<float> outErrors;
 
-    auto &vertices = g_meshData.vertexData_;
+    // the vertices are reordered by optimizeVertexFetch() before they are appended to g_meshData
+    std::vector<float> vertices;
+    vertices.reserve(m->mNumVertices * g_numElementsToStore);
 
     for (size_t i = 0; i != m->mNumVertices; i++)
     {
@@ -100,12 +45,9 @@ Mesh convertAIMesh(const aiMesh *m)
         const aiVector3D n = m->mNormals[i];
         const aiVector3D t = hasTexCoords ? m->mTextureCoords[0][i] : aiVector3D();
 
-        if (g_calculateLODs)
-        {
-            srcVertices.push_back(v.x);
-            srcVertices.push_back(v.y);
-            srcVertices.push_back(v.z);
-        }
+        srcVertices.push_back(v.x);
+        srcVertices.push_back(v.y);
+        srcVertices.push_back(v.z);
 
         vertices.push_back(v.x * g_meshScale);
         vertices.push_back(v.y * g_meshScale);
@@ -135,12 +77,17 @@ Mesh convertAIMesh(const aiMesh *m)
             srcIndices.push_back(m->mFaces[i].mIndices[j]);
     }
 
+    MeshOptimizationConfig optCfg = g_meshOptimization;
     if (!g_calculateLODs)
-        outLods.push_back(srcIndices);
-    else
-    {
-        processLods(srcIndices, srcVertices, outLods);
-    }
+        optCfg.maxLODs = 1;
+
+    processLods(srcVertices, srcIndices, optCfg, outLods, outErrors);
+
+    result.vertexCount = optimizeVertexFetch(vertices, g_numElementsToStore, outLods);
+    g_meshData.vertexData_.insert(g_meshData.vertexData_.end(), vertices.begin(), vertices.end());
+
+    for (size_t l = 0; l < outLods.size(); l++)
+        printf("\n   LOD%i: %i indices, error %f", int(l), int(outLods[l].size()), outErrors[l]);
 
     printf("\nCalculated LOD count: %u\n", (unsigned)outLods.size());
 
@@ -151,6 +98,8 @@ Mesh convertAIMesh(const aiMesh *m)
             g_meshData.indexData_.push_back(outLods[l][i]);
 
         result.lodOffset[l] = numIndices;
+        // the LODs were built from the unscaled source vertices
+        result.lodError[l] = outErrors[l] * g_meshScale;
         numIndices += (int)outLods[l].size();
     }
 
@@ -158,7 +107,7 @@ Mesh convertAIMesh(const aiMesh *m)
     result.lodCount = (uint32_t)outLods.size();
 
     g_indexOffset += numIndices;
-    g_vertexOffset += m->mNumVertices;
+    g_vertexOffset += result.vertexCount;
 
     return result;
 }
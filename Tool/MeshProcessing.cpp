@@ -0,0 +1,93 @@
+#include "MeshProcessing.h"
+
+#include <meshoptimizer.h>
+
+// Vertex cache optimization first: the overdraw optimizer splits the triangle list into clusters
+// which keep the cache order and only sorts these clusters front to back
+static void optimizeLod(std::vector<uint32_t> &indices, const std::vector<float> &positions, const MeshOptimizationConfig &cfg)
+{
+    const size_t vertexCount = positions.size() / 3;
+
+    meshopt_optimizeVertexCache(indices.data(), indices.data(), indices.size(), vertexCount);
+    meshopt_optimizeOverdraw(indices.data(), indices.data(), indices.size(), positions.data(), vertexCount, sizeof(float) * 3, cfg.overdrawThreshold);
+}
+
+void processLods(const std::vector<float> &positions, const std::vector<uint32_t> &indices, const MeshOptimizationConfig &cfg,
+                 std::vector<std::vector<uint32_t>> &outLods, std::vector<float> &outErrors)
+{
+    const size_t vertexCount = positions.size() / 3;
+
+    const float errorScale = meshopt_simplifyScale(positions.data(), vertexCount, sizeof(float) * 3);
+    float lodError = 0.0f;
+
+    // The first "zero" LOD corresponds to the original mesh indices
+    std::vector<uint32_t> lod = indices;
+    optimizeLod(lod, positions, cfg);
+    outLods.push_back(lod);
+    outErrors.push_back(0.0f);
+
+    while (lod.size() > cfg.minLODIndices && outLods.size() < cfg.maxLODs)
+    {
+        const size_t targetIndicesCount = (size_t)(lod.size() * cfg.lodRatio) / 3 * 3;
+
+        float stepError = 0.0f;
+
+        // tries to follow the topology of the original mesh.
+        // This is so that the attribute seams, borders, and overall appearance can be preserved.
+        size_t numOptIndices = meshopt_simplify(
+            lod.data(),
+            lod.data(), lod.size(),
+            positions.data(), vertexCount,
+            sizeof(float) * 3,
+            targetIndicesCount, cfg.lodTargetError, 0, &stepError);
+
+        // cannot simplify further
+        // meshopt_simplifySloppy does not follow the topology of the original mesh.
+        // This means that it can be much more aggressive.
+        if (static_cast<size_t>(numOptIndices * 1.1f) > lod.size())
+        {
+            if (outLods.size() < 2)
+                break;
+
+            // try harder
+            numOptIndices = meshopt_simplifySloppy(
+                lod.data(),
+                lod.data(), lod.size(),
+                positions.data(), vertexCount,
+                sizeof(float) * 3,
+                targetIndicesCount, cfg.lodTargetError, &stepError);
+            if (numOptIndices == lod.size())
+                break;
+        }
+
+        lod.resize(numOptIndices);
+        optimizeLod(lod, positions, cfg);
+
+        lodError += stepError * errorScale;
+
+        outLods.push_back(lod);
+        outErrors.push_back(lodError);
+    }
+}
+
+uint32_t optimizeVertexFetch(std::vector<float> &vertices, uint32_t vertexStride, std::vector<std::vector<uint32_t>> &lods)
+{
+    const size_t vertexCount = vertices.size() / vertexStride;
+
+    // LOD 0 comes first, so it determines the order of almost all the vertices.
+    // The coarser LODs mostly reuse the same vertices and only append the few they do not share
+    std::vector<uint32_t> allIndices;
+    for (const auto &l : lods)
+        allIndices.insert(allIndices.end(), l.begin(), l.end());
+
+    std::vector<uint32_t> remap(vertexCount);
+    const size_t newVertexCount = meshopt_optimizeVertexFetchRemap(remap.data(), allIndices.data(), allIndices.size(), vertexCount);
+
+    meshopt_remapVertexBuffer(vertices.data(), vertices.data(), vertexCount, vertexStride * sizeof(float), remap.data());
+    vertices.resize(newVertexCount * vertexStride);
+
+    for (auto &l : lods)
+        meshopt_remapIndexBuffer(l.data(), l.data(), l.size(), remap.data());
+
+    return (uint32_t)newVertexCount;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "Scene/VtxData.h"
+
+// The mesh optimization stage shared by MeshConverter and SceneConverter.
+// Every mesh goes through the same steps of meshoptimizer (https://github.com/zeux/meshoptimizer):
+//   1. the LOD chain is generated with meshopt_simplify(), each LOD from the previous one
+//   2. every LOD, including the original LOD 0, is reordered for the post-transform vertex cache and then for overdraw
+//   3. the vertices are reordered in the order of their first use by the LODs, so the GPU fetches them sequentially
+// Steps 1 and 2 only produce index buffers. Step 3 rewrites the vertex buffer too, so it runs separately
+// and the converters may cache the results of the first two steps
+
+struct MeshOptimizationConfig
+{
+    // the largest number of LODs, including LOD 0. One means no simplification at all
+    uint32_t maxLODs = kMaxLODs - 1;
+    // every LOD is simplified to this fraction of the indices of the previous one
+    float lodRatio = 0.5f;
+    // the largest allowed simplification error of a single step, relative to the mesh extents
+    float lodTargetError = 0.02f;
+    // meshes with fewer indices are not simplified any further
+    uint32_t minLODIndices = 1024;
+    // how much the vertex cache efficiency may degrade in favor of less overdraw (1.05 means by 5%)
+    float overdrawThreshold = 1.05f;
+};
+
+// positions are tightly packed (x, y, z) triples. outErrors receives the simplification error of every LOD
+// in the units of the positions: meshoptimizer reports it relative to the mesh extents, and since every LOD
+// is built from the previous one the errors of the individual steps add up
+void processLods(const std::vector<float> &positions, const std::vector<uint32_t> &indices, const MeshOptimizationConfig &cfg,
+                 std::vector<std::vector<uint32_t>> &outLods, std::vector<float> &outErrors);
+
+// Reorders the vertices (vertexStride floats each) and rewrites the indices of all the LODs accordingly.
+// The vertices not referenced by any LOD are removed. Returns the new number of vertices
+uint32_t optimizeVertexFetch(std::vector<float> &vertices, uint32_t vertexStride, std::vector<std::vector<uint32_t>> &lods);
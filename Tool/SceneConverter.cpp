@@ -1,14 +1,22 @@
 // a form of top-down recursive traversal where we create our implicit SceneNode objects in the Scene structure
 // Our texture conversion code goes through all the textures, downscales them to 512x512
-// where necessary, and saves them in RGBA .png files. In a real-world content pipeline,
-// this conversion process may include a texture compression phase.
+// where necessary, and saves them in .ktx files with a full MIP chain, optionally block-compressed
+// (see TextureProcessing.h), which is what a real-world content pipeline would do. Without the
+// MIP levels and the compression the textures are saved in RGBA .png files.
 
 #include <algorithm>
 #include <execution>
 #include <fstream>
 #include <filesystem>
-
-#include <assimp/cimport.h>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/Importer.hpp>
 #include <assimp/material.h>
 #include <assimp/pbrmaterial.h>
 #include <assimp/postprocess.h>
@@ -23,24 +31,25 @@
 #include "Scene/Scene.h"
 #include "Scene/MergeUtil.h"
 
+#include "Utils/UtilsChunkFile.h"
+#include "Utils/UtilsHash.h"
+#include "Utils/UtilsMappedFile.h"
+
+#include "MeshProcessing.h"
+#include "TextureProcessing.h"
+#include "TexturePipeline.h"
+
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_RESIZE_IMPLEMENTATION
 #include "stb_image_write.h"
 #include "stb_image.h"
-#include "stb_image_resize.h"
-
-#include <meshoptimizer.h>
 
 namespace fs = std::filesystem;
 
-// a global state to simplify our implementation
-MeshData g_MeshData;
-uint32_t g_indexOffset = 0;
-uint32_t g_vertexOffset = 0;
-
 const uint32_t g_numElementsToStore = 3 + 3 + 2; // pos(vec3) + normal(vec3) + uv(vec2)
 
+std::string replaceAll(const std::string &str, const std::string &oldSubStr, const std::string &newSubStr);
+
 // describing where to load a mesh file from, as well as where to save the converted data
 struct SceneConfig
 {
@@ -51,8 +60,295 @@ struct SceneConfig
     float scale;
     bool calculateLODs;
     bool mergeInstances;
+    // optional: sort the scene nodes breadth-first (see reorderNodesByLevel())
+    bool reorderNodes;
+    // optional: "lod_ratio", "lod_target_error" and "overdraw_threshold" override the defaults.
+    // maxLODs is set to one if calculateLODs is false
+    MeshOptimizationConfig meshOptimization;
+    // optional "vertex_format": "float" (default), "packed" or "quantized", see VertexFormat
+    VertexFormat vertexFormat;
+    // optional "compress_textures": save block-compressed .ktx files instead of .png
+    bool compressTextures;
+    // optional "generate_mips" (true by default): .ktx files with the MIP chains, see buildMipChain().
+    // Optional "mip_filter": "kaiser" (default) or "box", it is used for the downscaling of the source textures as well
+    bool generateMips;
+    ResampleFilter mipFilter;
+    // optional "max_texture_size" (512 by default). Scenes sharing texture files should use the same value,
+    // every texture is converted only once
+    uint32_t maxTextureSize;
+    // optional "texture_workers" (one per hardware thread by default) and "texture_memory_budget_mb" (1024 by default).
+    // The textures of all the scenes go through a single pipeline: if the scenes disagree, the smallest
+    // budget and the smallest non-zero worker count are used, see getTexturePipelineConfig()
+    TexturePipelineConfig texturePipeline;
+};
+
+// Meshes are converted in parallel, so every mesh gets its own vertex and index buffers.
+// The offsets into the combined buffers are only known once all the meshes are converted
+struct ConvertedMesh
+{
+    Mesh mesh_;
+    std::vector<float> vertices_;
+    std::vector<uint32_t> indices_;
+    // the LOD cache entry the LODs were taken from (or saved to), zero if the LODs are not cached
+    uint64_t lodCacheKey_ = 0;
+};
+
+// The files a converted scene was built from and the files it produced. They are saved once its textures are written
+struct SceneDeps
+{
+    std::vector<std::string> inputs_;
+    std::vector<std::string> outputs_;
+    // the LOD cache entries of its meshes, see pruneLODCache()
+    std::vector<uint64_t> lodCacheKeys_;
 };
 
+/* Conversion cache */
+
+// Our asset pipeline reruns the converter on every content commit, while most commits touch a single file.
+// Every expensive step is therefore keyed by a content hash of its inputs, so unchanged results are reused:
+//   - a whole scene is skipped if none of the files it was built from changed (data/cache/*.deps)
+//   - LOD chains of individual meshes are kept in data/cache/meshes/, the entries no scene uses are removed after every run
+//   - every rescaled texture has a .hash file next to it with the key of its source images
+// Bump this version whenever the output of the converter changes, this invalidates all the cached data
+constexpr uint32_t kConverterVersion = 4;
+
+const char *const kCacheDir = "data/cache/";
+const char *const kMeshCacheDir = "data/cache/meshes/";
+
+constexpr uint32_t kSceneDepsFileType = makeFourCC('D', 'E', 'P', 'S');
+constexpr uint32_t kSceneDepsChunk_ConfigKey = makeFourCC('C', 'K', 'E', 'Y');
+constexpr uint32_t kSceneDepsChunk_Inputs = makeFourCC('I', 'N', 'P', 'T');
+constexpr uint32_t kSceneDepsChunk_InputHashes = makeFourCC('I', 'H', 'S', 'H');
+constexpr uint32_t kSceneDepsChunk_Outputs = makeFourCC('O', 'U', 'T', 'S');
+constexpr uint32_t kSceneDepsChunk_LODCacheKeys = makeFourCC('L', 'K', 'E', 'Y');
+
+constexpr uint32_t kLODCacheFileType = makeFourCC('L', 'O', 'D', 'C');
+constexpr uint32_t kLODCacheChunk_Offsets = makeFourCC('L', 'O', 'F', 'S');
+constexpr uint32_t kLODCacheChunk_Indices = makeFourCC('L', 'I', 'D', 'X');
+constexpr uint32_t kLODCacheChunk_Errors = makeFourCC('L', 'E', 'R', 'R');
+
+std::string hashToString(uint64_t hash)
+{
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)hash);
+    return std::string(buf);
+}
+
+// Returns zero for missing (or empty) files
+uint64_t hashFile(const std::string &fileName)
+{
+    MappedFile file;
+    if (!mapFile(fileName.c_str(), file))
+        return 0;
+
+    const uint64_t hash = xxHash64(file.data_, file.size_);
+    unmapFile(file);
+
+    return hash;
+}
+
+// Several threads may produce the same cache entry at once, so every writer uses its own temporary file
+// which is then renamed. Whoever renames last wins, and since the contents are identical this does not matter
+std::string getTempFileName(const std::string &fileName)
+{
+    return fileName + "." + hashToString(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+}
+
+void commitTempFile(const std::string &tmpFile, const std::string &fileName)
+{
+    std::error_code ec;
+    fs::rename(tmpFile, fileName, ec);
+    if (ec)
+        fs::remove(tmpFile, ec);
+}
+
+// Assimp is asked to load a single file, but it may read other files as well (.mtl libraries for .obj,
+// external buffers for .gltf). This IO system records all of them, so they become dependencies of the scene
+class RecordingIOSystem : public Assimp::DefaultIOSystem
+{
+public:
+    Assimp::IOStream *Open(const char *file, const char *mode = "rb") override
+    {
+        Assimp::IOStream *stream = Assimp::DefaultIOSystem::Open(file, mode);
+        if (stream)
+            files_.push_back(file);
+        return stream;
+    }
+
+    std::vector<std::string> files_;
+};
+
+std::string getSceneDepsFileName(const SceneConfig &cfg)
+{
+    return kCacheDir + replaceAll(replaceAll(cfg.outputMesh, "..", "__"), "/", "__") + ".deps";
+}
+
+// All the config fields which affect the output
+uint64_t getConfigKey(const SceneConfig &cfg)
+{
+    HashCombiner key;
+    key.add(kConverterVersion);
+    key.add(cfg.fileName.data(), cfg.fileName.size());
+    key.add(cfg.scale);
+    key.add(cfg.calculateLODs);
+    key.add(cfg.mergeInstances);
+    key.add(cfg.reorderNodes);
+    key.add(cfg.meshOptimization.lodRatio);
+    key.add(cfg.meshOptimization.lodTargetError);
+    key.add(cfg.meshOptimization.overdrawThreshold);
+    key.add(cfg.vertexFormat);
+    key.add(cfg.compressTextures);
+    key.add(cfg.generateMips);
+    key.add(cfg.mipFilter);
+    key.add(cfg.maxTextureSize);
+    return key.value_;
+}
+
+// The scene is up to date if the config did not change, all the recorded inputs have the same content and all the outputs exist
+bool isSceneUpToDate(const SceneConfig &cfg)
+{
+    ChunkFile deps;
+    if (!openChunkFile(getSceneDepsFileName(cfg).c_str(), kSceneDepsFileType, deps))
+        return false;
+
+    const auto configKey = getChunkData<uint64_t>(deps, kSceneDepsChunk_ConfigKey);
+    const auto hashes = getChunkData<uint64_t>(deps, kSceneDepsChunk_InputHashes);
+
+    std::vector<std::string> inputs, outputs;
+    unpackStringList(getChunkData<uint8_t>(deps, kSceneDepsChunk_Inputs), inputs);
+    unpackStringList(getChunkData<uint8_t>(deps, kSceneDepsChunk_Outputs), outputs);
+
+    // the .deps files written before the LOD cache keys were recorded are outdated, otherwise the cache could not be pruned
+    bool upToDate = configKey.size() == 1 && configKey[0] == getConfigKey(cfg) && hashes.size() == inputs.size() && !inputs.empty() &&
+                    findChunk(deps, kSceneDepsChunk_LODCacheKeys);
+
+    if (upToDate)
+    {
+        upToDate = std::all_of(outputs.begin(), outputs.end(), [](const std::string &f)
+                               { return fs::exists(f); });
+    }
+
+    if (upToDate)
+    {
+        std::vector<size_t> idx(inputs.size());
+        std::iota(idx.begin(), idx.end(), 0);
+
+        upToDate = std::all_of(std::execution::par, idx.begin(), idx.end(), [&](size_t i)
+                               { return hashFile(inputs[i]) == hashes[i]; });
+    }
+
+    closeChunkFile(deps);
+
+    return upToDate;
+}
+
+void saveSceneDeps(const SceneConfig &cfg, const SceneDeps &deps)
+{
+    const std::vector<std::string> &inputs = deps.inputs_;
+
+    std::vector<uint64_t> hashes(inputs.size());
+    std::transform(std::execution::par, inputs.begin(), inputs.end(), hashes.begin(), hashFile);
+
+    const std::string fileName = getSceneDepsFileName(cfg);
+    const std::string tmpFile = getTempFileName(fileName);
+
+    ChunkFileWriter writer;
+    if (!beginChunkFile(writer, tmpFile.c_str(), kSceneDepsFileType))
+        return;
+
+    const uint64_t configKey = getConfigKey(cfg);
+    writeChunk(writer, kSceneDepsChunk_ConfigKey, &configKey, sizeof(configKey), kChunkAlignment_Small);
+    writeChunk(writer, kSceneDepsChunk_Inputs, packStringList(inputs), kChunkAlignment_Small);
+    writeChunk(writer, kSceneDepsChunk_InputHashes, hashes, kChunkAlignment_Small);
+    writeChunk(writer, kSceneDepsChunk_Outputs, packStringList(deps.outputs_), kChunkAlignment_Small);
+    writeChunk(writer, kSceneDepsChunk_LODCacheKeys, deps.lodCacheKeys_, kChunkAlignment_Small);
+
+    if (endChunkFile(writer))
+        commitTempFile(tmpFile, fileName);
+}
+
+// The LOD cache entries used by a scene which was not converted in this run. Returns false if they are unknown
+bool loadSceneLODCacheKeys(const SceneConfig &cfg, std::vector<uint64_t> &keys)
+{
+    ChunkFile deps;
+    if (!openChunkFile(getSceneDepsFileName(cfg).c_str(), kSceneDepsFileType, deps))
+        return false;
+
+    const bool recorded = findChunk(deps, kSceneDepsChunk_LODCacheKeys) != nullptr;
+    if (recorded)
+        readChunk(deps, kSceneDepsChunk_LODCacheKeys, keys);
+
+    closeChunkFile(deps);
+
+    return recorded;
+}
+
+// The LOD chain only depends on the source geometry and the optimization settings
+uint64_t getLODCacheKey(const std::vector<float> &srcVertices, const std::vector<uint32_t> &srcIndices, const MeshOptimizationConfig &optCfg)
+{
+    HashCombiner key;
+    key.add(kConverterVersion);
+    key.add(optCfg.maxLODs);
+    key.add(optCfg.lodRatio);
+    key.add(optCfg.lodTargetError);
+    key.add(optCfg.minLODIndices);
+    key.add(optCfg.overdrawThreshold);
+    key.add(srcVertices.data(), srcVertices.size() * sizeof(float));
+    key.add(srcIndices.data(), srcIndices.size() * sizeof(uint32_t));
+    return key.value_;
+}
+
+bool loadCachedLODs(uint64_t key, std::vector<std::vector<uint32_t>> &outLods, std::vector<float> &outErrors)
+{
+    ChunkFile file;
+    if (!openChunkFile((kMeshCacheDir + hashToString(key) + ".lods").c_str(), kLODCacheFileType, file))
+        return false;
+
+    // lodOffset[] has one extra element which marks the end of the last LOD
+    const auto offsets = getChunkData<uint32_t>(file, kLODCacheChunk_Offsets);
+    const auto indices = getChunkData<uint32_t>(file, kLODCacheChunk_Indices);
+    const auto errors = getChunkData<float>(file, kLODCacheChunk_Errors);
+
+    const bool valid = offsets.size() >= 2 && offsets.size() <= kMaxLODs && offsets.back() == indices.size() && errors.size() + 1 == offsets.size();
+
+    if (valid)
+    {
+        for (size_t l = 0; l + 1 < offsets.size(); l++)
+            outLods.emplace_back(indices.begin() + offsets[l], indices.begin() + offsets[l + 1]);
+        outErrors.assign(errors.begin(), errors.end());
+    }
+
+    closeChunkFile(file);
+
+    return valid;
+}
+
+void saveCachedLODs(uint64_t key, const std::vector<std::vector<uint32_t>> &lods, const std::vector<float> &errors)
+{
+    std::vector<uint32_t> offsets = {0};
+    std::vector<uint32_t> indices;
+
+    for (const auto &l : lods)
+    {
+        indices.insert(indices.end(), l.begin(), l.end());
+        offsets.push_back((uint32_t)indices.size());
+    }
+
+    const std::string fileName = kMeshCacheDir + hashToString(key) + ".lods";
+    const std::string tmpFile = getTempFileName(fileName);
+
+    ChunkFileWriter writer;
+    if (!beginChunkFile(writer, tmpFile.c_str(), kLODCacheFileType))
+        return;
+
+    writeChunk(writer, kLODCacheChunk_Offsets, offsets, kChunkAlignment_Small);
+    writeChunk(writer, kLODCacheChunk_Indices, indices);
+    writeChunk(writer, kLODCacheChunk_Errors, errors, kChunkAlignment_Small);
+
+    if (endChunkFile(writer))
+        commitTempFile(tmpFile, fileName);
+}
+
 // retrieves all the required parameters from the
 // aiMaterial structure and returns a MaterialDescription object that can be used
 // with our GLSL shaders.
@@ -208,82 +504,29 @@ MaterialDescription convertAIMaterialToDescription(const aiMaterial *M, std::vec
     return D;
 }
 
-void processLods(std::vector<uint32_t> &indices, std::vector<float> &vertices, std::vector<std::vector<uint32_t>> &outLods)
-{
-    size_t verticesCountIn = vertices.size() / 2;
-    size_t targetIndicesCount = indices.size();
-
-    uint8_t LOD = 1;
-
-    printf("\n   LOD0: %i indices", int(indices.size()));
-
-    outLods.push_back(indices);
-
-    while (targetIndicesCount > 1024 && LOD < 8)
-    {
-        targetIndicesCount = indices.size() / 2;
-
-        bool sloppy = false;
-
-        size_t numOptIndices = meshopt_simplify(
-            indices.data(),
-            indices.data(), (uint32_t)indices.size(),
-            vertices.data(), verticesCountIn,
-            sizeof(float) * 3,
-            targetIndicesCount, 0.02f);
-
-        // cannot simplify further
-        if (static_cast<size_t>(numOptIndices * 1.1f) > indices.size())
-        {
-            if (LOD > 1)
-            {
-                // try harder
-                numOptIndices = meshopt_simplifySloppy(
-                    indices.data(),
-                    indices.data(), indices.size(),
-                    vertices.data(), verticesCountIn,
-                    sizeof(float) * 3,
-                    targetIndicesCount, 0.02f, nullptr);
-                sloppy = true;
-                if (numOptIndices == indices.size())
-                    break;
-            }
-            else
-                break;
-        }
-
-        indices.resize(numOptIndices);
-
-        meshopt_optimizeVertexCache(indices.data(), indices.data(), indices.size(), verticesCountIn);
-
-        printf("\n   LOD%i: %i indices %s", int(LOD), int(numOptIndices), sloppy ? "[sloppy]" : "");
-
-        LOD++;
-
-        outLods.push_back(indices);
-    }
-}
-
-Mesh convertAIMesh(const aiMesh *m, const SceneConfig &cfg)
+// Converts a single Assimp mesh into its own buffers. The function does not touch any shared state,
+// so it is safe to call it for different meshes from multiple threads.
+// indexOffset, vertexOffset and streamOffset[] are set later in mergeConvertedMeshes()
+void convertAIMesh(const aiMesh *m, const SceneConfig &cfg, ConvertedMesh &out)
 {
     const bool hasTexCoords = m->HasTextureCoords(0);
     const uint32_t streamElementSize = static_cast<uint32_t>(g_numElementsToStore * sizeof(float));
 
-    Mesh result = {
+    Mesh &result = out.mesh_;
+    result = Mesh{
         .streamCount = 1,
-        .indexOffset = g_indexOffset,
-        .vertexOffset = g_vertexOffset,
         .vertexCount = m->mNumVertices,
-        .streamOffset = {g_vertexOffset * streamElementSize},
         .streamElementSize = {streamElementSize}};
 
-    // Original data for LOD calculation
+    // Original positions for the optimization stage
     std::vector<float> srcVertices;
     std::vector<uint32_t> srcIndices;
 
     std::vector<std::vector<uint32_t>> outLods;
+    std::vector<float> outErrors;
 
-    auto &vertices = g_MeshData.vertexData_;
+    auto &vertices = out.vertices_;
+    vertices.reserve(m->mNumVertices * g_numElementsToStore);
 
     for (size_t i = 0; i != m->mNumVertices; i++)
     {
@@ -291,12 +534,9 @@ Mesh convertAIMesh(const aiMesh *m, const SceneConfig &cfg)
         const aiVector3D n = m->mNormals[i];
         const aiVector3D t = hasTexCoords ? m->mTextureCoords[0][i] : aiVector3D();
 
-        if (cfg.calculateLODs)
-        {
-            srcVertices.push_back(v.x);
-            srcVertices.push_back(v.y);
-            srcVertices.push_back(v.z);
-        }
+        srcVertices.push_back(v.x);
+        srcVertices.push_back(v.y);
+        srcVertices.push_back(v.z);
 
         vertices.push_back(v.x * cfg.scale);
         vertices.push_back(v.y * cfg.scale);
@@ -318,31 +558,95 @@ Mesh convertAIMesh(const aiMesh *m, const SceneConfig &cfg)
             srcIndices.push_back(m->mFaces[i].mIndices[j]);
     }
 
+    MeshOptimizationConfig optCfg = cfg.meshOptimization;
+    if (!cfg.calculateLODs)
+        optCfg.maxLODs = 1;
+
+    // LOD generation is the expensive part of mesh conversion, so its results are cached.
+    // Optimizing a single LOD is cheap enough to be redone every time
     if (!cfg.calculateLODs)
-        outLods.push_back(srcIndices);
+    {
+        processLods(srcVertices, srcIndices, optCfg, outLods, outErrors);
+    }
     else
-        processLods(srcIndices, srcVertices, outLods);
+    {
+        const uint64_t lodKey = getLODCacheKey(srcVertices, srcIndices, optCfg);
 
-    printf("\nCalculated LOD count: %u\n", (unsigned)outLods.size());
+        if (!loadCachedLODs(lodKey, outLods, outErrors))
+        {
+            outLods.clear();
+            outErrors.clear();
+            processLods(srcVertices, srcIndices, optCfg, outLods, outErrors);
+            saveCachedLODs(lodKey, outLods, outErrors);
+        }
+
+        out.lodCacheKey_ = lodKey;
+    }
+
+    // the vertex order depends on all the LODs, so it is only known after they are loaded or generated
+    result.vertexCount = optimizeVertexFetch(vertices, g_numElementsToStore, outLods);
 
     uint32_t numIndices = 0;
 
     for (size_t l = 0; l < outLods.size(); l++)
     {
-        for (size_t i = 0; i < outLods[l].size(); i++)
-            g_MeshData.indexData_.push_back(outLods[l][i]);
+        out.indices_.insert(out.indices_.end(), outLods[l].begin(), outLods[l].end());
 
         result.lodOffset[l] = numIndices;
+        // the LODs were built from the unscaled source vertices
+        result.lodError[l] = outErrors[l] * cfg.scale;
         numIndices += (int)outLods[l].size();
     }
 
     result.lodOffset[outLods.size()] = numIndices;
     result.lodCount = (uint32_t)outLods.size();
+}
 
-    g_indexOffset += numIndices;
-    g_vertexOffset += m->mNumVertices;
+// Concatenates the individually converted meshes into a single MeshData container.
+// An exclusive prefix sum over the vertex and index counts gives every mesh its offsets,
+// after which all the meshes can be copied into their own ranges of the output buffers in parallel
+void mergeConvertedMeshes(std::vector<ConvertedMesh> &converted, MeshData &meshData)
+{
+    const size_t numMeshes = converted.size();
 
-    return result;
+    std::vector<uint32_t> vertexOffsets(numMeshes);
+    std::vector<uint32_t> indexOffsets(numMeshes);
+
+    std::transform_exclusive_scan(converted.begin(), converted.end(), vertexOffsets.begin(), 0u, std::plus<>(),
+                                  [](const ConvertedMesh &c)
+                                  { return c.mesh_.vertexCount; });
+    std::transform_exclusive_scan(converted.begin(), converted.end(), indexOffsets.begin(), 0u, std::plus<>(),
+                                  [](const ConvertedMesh &c)
+                                  { return (uint32_t)c.indices_.size(); });
+
+    const size_t totalVertices = numMeshes ? vertexOffsets.back() + converted.back().mesh_.vertexCount : 0;
+    const size_t totalIndices = numMeshes ? indexOffsets.back() + converted.back().indices_.size() : 0;
+
+    meshData.meshes_.resize(numMeshes);
+    meshData.vertexData_.resize(totalVertices * g_numElementsToStore);
+    meshData.indexData_.resize(totalIndices);
+
+    std::vector<size_t> meshIndices(numMeshes);
+    std::iota(meshIndices.begin(), meshIndices.end(), 0);
+
+    auto copyMesh = [&](size_t i)
+    {
+        ConvertedMesh &c = converted[i];
+
+        Mesh &mesh = meshData.meshes_[i];
+        mesh = c.mesh_;
+        mesh.indexOffset = indexOffsets[i];
+        mesh.vertexOffset = vertexOffsets[i];
+        mesh.streamOffset[0] = vertexOffsets[i] * mesh.streamElementSize[0];
+
+        std::copy(c.vertices_.begin(), c.vertices_.end(), meshData.vertexData_.begin() + (size_t)vertexOffsets[i] * g_numElementsToStore);
+        std::copy(c.indices_.begin(), c.indices_.end(), meshData.indexData_.begin() + indexOffsets[i]);
+
+        // the per-mesh buffers are not needed anymore
+        c = ConvertedMesh();
+    };
+
+    std::for_each(std::execution::par, meshIndices.begin(), meshIndices.end(), copyMesh);
 }
 
 void makePrefix(int ofs)
@@ -507,93 +811,60 @@ std::string fixTextureFile(const std::string &file)
     return fs::exists(file) ? file : findSubstitute(file);
 }
 
-std::string convertTexture(const std::string &file, const std::string &basePath, std::unordered_map<std::string, uint32_t> &opacityMapIndices, const std::vector<std::string> &opacityMaps)
+// The MIP chains and the block-compressed data need a container which .png is not
+bool isKTXOutput(const SceneConfig &cfg)
 {
-    // All our output textures will have no more than 512x512 pixels
-    const int maxNewWidth = 512;
-    const int maxNewHeight = 512;
+    return cfg.compressTextures || cfg.generateMips;
+}
 
-    // A temporary dynamic array will contain a combined albedo and opacity map.
+// Returns the output file name. Several scenes may add a job for the same output, the duplicates are
+// removed by mergeTextureJobs() once all the scenes are converted
+std::string addTextureJob(const std::string &file, const std::string &basePath, std::unordered_map<std::string, uint32_t> &opacityMapIndices, const std::vector<std::string> &opacityMaps,
+                          const TextureProcessingConfig &textureCfg, const SceneConfig &cfg, std::vector<TextureJob> &jobs)
+{
     // To run this on Windows, Linux, and macOS, we should replace all the path separators
     // with the "/" symbol
     const auto srcFile = replaceAll(basePath + file, "\\", "/");
     // The new filename is a concatenation of a fixed output directory and a source
     // filename, with all path separators replaced by double underscores:
-    const auto newFile = std::string("data/out_textures/") + lowercaseString(replaceAll(replaceAll(srcFile, "..", "__"), "/", "__") + std::string("__rescaled")) + std::string(".png");
-
-    // load this image
-    // We must force the loaded image to be in RGBA format, even if there is
-    // no opacity information. This is a shortcut that we can take here to make our texture
-    // handling code significantly simpler
-    int texWidth, texHeight, texChannels;
-    // The fixTextureFile() function fixes situations where 3D model
-    // material data references texture files with inappropriate case in filenames.
-    stbi_uc *pixels = stbi_load(fixTextureFile(srcFile).c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    uint8_t *src = pixels;
-    texChannels = STBI_rgb_alpha;
-
-    std::vector<uint8_t> tmpImage(maxNewWidth * maxNewHeight * 4);
-
-    // If the texture failed to load, we must set our temporary array as input data to avoid
-    // having to exit here
-    if (!src)
+    const auto newFile = std::string("data/out_textures/") + lowercaseString(replaceAll(replaceAll(srcFile, "..", "__"), "/", "__") + std::string("__rescaled")) + std::string(isKTXOutput(cfg) ? ".ktx" : ".png");
+
+    // If this texture has an associated opacity map stored in the hash table, the opacity map
+    // is packed into the alpha channel of this albedo texture
+    const bool hasOpacityMap = opacityMapIndices.count(file) > 0;
+
+    // All our output textures will have no more than 512x512 pixels (unless the config says otherwise).
+    // The content hashes of the source files are added to this key once the pipeline has read them
+    HashCombiner settingsKey;
+    settingsKey.add(kConverterVersion);
+    settingsKey.add(cfg.maxTextureSize);
+    settingsKey.add(textureCfg.usage);
+    settingsKey.add(textureCfg.alphaTest);
+    settingsKey.add(textureCfg.mipFilter);
+    if (isKTXOutput(cfg))
     {
-        printf("Failed to load [%s] texture\n", srcFile.c_str());
-        texWidth = maxNewWidth;
-        texHeight = maxNewHeight;
-        texChannels = STBI_rgb_alpha;
-        src = tmpImage.data();
-    }
-    else
-    {
-        printf("Loaded [%s] %dx%d texture with %d channels\n", srcFile.c_str(), texWidth, texHeight, texChannels);
+        settingsKey.add(textureCfg.generateMips);
+        settingsKey.add(textureCfg.compress);
     }
 
-    // If this texture has an associated opacity map stored in the hash table, we must load
-    // that opacity map and add its contents to the albedo map. As with the source texture
-    // file, we must replace the path separators for cross-platform operations. The opacity
-    // map is loaded as a simple grayscale image
-    if (opacityMapIndices.count(file) > 0)
+    // The fixTextureFile() function fixes situations where 3D model
+    // material data references texture files with inappropriate case in filenames.
+    // A missing file keeps its name, the pipeline reports it and converts a black texture instead
+    auto resolveFile = [](const std::string &name)
     {
-        const auto opacityMapFile = replaceAll(basePath + opacityMaps[opacityMapIndices[file]], "\\", "/");
-        int opacityWidth, opacityHeight;
-        stbi_uc *opacityPixels = stbi_load(fixTextureFile(opacityMapFile).c_str(), &opacityWidth, &opacityHeight, nullptr, 1);
-
-        // After signaling a possible loading error, we must check the loaded image's validity:
-        if (!opacityPixels)
-        {
-            printf("Failed to load opacity mask [%s]\n", opacityMapFile.c_str());
-        }
-
-        assert(opacityPixels);
-        assert(texWidth == opacityWidth);
-        assert(texHeight == opacityHeight);
-
-        // store the opacity values in the alpha component of this albedo texture
-        if (opacityPixels)
-            for (int y = 0; y != opacityHeight; y++)
-                for (int x = 0; x != opacityWidth; x++)
-                    src[(y * opacityWidth + x) * texChannels + 3] = opacityPixels[y * opacityWidth + x];
-
-        stbi_image_free(opacityPixels);
-    }
-
-    // allocate a maximum number of bytes to hold the output image. The output texture size isn't
-    // bigger than the constants we defined at the start of this function
-    const uint32_t imgSize = texWidth * texHeight * texChannels;
-    std::vector<uint8_t> mipData(imgSize);
-    uint8_t *dst = mipData.data();
-
-    const int newW = std::min(texWidth, maxNewWidth);
-    const int newH = std::min(texHeight, maxNewHeight);
-
-    // a simple function for rescaling an image without losing too much quality
-    stbir_resize_uint8(src, texWidth, texHeight, 0, dst, newW, newH, 0, texChannels);
-
-    stbi_write_png(newFile.c_str(), newW, newH, texChannels, dst, 0);
+        const std::string fixed = fixTextureFile(name);
+        return fixed.empty() ? name : fixed;
+    };
 
-    if (pixels)
-        stbi_image_free(pixels);
+    jobs.push_back(TextureJob{
+        .srcFile = resolveFile(srcFile),
+        .opacityFile = hasOpacityMap ? resolveFile(replaceAll(basePath + opacityMaps[opacityMapIndices[file]], "\\", "/")) : std::string(),
+        .outputFile = newFile,
+        .maxSize = cfg.maxTextureSize,
+        .textureCfg = textureCfg,
+        .ktxOutput = isKTXOutput(cfg),
+        .settingsKey = settingsKey.value_,
+    });
 
     return newFile;
     // the converted dataset is always valid and requires significantly fewer runtime checks
@@ -604,7 +875,8 @@ std::string convertTexture(const std::string &file, const std::string &basePath,
 // As parameters, this routine accepts a list of material descriptions, an output directory
 // for texture data, and the containers for all the texture files and opacity maps
 void convertAndDownscaleAllTextures(
-    const std::vector<MaterialDescription> &materials, const std::string &basePath, std::vector<std::string> &files, std::vector<std::string> &opacityMaps)
+    const std::vector<MaterialDescription> &materials, const std::string &basePath, std::vector<std::string> &files, std::vector<std::string> &opacityMaps,
+    const SceneConfig &cfg, std::vector<TextureJob> &jobs)
 {
     // Each of the opacity maps is combined with the albedo map. To keep the
     // correspondence between the opacity map list and the global texture indices, we will
@@ -616,14 +888,83 @@ void convertAndDownscaleAllTextures(
         if (m.opacityMap_ != 0xFFFFFFFF && m.albedoMap_ != 0xFFFFFFFF)
             opacityMapIndices[files[m.albedoMap_]] = (uint32_t)m.opacityMap_;
 
-    // takes a source texture filename and returns a modified texture filename
-    auto converter = [&](const std::string &s) -> std::string
+    // The block compression format and the MIP filtering depend on how the materials use the texture.
+    // Everything else is treated as albedo or emissive color
+    std::unordered_map<std::string, TextureProcessingConfig> textureConfigs(files.size());
+
+    for (const auto &m : materials)
+    {
+        for (uint64_t map : {m.metallicRoughnessMap_, m.ambientOcclusionMap_})
+            if (map != INVALID_TEXTURE)
+                textureConfigs[files[map]].usage = TextureUsage_Data;
+
+        if (m.normalMap_ != INVALID_TEXTURE)
+            textureConfigs[files[m.normalMap_]].usage = TextureUsage_Normal;
+
+        // several materials may share the albedo texture, the strictest test keeps the most of the coverage
+        if (m.albedoMap_ != INVALID_TEXTURE)
+            textureConfigs[files[m.albedoMap_]].alphaTest = std::max(textureConfigs[files[m.albedoMap_]].alphaTest, m.alphaTest_);
+    }
+
+    for (auto &[name, c] : textureConfigs)
     {
-        return convertTexture(s, basePath, opacityMapIndices, opacityMaps);
-    };
+        c.mipFilter = cfg.mipFilter;
+        c.generateMips = cfg.generateMips;
+        c.compress = cfg.compressTextures;
+    }
+
+    const TextureProcessingConfig colorCfg = {.mipFilter = cfg.mipFilter, .generateMips = cfg.generateMips, .compress = cfg.compressTextures};
+
+    // every source texture filename is replaced with the output one right away, the files are produced by the pipeline
+    // after all the scenes are converted
+    jobs.reserve(files.size());
+
+    for (auto &f : files)
+    {
+        const auto textureCfg = textureConfigs.find(f);
+        f = addTextureJob(f, basePath, opacityMapIndices, opacityMaps, textureCfg != textureConfigs.end() ? textureCfg->second : colorCfg, cfg, jobs);
+    }
+}
+
+// Several scenes can reference the same texture file. The texture jobs of all the scenes are merged in the order
+// of the config entries and only the first job for every output file is kept, so when the scenes convert a shared
+// texture with different settings (e.g. max_texture_size), the earliest entry of the config wins on every run,
+// no matter which of the concurrently converted scenes got to the texture first
+std::vector<TextureJob> mergeTextureJobs(const std::vector<std::vector<TextureJob>> &sceneJobs)
+{
+    std::vector<TextureJob> jobs;
+    std::unordered_set<std::string> outputs;
 
-    // use the std::transform() algorithm to convert all of the texture files
-    std::transform(std::execution::par, std::begin(files), std::end(files), std::begin(files), converter);
+    for (const auto &list : sceneJobs)
+        for (const auto &job : list)
+            if (outputs.insert(job.outputFile).second)
+                jobs.push_back(job);
+
+    return jobs;
+}
+
+ResampleFilter parseMipFilter(const std::string &name)
+{
+    if (name == "box")
+        return ResampleFilter_Box;
+    if (name == "kaiser")
+        return ResampleFilter_Kaiser;
+
+    printf("Unknown MIP filter '%s'\n", name.c_str());
+    exit(EXIT_FAILURE);
+}
+
+VertexFormat parseVertexFormat(const std::string &name)
+{
+    if (name == "float")
+        return VertexFormat_Float;
+    if (name == "packed")
+        return VertexFormat_Packed;
+    if (name == "quantized")
+        return VertexFormat_Quantized;
+
+    printf("Unknown vertex format '%s'\n", name.c_str());
+    exit(EXIT_FAILURE);
 }
 
 std::vector<SceneConfig> readConfigFile(const char *cfgFileName)
@@ -652,23 +993,60 @@ std::vector<SceneConfig> readConfigFile(const char *cfgFileName)
             .outputMaterials = document[i]["output_materials"].GetString(),
             .scale = (float)document[i]["scale"].GetDouble(),
             .calculateLODs = document[i]["calculate_LODs"].GetBool(),
-            .mergeInstances = document[i]["merge_instances"].GetBool()});
+            .mergeInstances = document[i]["merge_instances"].GetBool(),
+            .reorderNodes = document[i].HasMember("reorder_nodes") && document[i]["reorder_nodes"].GetBool(),
+            .vertexFormat = document[i].HasMember("vertex_format") ? parseVertexFormat(document[i]["vertex_format"].GetString()) : VertexFormat_Float,
+            .compressTextures = document[i].HasMember("compress_textures") && document[i]["compress_textures"].GetBool(),
+            .generateMips = !document[i].HasMember("generate_mips") || document[i]["generate_mips"].GetBool(),
+            .mipFilter = document[i].HasMember("mip_filter") ? parseMipFilter(document[i]["mip_filter"].GetString()) : ResampleFilter_Kaiser,
+            .maxTextureSize = document[i].HasMember("max_texture_size") ? document[i]["max_texture_size"].GetUint() : 512u});
+
+        MeshOptimizationConfig &opt = configList.back().meshOptimization;
+        if (document[i].HasMember("lod_ratio"))
+            opt.lodRatio = (float)document[i]["lod_ratio"].GetDouble();
+        if (document[i].HasMember("lod_target_error"))
+            opt.lodTargetError = (float)document[i]["lod_target_error"].GetDouble();
+        if (document[i].HasMember("overdraw_threshold"))
+            opt.overdrawThreshold = (float)document[i]["overdraw_threshold"].GetDouble();
+
+        TexturePipelineConfig &pipeline = configList.back().texturePipeline;
+        if (document[i].HasMember("texture_workers"))
+            pipeline.workers = document[i]["texture_workers"].GetUint();
+        if (document[i].HasMember("texture_memory_budget_mb"))
+            pipeline.memoryBudget = (size_t)document[i]["texture_memory_budget_mb"].GetUint() * 1024 * 1024;
     }
 
     return configList;
 }
 
-// loads a single scene file using Assimp and converts all the data into formats suitable for rendering
-void processScene(const SceneConfig &cfg)
+// Every config entry may set the pipeline limits, the strictest ones apply to the whole run
+TexturePipelineConfig getTexturePipelineConfig(const std::vector<SceneConfig> &configs)
 {
-    // clear mesh data from previous scene
-    g_MeshData.meshes_.clear();
-    g_MeshData.boxes_.clear();
-    g_MeshData.indexData_.clear();
-    g_MeshData.vertexData_.clear();
+    TexturePipelineConfig result;
+    result.memoryBudget = std::numeric_limits<size_t>::max();
+
+    for (const auto &cfg : configs)
+    {
+        const TexturePipelineConfig &c = cfg.texturePipeline;
+        if (c.workers && (!result.workers || c.workers < result.workers))
+            result.workers = c.workers;
+        result.memoryBudget = std::min(result.memoryBudget, c.memoryBudget);
+    }
+
+    return result;
+}
 
-    g_indexOffset = 0;
-    g_vertexOffset = 0;
+// loads a single scene file using Assimp and converts all the data into formats suitable for rendering.
+// processScene() has no global state, so independent scenes can be converted concurrently.
+// Returns false if the cached output was up to date and nothing had to be converted. The texture jobs
+// are only collected, they are run by main() for all the scenes together
+bool processScene(const SceneConfig &cfg, std::vector<TextureJob> &textureJobs, SceneDeps &deps)
+{
+    if (isSceneUpToDate(cfg))
+    {
+        printf("'%s' is up to date\n", cfg.fileName.c_str());
+        return false;
+    }
 
     // To load a mesh using Assimp, we must extract the base path from the filename:
     const std::size_t pathSeparator = cfg.fileName.find_last_of("/\\");
@@ -690,7 +1068,12 @@ void processScene(const SceneConfig &cfg)
 
     printf("Loading scene from '%s'...\n", cfg.fileName.c_str());
 
-    const aiScene *scene = aiImportFile(cfg.fileName.c_str(), flags);
+    // the importer owns both the IO system and the loaded scene
+    Assimp::Importer importer;
+    RecordingIOSystem *ioSystem = new RecordingIOSystem();
+    importer.SetIOHandler(ioSystem);
+
+    const aiScene *scene = importer.ReadFile(cfg.fileName.c_str(), flags);
 
     if (!scene || !scene->HasMeshes())
     {
@@ -698,22 +1081,39 @@ void processScene(const SceneConfig &cfg)
         exit(EXIT_FAILURE);
     }
 
-    // 1. Mesh conversion as in Mesh Converter, convert the Assimp meshes into our representation
-    g_MeshData.meshes_.reserve(scene->mNumMeshes);
-    g_MeshData.boxes_.reserve(scene->mNumMeshes);
+    // 1. Mesh conversion as in Mesh Converter, convert the Assimp meshes into our representation.
+    // The meshes are independent, so each of them is converted on its own thread into a separate buffer
+    printf("Converting %u meshes from '%s'...\n", scene->mNumMeshes, cfg.fileName.c_str());
 
-    for (unsigned int i = 0; i != scene->mNumMeshes; i++)
-    {
-        printf("\nConverting meshes %u/%u...", i + 1, scene->mNumMeshes);
-        Mesh mesh = convertAIMesh(scene->mMeshes[i], cfg);
-        g_MeshData.meshes_.push_back(mesh);
-    }
+    std::vector<ConvertedMesh> convertedMeshes(scene->mNumMeshes);
+
+    std::transform(std::execution::par, scene->mMeshes, scene->mMeshes + scene->mNumMeshes, convertedMeshes.begin(),
+                   [&cfg](const aiMesh *m)
+                   {
+                       ConvertedMesh c;
+                       convertAIMesh(m, cfg, c);
+                       return c;
+                   });
+
+    // several meshes with the same geometry share a cache entry
+    std::vector<uint64_t> lodCacheKeys;
+    for (const auto &c : convertedMeshes)
+        if (c.lodCacheKey_)
+            lodCacheKeys.push_back(c.lodCacheKey_);
+    std::sort(lodCacheKeys.begin(), lodCacheKeys.end());
+    lodCacheKeys.erase(std::unique(lodCacheKeys.begin(), lodCacheKeys.end()), lodCacheKeys.end());
+
+    MeshData meshData;
+    mergeConvertedMeshes(convertedMeshes, meshData);
+
+    printf("Converted %u meshes from '%s': %u vertices, %u indices\n", scene->mNumMeshes, cfg.fileName.c_str(),
+           (uint32_t)(meshData.vertexData_.size() / g_numElementsToStore), (uint32_t)meshData.indexData_.size());
 
     // generate a bounding box for each mesh. Bounding boxes will
     // be used to implement frustum culling
-    recalculateBoundingBoxes(g_MeshData);
+    recalculateBoundingBoxes(meshData);
 
-    saveMeshData(cfg.outputMesh.c_str(), g_MeshData);
+    saveMeshData(cfg.outputMesh.c_str(), meshData, cfg.vertexFormat);
 
     Scene ourScene;
 
@@ -743,7 +1143,14 @@ void processScene(const SceneConfig &cfg)
     // 3. Texture processing, rescaling and packing
     // The textures are converted, rescaled, and packed into the output folder. The
     // basePath folder's name is needed to extract plain filenames:
-    convertAndDownscaleAllTextures(materials, basePath, files, opacityMaps);
+    // the source textures are dependencies of this scene as well
+    std::vector<std::string> inputs = ioSystem->files_;
+    for (const auto &list : {&files, &opacityMaps})
+        for (const auto &f : *list)
+            if (const auto srcFile = fixTextureFile(replaceAll(basePath + f, "\\", "/")); !srcFile.empty())
+                inputs.push_back(srcFile);
+
+    convertAndDownscaleAllTextures(materials, basePath, files, opacityMaps, cfg, textureJobs);
 
     saveMaterials(cfg.outputMaterials.c_str(), materials, files);
 
@@ -751,7 +1158,69 @@ void processScene(const SceneConfig &cfg)
     // the scene is converted into the first-child-next-sibling form and saved:
     traverse(scene, ourScene, scene->mRootNode, -1, 0);
 
+    if (cfg.reorderNodes)
+        reorderNodesByLevel(ourScene);
+
+    // traverse() assigns the names directly, so the name index is built once for the whole scene
+    buildNameIndex(ourScene);
+
     saveScene(cfg.outputScene.c_str(), ourScene);
+
+    // the textures are only written after all the scenes are converted, the dependencies are saved after that
+    deps.inputs_ = std::move(inputs);
+    deps.outputs_ = {cfg.outputMesh, cfg.outputScene, cfg.outputMaterials};
+    deps.outputs_.insert(deps.outputs_.end(), files.begin(), files.end());
+    deps.lodCacheKeys_ = std::move(lodCacheKeys);
+
+    return true;
+}
+
+// Removes the LOD cache entries which none of the config entries references any more: the meshes which were edited,
+// the scenes which were removed from the config and the entries of older converter versions. The scenes skipped
+// as up to date report the entries recorded in their .deps files. If any of them cannot be read, nothing is removed
+void pruneLODCache(const std::vector<SceneConfig> &configs, const std::vector<uint8_t> &converted, const std::vector<SceneDeps> &deps)
+{
+    std::unordered_set<std::string> referenced;
+
+    for (size_t i = 0; i != configs.size(); i++)
+    {
+        std::vector<uint64_t> keys = deps[i].lodCacheKeys_;
+
+        if (!converted[i] && !loadSceneLODCacheKeys(configs[i], keys))
+        {
+            printf("The LOD cache entries of '%s' are unknown, the cache is not pruned\n", configs[i].fileName.c_str());
+            return;
+        }
+
+        for (uint64_t key : keys)
+            referenced.insert(hashToString(key) + ".lods");
+    }
+
+    uint32_t removedFiles = 0;
+    uintmax_t removedBytes = 0;
+
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(kMeshCacheDir, ec))
+    {
+        // the temporary files are leftovers of interrupted runs, nothing writes to the cache at this point
+        const std::string name = entry.path().filename().string();
+        const std::string ext = entry.path().extension().string();
+
+        if (!entry.is_regular_file(ec) || (ext != ".lods" && ext != ".tmp") || referenced.count(name))
+            continue;
+
+        std::error_code sizeError;
+        const uintmax_t size = entry.file_size(sizeError);
+
+        if (fs::remove(entry.path(), ec))
+        {
+            removedFiles++;
+            removedBytes += sizeError ? 0 : size;
+        }
+    }
+
+    if (removedFiles)
+        printf("Removed %u unused LOD cache entries (%.1f MB)\n", removedFiles, (double)removedBytes / (1024.0 * 1024.0));
 }
 
 // Merge meshes (interior/exterior)
@@ -761,7 +1230,9 @@ void mergeBistro()
     std::vector<Scene *> scenes = {&scene1, &scene2};
 
     MeshData m1, m2;
-    MeshFileHeader header1 = loadMeshData("data/meshes/test.meshes", m1);
+    // the merged scene keeps the vertex format of the exterior
+    VertexFormat vertexFormat = VertexFormat_Float;
+    MeshFileHeader header1 = loadMeshData("data/meshes/test.meshes", m1, &vertexFormat);
     MeshFileHeader header2 = loadMeshData("data/meshes/test2.meshes", m2);
 
     std::vector<uint32_t> meshCounts = {header1.meshCount, header2.meshCount};
@@ -788,45 +1259,72 @@ void mergeBistro()
     std::vector<MaterialDescription> allMaterials;
     std::vector<std::string> allTextures;
 
-    // A global material list is created with the mergeMaterialLists() function described previously:
+    // A global material list is created with the mergeMaterialLists() function described previously.
+    // The interior and the exterior share lots of textures and materials, and the duplicates are
+    // merged, which shrinks both the material buffer and the texture array of the renderer:
+    std::vector<uint32_t> materialRemap;
     mergeMaterialLists(
         {&materials1, &materials2},
         {&textureFiles1, &textureFiles2},
-        allMaterials, allTextures);
+        allMaterials, allTextures,
+        MaterialMergeOptions{.deduplicateMaterials = true, .deduplicateTextureContents = true},
+        &materialRemap);
+
+    remapSceneMaterials(scene, materialRemap);
+    printf("[Merged materials] materials: %d -> %d, textures: %d -> %d\n",
+           (int)(materials1.size() + materials2.size()), (int)allMaterials.size(),
+           (int)(textureFiles1.size() + textureFiles2.size()), (int)allTextures.size());
 
     saveMaterials("data/meshes/bistro_all.materials", allMaterials, allTextures);
 
-    // Our scene contains a leafy tree object in the backyard. Just by inspecting the
-    // source mesh files, we can easily find out the names of materials for the meshes to
-    // be merged. Green and orange leaves constitute almost two-thirds of the total mesh
-    // count in the combined scene, so they are merged into two large meshes. The trunk
-    // is almost 1,000 meshes, so we merge it as well:
-    printf("[Unmerged] scene items: %d\n", (int)scene.hierarchy_.size());
-    mergeScene(scene, meshData, "Foliage_Linde_Tree_Large_Orange_Leaves");
-    printf("[Merged orange leaves] scene items: %d\n", (int)scene.hierarchy_.size());
-    mergeScene(scene, meshData, "Foliage_Linde_Tree_Large_Green_Leaves");
-    printf("[Merged green leaves]  scene items: %d\n", (int)scene.hierarchy_.size());
-    mergeScene(scene, meshData, "Foliage_Linde_Tree_Large_Trunk");
-    printf("[Merged trunk]  scene items: %d\n", (int)scene.hierarchy_.size());
+    // Our scene contains thousands of tiny static meshes (the leafy tree in the backyard alone is
+    // almost two-thirds of the total mesh count). All the static meshes are batched by material
+    // and location, which bakes the node transforms into the vertices and keeps every LOD level:
+    const size_t unmergedCount = scene.meshes_.size();
+    const uint32_t batchCount = batchStaticMeshes(scene, meshData);
+    printf("[Static batching] %u batches, drawable items: %d -> %d\n", batchCount, (int)unmergedCount, (int)scene.meshes_.size());
 
     // Following the modification, we have our bounding-box array broken, so we call the calculation routine.
     recalculateBoundingBoxes(meshData);
 
-    saveMeshData("data/meshes/bistro_all.meshes", meshData);
+    saveMeshData("data/meshes/bistro_all.meshes", meshData, vertexFormat);
     saveScene("data/meshes/bistro_all.scene", scene);
 }
 
 int main()
 {
     fs::create_directory("data/out_textures");
+    fs::create_directories(kMeshCacheDir);
 
     const auto configs = readConfigFile("data/sceneconverter.json");
 
-    for (const auto &cfg : configs)
-        processScene(cfg);
+    // the config entries are independent, so all the scenes are converted concurrently
+    std::vector<size_t> idx(configs.size());
+    std::iota(idx.begin(), idx.end(), 0);
+
+    std::vector<uint8_t> converted(configs.size());
+    std::vector<SceneDeps> deps(configs.size());
+    std::vector<std::vector<TextureJob>> textureJobs(configs.size());
+    std::for_each(std::execution::par, idx.begin(), idx.end(), [&](size_t i)
+                  { converted[i] = (uint8_t)processScene(configs[i], textureJobs[i], deps[i]); });
+
+    // the textures of all the converted scenes share one memory budget and one set of workers
+    runTexturePipeline(mergeTextureJobs(textureJobs), getTexturePipelineConfig(configs));
+
+    // A scene is only recorded as up to date once its textures are written. Should the converter stop
+    // before that, the scene is converted again on the next run
+    for (size_t i = 0; i != configs.size(); i++)
+        if (converted[i])
+            saveSceneDeps(configs[i], deps[i]);
+
+    pruneLODCache(configs, converted, deps);
+
+    // Final step: optimize bistro scene (only if any of its inputs were converted again)
+    const bool anyConverted = std::find(converted.begin(), converted.end(), 1) != converted.end();
 
-    // Final step: optimize bistro scene
-    mergeBistro();
+    if (anyConverted || !fs::exists("data/meshes/bistro_all.meshes") || !fs::exists("data/meshes/bistro_all.scene") ||
+        !fs::exists("data/meshes/bistro_all.materials"))
+        mergeBistro();
 
     return 0;
 }
@@ -0,0 +1,561 @@
+#include "TexturePipeline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "Utils/UtilsHash.h"
+
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+namespace fs = std::filesystem;
+
+enum TextureStage
+{
+    TextureStage_Read = 0,
+    TextureStage_Decode,
+    TextureStage_Resize,
+    TextureStage_Encode,
+    TextureStage_Write,
+    TextureStage_Count,
+};
+
+static const char *const kStageNames[TextureStage_Count] = {"read", "decode", "resize", "encode", "write"};
+
+// A texture in flight. Only one stage works on it at a time
+struct TextureTask
+{
+    const TextureJob *job_ = nullptr;
+    uint64_t key_ = 0;
+
+    // the memory reserved for the task which is not returned yet, and the parts of it returned after decoding and after resizing
+    size_t reserved_ = 0;
+    size_t fileBytes_ = 0;
+    size_t sourceBytes_ = 0;
+
+    std::vector<uint8_t> file_;
+    std::vector<uint8_t> opacityFile_;
+
+    // the decoded source image. If decoding fails, image_ holds a black image of the output size instead
+    stbi_uc *pixels_ = nullptr;
+    // RGBA8, the output image after resizing
+    std::vector<uint8_t> image_;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+
+    std::vector<char> encoded_;
+};
+
+struct StageStats
+{
+    uint32_t tasks_ = 0;
+    uint64_t bytes_ = 0;
+    // the busy time summed over all the threads running the stage
+    double seconds_ = 0.0;
+};
+
+// Only the reader reserves memory, so it is the only thread which ever waits for the budget
+struct MemoryBudget
+{
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t budget_ = 0;
+    size_t used_ = 0;
+    size_t peak_ = 0;
+};
+
+struct TexturePipeline
+{
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    // the tasks waiting for every stage. Nothing waits for reading, the reader goes through the job list
+    std::deque<std::unique_ptr<TextureTask>> queues_[TextureStage_Count];
+    // the tasks which have been read but not yet written
+    uint32_t inFlight_ = 0;
+    bool readDone_ = false;
+
+    StageStats stats_[TextureStage_Count];
+    uint32_t upToDate_ = 0;
+    uint32_t failed_ = 0;
+
+    MemoryBudget memory_;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double getSeconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+template <typename T>
+static void freeBuffer(std::vector<T> &v)
+{
+    std::vector<T>().swap(v);
+}
+
+/* Memory budget */
+
+static void reserveMemory(MemoryBudget &m, TextureTask &task, size_t bytes)
+{
+    std::unique_lock lock(m.mutex_);
+
+    // an oversized task waits until it is the only one
+    bytes = std::min(bytes, m.budget_);
+    m.cv_.wait(lock, [&m, bytes]
+               { return m.used_ + bytes <= m.budget_; });
+
+    m.used_ += bytes;
+    m.peak_ = std::max(m.peak_, m.used_);
+    task.reserved_ += bytes;
+}
+
+static void releaseMemory(MemoryBudget &m, TextureTask &task, size_t bytes)
+{
+    {
+        std::lock_guard lock(m.mutex_);
+
+        bytes = std::min(bytes, task.reserved_);
+        m.used_ -= bytes;
+        task.reserved_ -= bytes;
+    }
+
+    m.cv_.notify_all();
+}
+
+/* Scheduling */
+
+static void pushTask(TexturePipeline &p, TextureStage stage, std::unique_ptr<TextureTask> task)
+{
+    {
+        std::lock_guard lock(p.mutex_);
+        p.queues_[stage].push_back(std::move(task));
+    }
+
+    p.cv_.notify_all();
+}
+
+// Waits for a task of one of the stages [first, last], the later stages go first. Returns nullptr once
+// everything has been read and written
+static std::unique_ptr<TextureTask> popTask(TexturePipeline &p, TextureStage first, TextureStage last, TextureStage &stage)
+{
+    std::unique_lock lock(p.mutex_);
+
+    for (;;)
+    {
+        for (int s = last; s >= first; s--)
+        {
+            if (!p.queues_[s].empty())
+            {
+                std::unique_ptr<TextureTask> task = std::move(p.queues_[s].front());
+                p.queues_[s].pop_front();
+                stage = (TextureStage)s;
+                return task;
+            }
+        }
+
+        if (p.readDone_ && p.inFlight_ == 0)
+            return nullptr;
+
+        p.cv_.wait(lock);
+    }
+}
+
+static void finishTask(TexturePipeline &p)
+{
+    {
+        std::lock_guard lock(p.mutex_);
+        p.inFlight_--;
+    }
+
+    p.cv_.notify_all();
+}
+
+static void recordFailure(TexturePipeline &p)
+{
+    std::lock_guard lock(p.mutex_);
+    p.failed_++;
+}
+
+static void recordStage(TexturePipeline &p, TextureStage stage, uint64_t bytes, Clock::time_point start)
+{
+    const double seconds = getSeconds(start);
+
+    std::lock_guard lock(p.mutex_);
+    p.stats_[stage].tasks_++;
+    p.stats_[stage].bytes_ += bytes;
+    p.stats_[stage].seconds_ += seconds;
+}
+
+/* Conversion cache */
+
+// The rescaled texture is reused if its .hash file contains the same key
+static bool isTextureUpToDate(const std::string &newFile, uint64_t key)
+{
+    FILE *f = fopen((newFile + ".hash").c_str(), "rb");
+    if (!f)
+        return false;
+
+    uint64_t storedKey = 0;
+    const bool valid = fread(&storedKey, sizeof(storedKey), 1, f) == 1;
+    fclose(f);
+
+    return valid && storedKey == key && fs::exists(newFile);
+}
+
+static void saveTextureHash(const std::string &newFile, uint64_t key)
+{
+    FILE *f = fopen((newFile + ".hash").c_str(), "wb");
+    if (!f)
+        return;
+
+    fwrite(&key, sizeof(key), 1, f);
+    fclose(f);
+}
+
+/* Stages */
+
+static bool readFile(const std::string &fileName, std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(fileName.c_str(), "rb");
+    if (!f)
+        return false;
+
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    data.resize(size > 0 ? (size_t)size : 0);
+    const bool ok = fread(data.data(), 1, data.size(), f) == data.size();
+    fclose(f);
+
+    return ok;
+}
+
+// Missing (or empty) files hash to zero
+static uint64_t hashBuffer(const std::vector<uint8_t> &data)
+{
+    return data.empty() ? 0 : xxHash64(data.data(), data.size());
+}
+
+static void getOutputSize(const TextureJob &job, uint32_t width, uint32_t height, uint32_t &outWidth, uint32_t &outHeight)
+{
+    outWidth = std::min(width, job.maxSize);
+    outHeight = std::min(height, job.maxSize);
+}
+
+// Only the headers of the images are read here. stb_image may keep the image in its own channel count
+// while converting it to RGBA, hence 8 bytes per source texel, and 2 bytes per texel of the opacity map.
+// The resampler keeps the horizontally filtered rows in floating point, and the output goes through
+// a few floating point copies while its MIP chain is built
+static void estimateTaskMemory(const TextureJob &job, size_t &fileBytes, size_t &sourceBytes, size_t &outputBytes)
+{
+    std::error_code ec;
+    fileBytes = 0;
+    for (const std::string *f : {&job.srcFile, &job.opacityFile})
+        if (!f->empty())
+            if (const uintmax_t size = fs::file_size(*f, ec); !ec)
+                fileBytes += (size_t)size;
+
+    int w = 0, h = 0, comp = 0;
+    if (job.srcFile.empty() || !stbi_info(job.srcFile.c_str(), &w, &h, &comp))
+        w = h = (int)job.maxSize;
+
+    uint32_t outW, outH;
+    getOutputSize(job, w, h, outW, outH);
+
+    int opacityW = 0, opacityH = 0;
+    if (!job.opacityFile.empty() && !stbi_info(job.opacityFile.c_str(), &opacityW, &opacityH, &comp))
+        opacityW = opacityH = 0;
+
+    sourceBytes = (size_t)w * h * 8 + (size_t)opacityW * opacityH * 2 + (size_t)outW * h * 16;
+    outputBytes = (size_t)outW * outH * 64;
+}
+
+static void readStage(TexturePipeline &p, const std::vector<TextureJob> &jobs)
+{
+    for (const TextureJob &job : jobs)
+    {
+        auto task = std::make_unique<TextureTask>();
+        task->job_ = &job;
+
+        size_t outputBytes = 0;
+        estimateTaskMemory(job, task->fileBytes_, task->sourceBytes_, outputBytes);
+        reserveMemory(p.memory_, *task, task->fileBytes_ + task->sourceBytes_ + outputBytes);
+
+        const auto start = Clock::now();
+
+        if (!job.srcFile.empty())
+            readFile(job.srcFile, task->file_);
+        if (!job.opacityFile.empty())
+            readFile(job.opacityFile, task->opacityFile_);
+
+        // The output only depends on the source image, its opacity map and the settings
+        HashCombiner key;
+        key.add(job.settingsKey);
+        key.add(hashBuffer(task->file_));
+        if (!job.opacityFile.empty())
+            key.add(hashBuffer(task->opacityFile_));
+        task->key_ = key.value_;
+
+        recordStage(p, TextureStage_Read, task->file_.size() + task->opacityFile_.size(), start);
+
+        if (isTextureUpToDate(job.outputFile, task->key_))
+        {
+            releaseMemory(p.memory_, *task, task->reserved_);
+
+            std::lock_guard lock(p.mutex_);
+            p.upToDate_++;
+            continue;
+        }
+
+        {
+            std::lock_guard lock(p.mutex_);
+            p.inFlight_++;
+        }
+        pushTask(p, TextureStage_Decode, std::move(task));
+    }
+
+    {
+        std::lock_guard lock(p.mutex_);
+        p.readDone_ = true;
+    }
+    p.cv_.notify_all();
+}
+
+// We must force the loaded image to be in RGBA format, even if there is no opacity information.
+// The opacity map is loaded as a simple grayscale image and stored in the alpha channel
+static void decodeStage(TexturePipeline &p, TextureTask &task)
+{
+    const TextureJob &job = *task.job_;
+    const auto start = Clock::now();
+
+    int texWidth = 0, texHeight = 0, texChannels = 0;
+    if (!task.file_.empty())
+        task.pixels_ = stbi_load_from_memory(task.file_.data(), (int)task.file_.size(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+    // If the texture failed to load, a black image is converted instead to avoid having to exit here
+    if (!task.pixels_)
+    {
+        printf("Failed to load [%s] texture\n", job.srcFile.c_str());
+        texWidth = texHeight = (int)job.maxSize;
+        task.image_.assign((size_t)texWidth * texHeight * 4, 0);
+        recordFailure(p);
+    }
+    else
+    {
+        printf("Loaded [%s] %dx%d texture with %d channels\n", job.srcFile.c_str(), texWidth, texHeight, texChannels);
+    }
+
+    if (!job.opacityFile.empty())
+    {
+        int opacityWidth = 0, opacityHeight = 0;
+        stbi_uc *opacityPixels = task.opacityFile_.empty() ? nullptr : stbi_load_from_memory(task.opacityFile_.data(), (int)task.opacityFile_.size(), &opacityWidth, &opacityHeight, nullptr, 1);
+
+        uint8_t *rgba = task.pixels_ ? task.pixels_ : task.image_.data();
+
+        // an unreadable opacity map leaves the alpha of the texture as it is
+        if (!opacityPixels)
+        {
+            printf("Failed to load opacity mask [%s], keeping the alpha of [%s]\n", job.opacityFile.c_str(), job.srcFile.c_str());
+            recordFailure(p);
+        }
+        else if (texWidth == opacityWidth && texHeight == opacityHeight)
+        {
+            for (size_t i = 0; i != (size_t)opacityWidth * opacityHeight; i++)
+                rgba[i * 4 + 3] = opacityPixels[i];
+        }
+        else
+        {
+            // The nearest texel of the mask is taken: alpha-tested masks are mostly binary, and no extra memory is needed
+            printf("Opacity mask [%s] is %dx%d, scaling it to the %dx%d of [%s]\n", job.opacityFile.c_str(), opacityWidth, opacityHeight,
+                   texWidth, texHeight, job.srcFile.c_str());
+            for (int y = 0; y != texHeight; y++)
+            {
+                const stbi_uc *row = opacityPixels + (size_t)((int64_t)y * opacityHeight / texHeight) * opacityWidth;
+                for (int x = 0; x != texWidth; x++)
+                    rgba[((size_t)y * texWidth + x) * 4 + 3] = row[(int64_t)x * opacityWidth / texWidth];
+            }
+        }
+
+        stbi_image_free(opacityPixels);
+    }
+
+    task.width_ = (uint32_t)texWidth;
+    task.height_ = (uint32_t)texHeight;
+
+    freeBuffer(task.file_);
+    freeBuffer(task.opacityFile_);
+    releaseMemory(p.memory_, task, task.fileBytes_);
+
+    recordStage(p, TextureStage_Decode, (uint64_t)texWidth * texHeight * 4, start);
+}
+
+static void resizeStage(TexturePipeline &p, TextureTask &task)
+{
+    const TextureJob &job = *task.job_;
+    const auto start = Clock::now();
+
+    uint32_t newW, newH;
+    getOutputSize(job, task.width_, task.height_, newW, newH);
+
+    // The colors are filtered in linear space, and the alpha of alpha-tested albedo keeps its coverage.
+    // The MIP levels are built from this image in the same way
+    const TextureProcessingConfig &textureCfg = job.textureCfg;
+    const ResampleConfig resampleCfg = {
+        .filter = textureCfg.mipFilter,
+        .srgb = textureCfg.usage == TextureUsage_Color,
+        .normals = textureCfg.usage == TextureUsage_Normal,
+        .alphaTest = (textureCfg.usage == TextureUsage_Color) ? textureCfg.alphaTest : 0.0f,
+    };
+
+    std::vector<uint8_t> resized((size_t)newW * newH * 4);
+    resampleImage(task.pixels_ ? task.pixels_ : task.image_.data(), task.width_, task.height_, resized.data(), newW, newH, resampleCfg);
+
+    stbi_image_free(task.pixels_);
+    task.pixels_ = nullptr;
+    task.image_.swap(resized);
+    task.width_ = newW;
+    task.height_ = newH;
+
+    freeBuffer(resized);
+    releaseMemory(p.memory_, task, task.sourceBytes_);
+
+    recordStage(p, TextureStage_Resize, task.image_.size(), start);
+}
+
+static void encodeStage(TexturePipeline &p, TextureTask &task)
+{
+    const TextureJob &job = *task.job_;
+    const auto start = Clock::now();
+
+    if (job.ktxOutput)
+    {
+        if (!encodeKTXTexture(task.image_.data(), task.width_, task.height_, job.textureCfg, task.encoded_))
+            task.encoded_.clear();
+    }
+    else
+    {
+        int size = 0;
+        unsigned char *png = stbi_write_png_to_mem(task.image_.data(), 0, task.width_, task.height_, 4, &size);
+        if (png)
+            task.encoded_.assign(png, png + size);
+        // stb_image_write allocates with malloc() unless STBIW_MALLOC is overridden
+        free(png);
+    }
+
+    freeBuffer(task.image_);
+
+    recordStage(p, TextureStage_Encode, task.encoded_.size(), start);
+}
+
+static void writeStage(TexturePipeline &p, TextureTask &task)
+{
+    const TextureJob &job = *task.job_;
+    const auto start = Clock::now();
+
+    bool saved = false;
+    if (!task.encoded_.empty())
+    {
+        if (FILE *f = fopen(job.outputFile.c_str(), "wb"))
+        {
+            saved = fwrite(task.encoded_.data(), 1, task.encoded_.size(), f) == task.encoded_.size();
+            saved = (fclose(f) == 0) && saved;
+        }
+    }
+
+    if (saved)
+    {
+        saveTextureHash(job.outputFile, task.key_);
+    }
+    else
+    {
+        printf("Failed to save [%s] texture\n", job.outputFile.c_str());
+        recordFailure(p);
+    }
+
+    releaseMemory(p.memory_, task, task.reserved_);
+
+    recordStage(p, TextureStage_Write, task.encoded_.size(), start);
+}
+
+/* Threads */
+
+static void workerThread(TexturePipeline &p)
+{
+    TextureStage stage;
+    while (std::unique_ptr<TextureTask> task = popTask(p, TextureStage_Decode, TextureStage_Encode, stage))
+    {
+        if (stage == TextureStage_Decode)
+            decodeStage(p, *task);
+        else if (stage == TextureStage_Resize)
+            resizeStage(p, *task);
+        else
+            encodeStage(p, *task);
+
+        pushTask(p, (TextureStage)(stage + 1), std::move(task));
+    }
+}
+
+static void writerThread(TexturePipeline &p)
+{
+    TextureStage stage;
+    while (std::unique_ptr<TextureTask> task = popTask(p, TextureStage_Write, TextureStage_Write, stage))
+    {
+        writeStage(p, *task);
+        finishTask(p);
+    }
+}
+
+TexturePipelineStats runTexturePipeline(const std::vector<TextureJob> &jobs, const TexturePipelineConfig &cfg)
+{
+    if (jobs.empty())
+        return TexturePipelineStats();
+
+    const auto start = Clock::now();
+
+    TexturePipeline p;
+    p.memory_.budget_ = cfg.memoryBudget;
+
+    const uint32_t numWorkers = cfg.workers ? cfg.workers : std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::vector<std::thread> threads;
+    threads.emplace_back(readStage, std::ref(p), std::cref(jobs));
+    threads.emplace_back(writerThread, std::ref(p));
+    for (uint32_t i = 0; i != numWorkers; i++)
+        threads.emplace_back(workerThread, std::ref(p));
+
+    for (auto &t : threads)
+        t.join();
+
+    printf("Converted %u textures (%u up to date) in %.2f s with %u workers, peak memory %.1f MB of %.1f MB\n",
+           (uint32_t)jobs.size() - p.upToDate_, p.upToDate_, getSeconds(start), numWorkers,
+           p.memory_.peak_ / (1024.0 * 1024.0), p.memory_.budget_ / (1024.0 * 1024.0));
+
+    for (int s = 0; s != TextureStage_Count; s++)
+    {
+        const StageStats &st = p.stats_[s];
+        const double mb = st.bytes_ / (1024.0 * 1024.0);
+        printf("    %-6s %6u textures %10.1f MB %8.2f s busy %8.1f MB/s\n", kStageNames[s], st.tasks_, mb, st.seconds_, st.seconds_ > 0.0 ? mb / st.seconds_ : 0.0);
+    }
+
+    if (p.failed_)
+        printf("    %u errors, see above\n", p.failed_);
+
+    return TexturePipelineStats{
+        .converted = (uint32_t)jobs.size() - p.upToDate_,
+        .upToDate = p.upToDate_,
+        .failed = p.failed_,
+        .peakMemory = p.memory_.peak_,
+    };
+}
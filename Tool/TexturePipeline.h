@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "TextureProcessing.h"
+
+// The texture conversion of SceneConverter as a pipeline of five stages:
+//   1. read:   the source image (and its opacity map) is read into memory, its content hash decides whether the
+//              cached output can be reused
+//   2. decode: stb_image decodes the file into RGBA8, the opacity map goes into alpha. An opacity map of another size
+//              is scaled to the size of the texture
+//   3. resize: the image is downscaled to the output size, see resampleImage()
+//   4. encode: the MIP chain is built and stored into a .ktx (or .png) file in memory
+//   5. write:  the file and its .hash are written
+// Reading and writing run on their own threads, so the disk stays busy while the workers decode, resize and encode.
+// The workers always pick the task closest to the end of the pipeline: this frees its memory sooner.
+//
+// Every task reserves its estimated peak memory before the source file is read, and returns it stage by stage
+// as the buffers are freed. The reader waits while the budget is exhausted, so the memory use is bounded
+// by the budget no matter how many textures there are and how large they are. A texture which alone
+// exceeds the budget is converted once everything else has finished
+
+struct TextureJob
+{
+    // the resolved paths of the source files. opacityFile is empty if the texture has no opacity map
+    std::string srcFile;
+    std::string opacityFile;
+    std::string outputFile;
+    // the output is not larger than maxSize x maxSize
+    uint32_t maxSize;
+    TextureProcessingConfig textureCfg;
+    // .ktx with the MIP chain, or .png if false
+    bool ktxOutput;
+    // the hash of all the settings affecting the output, the content hashes of the source files are added to it
+    uint64_t settingsKey;
+};
+
+struct TexturePipelineConfig
+{
+    // decode, resize and encode workers. Zero means one per hardware thread
+    uint32_t workers = 0;
+    // the largest number of bytes held by the textures in flight
+    size_t memoryBudget = 1024ull * 1024 * 1024;
+};
+
+struct TexturePipelineStats
+{
+    uint32_t converted = 0;
+    uint32_t upToDate = 0;
+    // the errors worked around with a fallback: a black image for an unreadable source, the alpha of the source
+    // for an unreadable opacity map. Failed writes are counted here as well
+    uint32_t failed = 0;
+    // the largest number of bytes reserved at once, it never exceeds the budget
+    size_t peakMemory = 0;
+};
+
+// Converts all the jobs and prints the throughput of every stage
+TexturePipelineStats runTexturePipeline(const std::vector<TextureJob> &jobs, const TexturePipelineConfig &cfg);
@@ -0,0 +1,127 @@
+#include "TextureProcessing.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <gli/gli.hpp>
+#include <gli/texture2d.hpp>
+#include <gli/save_ktx.hpp>
+
+#define STB_DXT_IMPLEMENTATION
+#include "stb_dxt.h"
+
+static bool hasTransparentTexels(const uint8_t *rgba, uint32_t numTexels)
+{
+    for (uint32_t i = 0; i != numTexels; i++)
+        if (rgba[i * 4 + 3] != 255)
+            return true;
+
+    return false;
+}
+
+static gli::format getCompressedFormat(const uint8_t *rgba, uint32_t width, uint32_t height, TextureUsage usage)
+{
+    if (usage == TextureUsage_Normal)
+        return gli::FORMAT_RG_ATI2N_UNORM_BLOCK16;
+
+    // BC1 has twice the compression ratio of BC3, so alpha is only kept where it is really used
+    if (usage == TextureUsage_Color && hasTransparentTexels(rgba, width * height))
+        return gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16;
+
+    return gli::FORMAT_RGB_DXT1_UNORM_BLOCK8;
+}
+
+/* MIP chain */
+
+void buildMipChain(const uint8_t *rgba, uint32_t width, uint32_t height, const TextureProcessingConfig &cfg, std::vector<std::vector<uint8_t>> &levels)
+{
+    levels.clear();
+    levels.emplace_back(rgba, rgba + width * height * 4);
+
+    if (!cfg.generateMips)
+        return;
+
+    const ResampleConfig resampleCfg = {
+        .filter = cfg.mipFilter,
+        .srgb = cfg.usage == TextureUsage_Color,
+        .normals = cfg.usage == TextureUsage_Normal,
+        .alphaTest = (cfg.usage == TextureUsage_Color) ? cfg.alphaTest : 0.0f,
+    };
+
+    FloatImage level;
+    decodeImage(rgba, width, height, resampleCfg, level);
+
+    const bool preserveCoverage = resampleCfg.alphaTest > 0.0f;
+    const float coverage = preserveCoverage ? getAlphaCoverage(level, resampleCfg.alphaTest) : 0.0f;
+
+    FloatImage next;
+    while (level.w_ > 1 || level.h_ > 1)
+    {
+        resampleImage(level, std::max(level.w_ / 2, 1u), std::max(level.h_ / 2, 1u), resampleCfg, next);
+        std::swap(level, next);
+
+        // the next levels are filtered from the unscaled alpha, only the stored values are scaled
+        const float alphaScale = preserveCoverage ? findAlphaScale(level, resampleCfg.alphaTest, coverage) : 1.0f;
+
+        levels.emplace_back();
+        encodeImage(level, resampleCfg, alphaScale, levels.back());
+    }
+}
+
+// The blocks on the right and bottom edges of the levels which are not a multiple of 4 repeat the last texels
+static void compressLevel(const uint8_t *rgba, uint32_t width, uint32_t height, gli::format format, uint8_t *dst)
+{
+    const size_t blockSize = gli::block_size(format);
+
+    for (uint32_t by = 0; by < height; by += 4)
+    {
+        for (uint32_t bx = 0; bx < width; bx += 4)
+        {
+            uint8_t block[16 * 4];
+            uint8_t blockRG[16 * 2];
+
+            for (uint32_t i = 0; i != 16; i++)
+            {
+                const uint32_t x = std::min(bx + i % 4, width - 1);
+                const uint32_t y = std::min(by + i / 4, height - 1);
+
+                memcpy(block + i * 4, rgba + (y * width + x) * 4, 4);
+                memcpy(blockRG + i * 2, rgba + (y * width + x) * 4, 2);
+            }
+
+            if (format == gli::FORMAT_RG_ATI2N_UNORM_BLOCK16)
+                stb_compress_bc5_block(dst, blockRG);
+            else
+                stb_compress_dxt_block(dst, block, format == gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16, STB_DXT_HIGHQUAL);
+
+            dst += blockSize;
+        }
+    }
+}
+
+bool encodeKTXTexture(const uint8_t *rgba, uint32_t width, uint32_t height, const TextureProcessingConfig &cfg, std::vector<char> &out)
+{
+    std::vector<std::vector<uint8_t>> levels;
+    buildMipChain(rgba, width, height, cfg, levels);
+
+    const gli::format format = cfg.compress ? getCompressedFormat(rgba, width, height, cfg.usage) : gli::FORMAT_RGBA8_UNORM_PACK8;
+
+    gli::texture2d texture(format, gli::extent2d(width, height), levels.size());
+
+    for (size_t l = 0; l != levels.size(); l++)
+    {
+        uint8_t *dst = static_cast<uint8_t *>(texture.data(0, 0, l));
+
+        if (cfg.compress)
+            compressLevel(levels[l].data(), width, height, format, dst);
+        else
+            memcpy(dst, levels[l].data(), levels[l].size());
+
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+
+    return gli::save_ktx(texture, out);
+}
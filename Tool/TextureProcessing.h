@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "ImageResampling.h"
+
+// The texture processing stage of SceneConverter.
+// The rescaled material textures are stored in KTX files (https://www.khronos.org/ktx/) with a full MIP chain
+// which is generated here, on the CPU, at conversion time. Optionally, every level is block-compressed with
+// stb_dxt, so the renderer uploads the blocks as they are: there is no image decoding at startup and
+// the textures take 4-8 times less GPU memory than RGBA8.
+// The BCn format and the filtering of the MIP levels are chosen by what the material uses the texture for, see TextureUsage
+
+enum TextureUsage
+{
+    // albedo with the opacity map packed into alpha, or emissive color. The color channels are sRGB-encoded,
+    // so they are filtered in linear space. BC3 if any texel is not fully opaque, BC1 otherwise
+    TextureUsage_Color = 0,
+    // tangent-space normal map: the filtered normals are renormalized. Only X and Y are compressed (BC5),
+    // the shaders reconstruct Z from them
+    TextureUsage_Normal = 1,
+    // occlusion-roughness-metallic and other linear data, filtered as is. Alpha is not used: BC1
+    TextureUsage_Data = 2,
+};
+
+struct TextureProcessingConfig
+{
+    TextureUsage usage = TextureUsage_Color;
+    // the alphaTest_ of the materials using this texture as albedo. The filtering smooths alpha, so without any
+    // correction alpha-tested foliage loses its leaves in the distance. With a non-zero threshold the alpha
+    // of every level is scaled to keep the same fraction of texels passing the test as in the top level
+    // ("Computing Alpha Mipmaps" by Ignacio Castano, 2010)
+    float alphaTest = 0.0f;
+    // used for the MIP levels and for the downscaling of the source image as well
+    ResampleFilter mipFilter = ResampleFilter_Kaiser;
+    // one level only if false
+    bool generateMips = true;
+    // BCn blocks, or plain RGBA8 if false
+    bool compress = true;
+};
+
+// rgba is a tightly packed RGBA8 image, it becomes level 0. Every next level is half the size of the previous one
+// (rounded down, but not below 1) down to 1x1. The levels are resampled one from another in floating point,
+// so the rounding errors do not accumulate
+void buildMipChain(const uint8_t *rgba, uint32_t width, uint32_t height, const TextureProcessingConfig &cfg, std::vector<std::vector<uint8_t>> &levels);
+
+// Builds the MIP chain (if cfg.generateMips) and stores it with the format chosen by cfg.compress and cfg.usage.
+// out receives the contents of the .ktx file, the texture pipeline writes it on its own thread
+bool encodeKTXTexture(const uint8_t *rgba, uint32_t width, uint32_t height, const TextureProcessingConfig &cfg, std::vector<char> &out);
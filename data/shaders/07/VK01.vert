@@ -21,7 +21,7 @@ void main()
 	uint refIdx = dd.indexOffset + gl_VertexIndex;
 	// The vertex index is calculated by adding the global vertex offset for this mesh to the
 	// vertex index fetched from the ibo buffer
-	ImDrawVert v = sbo.data[ibo.data[refIdx] + dd.vertexOffset];
+	ImDrawVert v = fetchVertex(ibo.data[refIdx] + dd.vertexOffset);
 
 	// The object-to-world transformation is read directly from transformBuffer using the instance index
 	mat4 model = transformBuffer.data[gl_BaseInstance];
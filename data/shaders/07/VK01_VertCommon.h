@@ -1,7 +1,59 @@
 // two per-frame uniforms – the model-view-projection matrix and the camera position in the world space:
 layout(binding = 0) uniform  UniformBuffer { mat4 proj; mat4 view; vec4 cameraPos; } ubo;
+
+// The vertex stream of a mesh file may be packed (see VertexFormat in src/Scene/VtxData.h).
+// Its description is uploaded in front of the vertices:
+const uint VertexFormat_Float     = 0;
+const uint VertexFormat_Packed    = 1;
+const uint VertexFormat_Quantized = 2;
+
+struct VertexStreamHeader { uint format; uint stride; float posOffset[3]; float posScale[3]; };
+
 // the indices and vertices to be in separate buffers
-layout(binding = 1) readonly buffer SBO    { ImDrawVert data[]; } sbo;
+layout(binding = 1) readonly buffer SBO    { VertexStreamHeader header; uint data[]; } sbo;
 layout(binding = 2) readonly buffer IBO    { uint   data[]; } ibo;
 layout(binding = 3) readonly buffer DrawBO { DrawData data[]; } drawDataBuffer;
 layout(binding = 5) readonly buffer XfrmBO { mat4 data[]; } transformBuffer;
+
+// the same as decodeOctahedral() in src/Scene/VtxData.cpp
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+// Fetches and decodes a vertex. The format is the same for all the vertices, so the branches are uniform
+ImDrawVert fetchVertex(uint vertexIndex)
+{
+	uint base = vertexIndex * sbo.header.stride;
+
+	if (sbo.header.format == VertexFormat_Float)
+	{
+		return ImDrawVert(
+			uintBitsToFloat(sbo.data[base + 0]), uintBitsToFloat(sbo.data[base + 1]), uintBitsToFloat(sbo.data[base + 2]),
+			uintBitsToFloat(sbo.data[base + 3]), uintBitsToFloat(sbo.data[base + 4]),
+			uintBitsToFloat(sbo.data[base + 5]), uintBitsToFloat(sbo.data[base + 6]), uintBitsToFloat(sbo.data[base + 7]));
+	}
+
+	vec3 pos;
+	if (sbo.header.format == VertexFormat_Packed)
+	{
+		pos = uintBitsToFloat(uvec3(sbo.data[base + 0], sbo.data[base + 1], sbo.data[base + 2]));
+	}
+	else
+	{
+		vec3 q = vec3(unpackUnorm2x16(sbo.data[base + 0]), unpackUnorm2x16(sbo.data[base + 1]).x);
+		pos = vec3(sbo.header.posOffset[0], sbo.header.posOffset[1], sbo.header.posOffset[2]) +
+		      q * vec3(sbo.header.posScale[0], sbo.header.posScale[1], sbo.header.posScale[2]);
+	}
+
+	// the texture coordinates and the normal are the last two words in both packed formats
+	uint attribs = base + sbo.header.stride - 2;
+	vec2 uv = unpackHalf2x16(sbo.data[attribs]);
+	vec3 n  = octDecode(unpackSnorm2x16(sbo.data[attribs + 1]));
+
+	return ImDrawVert(pos.x, pos.y, pos.z, uv.x, uv.y, n.x, n.y, n.z);
+}
@@ -14,7 +14,7 @@ void main()
 	DrawData dd = drawDataBuffer.data[gl_BaseInstance];
 
 	uint refIdx = dd.indexOffset + gl_VertexIndex;
-	ImDrawVert v = sbo.data[ibo.data[refIdx] + dd.vertexOffset];
+	ImDrawVert v = fetchVertex(ibo.data[refIdx] + dd.vertexOffset);
 
 	mat4 model = transformBuffer.data[gl_BaseInstance];
 
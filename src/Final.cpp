@@ -119,6 +119,9 @@ struct MyApp : public CameraApp
 
         ImGui::Checkbox("Show object bounding boxes", &showObjectBoxes);
         ImGui::Checkbox("Render transparent objects", &finalRenderer.renderTransparentObjects);
+        ImGui::Checkbox("Frustum culling", &finalRenderer.enableFrustumCulling);
+        ImGui::Checkbox("Enable LODs", &finalRenderer.enableLODs);
+        ImGui::SliderFloat("LOD pixel error", &finalRenderer.lodSelection.maxPixelError, 0.25f, 16.0f);
 
         ImGui::Text("HDR");
         ImGui::Indent(indentSize);
@@ -157,6 +160,7 @@ struct MyApp : public CameraApp
 
         ImGui::Checkbox("Show shadow buffer", &showShadowBuffer);
         ImGui::Checkbox("Show light frustum", &showLightFrustum);
+        ImGui::Checkbox("Cull shadow casters", &finalRenderer.enableShadowCasterCulling);
 
         ImGui::SliderFloat("Light Theta", &g_LightTheta, -85.0f, +85.0f);
         ImGui::SliderFloat("Light Phi", &g_LightPhi, -85.0f, +85.0f);
@@ -253,7 +257,12 @@ struct MyApp : public CameraApp
         // use this light's view matrix to transform the world-space bounding box
         // of the scene into light-space.
         const BoundingBox box = bigBox.getTransformed(lightView);
-        const mat4 lightProj = finalRenderer.enableShadows ? glm::ortho(box.min_.x, box.max_.x, box.min_.y, box.max_.y, -box.max_.z, -box.min_.z) : mat4(0.f);
+        mat4 lightProj = mat4(0.f);
+
+        // The fitted projection only covers the visible part of the scene, so the shadow map resolution is spent
+        // where the camera looks. Without caster culling the whole scene is rendered into the shadow map
+        if (finalRenderer.enableShadows)
+            lightProj = finalRenderer.enableShadowCasterCulling ? finalRenderer.cullShadowCasters(p, view, lightView) : glm::ortho(box.min_.x, box.max_.x, box.min_.y, box.max_.y, -box.max_.z, -box.min_.z);
 
         if (finalRenderer.enableShadows && showLightFrustum)
         {
@@ -273,6 +282,7 @@ struct MyApp : public CameraApp
         finalRenderer.setMatrices(p, view);
         finalRenderer.setLightParameters(lightProj, lightView);
         finalRenderer.setCameraPosition(positioner.getPosition());
+        finalRenderer.selectLODs(p, positioner.getPosition());
 
         for (int i = 0; i < 25; i++)
             finalRenderer.checkLoadedTextures();
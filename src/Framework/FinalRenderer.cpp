@@ -20,6 +20,7 @@ BaseMultiRenderer::BaseMultiRenderer(
 	const size_t imgCount = ctx.vkDev.swapchainImages.size();
 	uniforms_.resize(imgCount);
 	shape_.resize(imgCount);
+	shapesVersion_.assign(imgCount, sceneData_.shapesVersion_);
 	indirect_.resize(imgCount);
 
 	descriptorSets_.resize(imgCount);
@@ -89,11 +90,18 @@ void BaseMultiRenderer::fillCommandBuffer(VkCommandBuffer commandBuffer, size_t
 
 void BaseMultiRenderer::updateIndirectBuffers(size_t currentImage, bool *visibility)
 {
-	VkDrawIndirectCommand *data = nullptr;
-	vkMapMemory(ctx_.vkDev.device, indirect_[currentImage].memory, 0, sizeof(VkDrawIndirectCommand), 0, (void **)&data);
+	// the LODs were changed, so the shaders need the new index offsets
+	if (shapesVersion_[currentImage] != sceneData_.shapesVersion_)
+	{
+		uploadBufferData(ctx_.vkDev, shape_[currentImage].memory, 0, sceneData_.shapes_.data(), sceneData_.shapes_.size() * sizeof(DrawData));
+		shapesVersion_[currentImage] = sceneData_.shapesVersion_;
+	}
 
 	const uint32_t size = (uint32_t)indices_.size(); // (uint32_t)sceneData_.shapes_.size();
 
+	VkDrawIndirectCommand *data = nullptr;
+	vkMapMemory(ctx_.vkDev.device, indirect_[currentImage].memory, 0, size * sizeof(VkDrawIndirectCommand), 0, (void **)&data);
+
 	for (uint32_t i = 0; i != size; i++)
 	{
 		const uint32_t j = sceneData_.shapes_[indices_[i]].meshIndex;
@@ -108,6 +116,13 @@ void BaseMultiRenderer::updateIndirectBuffers(size_t currentImage, bool *visibil
 	vkUnmapMemory(ctx_.vkDev.device, indirect_[currentImage].memory);
 }
 
+// The shadow renderer is not affected: shapes outside the camera frustum may still cast shadows into it
+void FinalMultiRenderer::updateIndirectBuffers(size_t currentImage, bool *visibility)
+{
+	opaqueRenderer.updateIndirectBuffers(currentImage, visibility);
+	transparentRenderer.updateIndirectBuffers(currentImage, visibility);
+}
+
 bool FinalMultiRenderer::checkLoadedTextures()
 {
 	VKSceneData::LoadedImageData data;
@@ -123,12 +138,10 @@ bool FinalMultiRenderer::checkLoadedTextures()
 		sceneData_.loadedFiles_.pop_back();
 	}
 
-	auto newTexture = ctx_.resources.addRGBATexture(data.w_, data.h_, const_cast<uint8_t *>(data.img_));
+	auto newTexture = sceneData_.addLoadedTexture(data);
 
 	transparentRenderer.updateTexture(data.index_, newTexture, 14);
 	opaqueRenderer.updateTexture(data.index_, newTexture, 11);
 
-	stbi_image_free((void *)data.img_);
-
 	return true;
 }
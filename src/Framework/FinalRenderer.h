@@ -60,6 +60,9 @@ private:
 	std::vector<VulkanBuffer> indirect_;
 	std::vector<VulkanBuffer> shape_;
 
+	// the value of VKSceneData::shapesVersion_ uploaded into each of the shape_ buffers
+	std::vector<uint32_t> shapesVersion_;
+
 	struct UBO
 	{
 		mat4 proj_;
@@ -246,6 +249,10 @@ struct FinalMultiRenderer : public Renderer
 
 		shadowRenderer.updateBuffers(currentImage);
 
+		// the shapes were culled in setMatrices() and the shadow casters in cullShadowCasters()
+		updateIndirectBuffers(currentImage, enableFrustumCulling ? sceneData_.shapeVisibility_.get() : nullptr);
+		shadowRenderer.updateIndirectBuffers(currentImage, enableShadowCasterCulling ? sceneData_.casterVisibility_.get() : nullptr);
+
 		uint32_t zeroCount = 0;
 		uploadBufferData(ctx_.vkDev, atomicBuffer.memory, 0, &zeroCount, sizeof(uint32_t));
 
@@ -258,6 +265,31 @@ struct FinalMultiRenderer : public Renderer
 	{
 		transparentRenderer.setMatrices(proj, view);
 		opaqueRenderer.setMatrices(proj, view);
+
+		// the same Y flip as in BaseMultiRenderer::setMatrices()
+		if (enableFrustumCulling)
+			sceneData_.cullShapes(proj * view * glm::scale(glm::mat4(1.f), glm::vec3(1.f, -1.f, 1.f)));
+	}
+
+	// Selects the shapes which may cast shadows into the camera view and returns the light projection fitted to them.
+	// The result is meant to be passed to setLightParameters()
+	inline glm::mat4 cullShadowCasters(const glm::mat4 &proj, const glm::mat4 &view, const glm::mat4 &lightView)
+	{
+		// the same Y flip as in BaseMultiRenderer::setMatrices(). The shadow shaders use unflipped world coordinates
+		return sceneData_.cullShadowCasters(proj * view * glm::scale(glm::mat4(1.f), glm::vec3(1.f, -1.f, 1.f)), lightView, ShadowSize);
+	}
+
+	// Selects the LODs of all the shapes for the current camera. Without enableLODs every shape returns to LOD 0
+	inline void selectLODs(const glm::mat4 &proj, const glm::vec3 &cameraPos)
+	{
+		LODSelectionConfig cfg = lodSelection;
+		if (!enableLODs)
+			cfg.maxPixelError = 0.0f;
+
+		// proj[1][1] is the cotangent of the half vertical field of view, i.e. a unit length at unit distance
+		// covers half of proj[1][1] screen heights. The shapes use the Y-flipped coordinates of setMatrices()
+		const float pixelsPerUnit = 0.5f * proj[1][1] * (float)ctx_.vkDev.framebufferHeight;
+		sceneData_.selectLODs(glm::vec3(cameraPos.x, -cameraPos.y, cameraPos.z), pixelsPerUnit, cfg);
 	}
 
 	inline void setLightParameters(const glm::mat4 &lightProj, const glm::mat4 &lightView)
@@ -293,6 +325,13 @@ struct FinalMultiRenderer : public Renderer
 
 	bool enableShadows = true;
 	bool renderTransparentObjects = true;
+	// CPU culling of the opaque and transparent shapes against the camera frustum using the BVH of VKSceneData
+	bool enableFrustumCulling = true;
+	// draw only the potential shadow casters into the shadow map, see cullShadowCasters()
+	bool enableShadowCasterCulling = true;
+	// screen-space error driven LOD selection, see selectLODs()
+	bool enableLODs = true;
+	LODSelectionConfig lodSelection;
 
 private:
 	VKSceneData &sceneData_;
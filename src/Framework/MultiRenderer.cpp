@@ -1,7 +1,13 @@
 #include "MultiRenderer.h"
+#include "Utils/Utils.h"
+
+#include <algorithm>
 
 #include <stb/stb_image.h>
 
+#include <gli/gli.hpp>
+#include <gli/load_ktx.hpp>
+
 /// Draw a checkerboard on a pre-allocated square RGB image.
 uint8_t *genDefaultCheckerboardImage(int *width, int *height)
 {
@@ -72,17 +78,28 @@ VKSceneData::VKSceneData(VulkanRenderContext &ctx,
 	{
 		// create an independent asynchronous task for each texture file
 		// using the provided lambda. This lambda loads a texture from a file using the STB
-		// library and stores the loaded data in loadedFiles_
+		// library (or gli for the compressed .ktx files) and stores the loaded data in loadedFiles_
 		loadedFiles_.reserve(textureFiles_.size());
 
 		taskflow_.for_each_index(0u, (uint32_t)textureFiles_.size(), 1u, [this](int idx)
 								 {
-				int w, h;
-				const uint8_t* img = stbi_load(this->textureFiles_[idx].c_str(), &w, &h, nullptr, STBI_rgb_alpha);
-				if (!img)
+				int w = 0, h = 0;
+				const uint8_t* img = nullptr;
+				std::shared_ptr<gli::texture> ktx;
+				if (endsWith(this->textureFiles_[idx].c_str(), ".ktx"))
+				{
+					ktx = std::make_shared<gli::texture>(gli::load_ktx(this->textureFiles_[idx]));
+					if (ktx->empty())
+						ktx.reset();
+				}
+				else
+				{
+					img = stbi_load(this->textureFiles_[idx].c_str(), &w, &h, nullptr, STBI_rgb_alpha);
+				}
+				if (!img && !ktx)
 					img = genDefaultCheckerboardImage(&w, &h);
 				std::lock_guard lock(loadedFilesMutex_);
-				loadedFiles_.emplace_back(LoadedImageData { idx, w, h, img }); });
+				loadedFiles_.emplace_back(LoadedImageData { idx, w, h, img, ktx }); });
 
 		executor_.run(taskflow_);
 	}
@@ -99,28 +116,54 @@ VKSceneData::VKSceneData(VulkanRenderContext &ctx,
 	loadScene(sceneFile);
 }
 
+VulkanTexture VKSceneData::addLoadedTexture(const LoadedImageData &data)
+{
+	if (data.ktx_)
+	{
+		return ctx.resources.addKTXTexture(*data.ktx_);
+	}
+
+	VulkanTexture tex = ctx.resources.addRGBATexture(data.w_, data.h_, const_cast<uint8_t *>(data.img_));
+	stbi_image_free((void *)data.img_);
+	return tex;
+}
+
 // After loading, vertices and indices are
 // uploaded into a single buffer. The actual code is slightly more involved because
 // Vulkan requires sub-buffer offsets to be a multiple of the minimum alignment value.
+// The mesh file is memory-mapped, so the vertex and index data go straight from the
+// file pages into the GPU buffer. Only the small mesh descriptors and bounding boxes
+// are copied into meshData_ because the renderers access them every frame.
 void VKSceneData::loadMeshes(const char *meshFile)
 {
-	MeshFileHeader header = loadMeshData(meshFile, meshData_);
+	MeshDataView view;
+	MeshFileHeader header = loadMeshDataView(meshFile, view);
 
-	const uint32_t indexBufferSize = header.indexDataSize;
-	uint32_t vertexBufferSize = header.vertexDataSize;
+	meshData_.meshes_.assign(view.meshes_.begin(), view.meshes_.end());
+	meshData_.boxes_.assign(view.boxes_.begin(), view.boxes_.end());
+
+	// The file format has 64-bit sizes, but a single GPU storage buffer (and BufferAttachment) is still limited to 4 GB
+	if (header.indexDataSize + header.vertexDataSize + sizeof(VertexStreamHeader) > UINT32_MAX)
+	{
+		printf("Mesh file %s is too large for a single storage buffer\n", meshFile);
+		exit(EXIT_FAILURE);
+	}
 
+	const uint32_t indexBufferSize = (uint32_t)header.indexDataSize;
+	// the vertex-pulling shaders find the format of the (possibly packed) vertex stream in front of it
+	uint32_t vertexBufferSize = (uint32_t)(sizeof(VertexStreamHeader) + header.vertexDataSize);
+
+	// The padding only has to exist in the GPU buffer, there is no need to append zeros to the source data
 	const uint32_t offsetAlignment = getVulkanBufferAlignment(ctx.vkDev);
 	if ((vertexBufferSize & (offsetAlignment - 1)) != 0)
-	{
-		const size_t numFloats = (offsetAlignment - (vertexBufferSize & (offsetAlignment - 1))) / sizeof(float);
-		for (size_t i = 0; i != numFloats; i++)
-			meshData_.vertexData_.push_back(0);
 		vertexBufferSize = (vertexBufferSize + offsetAlignment) & ~(offsetAlignment - 1);
-	}
 
 	VulkanBuffer storage = ctx.resources.addStorageBuffer(vertexBufferSize + indexBufferSize);
-	uploadBufferData(ctx.vkDev, storage.memory, 0, meshData_.vertexData_.data(), vertexBufferSize);
-	uploadBufferData(ctx.vkDev, storage.memory, vertexBufferSize, meshData_.indexData_.data(), indexBufferSize);
+	uploadBufferData(ctx.vkDev, storage.memory, 0, &view.vertexStream_, sizeof(VertexStreamHeader));
+	uploadBufferData(ctx.vkDev, storage.memory, sizeof(VertexStreamHeader), view.vertexData_.data(), view.vertexData_.size_bytes());
+	uploadBufferData(ctx.vkDev, storage.memory, vertexBufferSize, view.indexData_.data(), indexBufferSize);
+
+	releaseMeshDataView(view);
 
 	vertexBuffer_ = BufferAttachment{.dInfo = {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .shaderStageFlags = VK_SHADER_STAGE_VERTEX_BIT}, .buffer = storage, .offset = 0, .size = vertexBufferSize};
 	indexBuffer_ = BufferAttachment{.dInfo = {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .shaderStageFlags = VK_SHADER_STAGE_VERTEX_BIT}, .buffer = storage, .offset = vertexBufferSize, .size = indexBufferSize};
@@ -133,23 +176,29 @@ void VKSceneData::loadScene(const char *sceneFile)
 {
 	::loadScene(sceneFile, scene_);
 
+	shapeForNode_.assign(scene_.hierarchy_.size(), -1);
+
 	// prepare draw data buffer
+	// the mesh items are sorted by node, so the shapes are generated in node order
+	shapes_.reserve(scene_.meshes_.size());
 	for (const auto &c : scene_.meshes_)
 	{
-		auto material = scene_.materialForNode_.find(c.first);
-		if (material == scene_.materialForNode_.end())
+		const NodeMapItem *material = scene_.materialForNode_.find(c.node_);
+		if (!material)
 			continue;
 
+		shapeForNode_[c.node_] = (int)shapes_.size();
+
 		// we also store material indices.
 		// the next line binds our scene node's global transform to the GPU-drawable element: a shape.
 		shapes_.push_back(
 			DrawData{
-				.meshIndex = c.second,
-				.materialIndex = material->second,
+				.meshIndex = c.value_,
+				.materialIndex = material->value_,
 				.LOD = 0,
-				.indexOffset = meshData_.meshes_[c.second].indexOffset,
-				.vertexOffset = meshData_.meshes_[c.second].vertexOffset,
-				.transformIndex = c.first});
+				.indexOffset = meshData_.meshes_[c.value_].indexOffset,
+				.vertexOffset = meshData_.meshes_[c.value_].vertexOffset,
+				.transformIndex = c.node_});
 	}
 
 	// After the shape list has been created, we allocate a GPU buffer for all global
@@ -159,6 +208,103 @@ void VKSceneData::loadScene(const char *sceneFile)
 
 	recalculateAllTransforms();
 	uploadGlobalTransforms();
+
+	buildShapeBVH();
+}
+
+static BoundingBox getShapeBox(const VKSceneData &sceneData, uint32_t shape)
+{
+	return sceneData.meshData_.boxes_[sceneData.shapes_[shape].meshIndex].getTransformed(sceneData.shapeTransforms_[shape]);
+}
+
+void VKSceneData::buildShapeBVH()
+{
+	shapeBoxes_.resize(shapes_.size());
+	for (uint32_t s = 0; s != (uint32_t)shapes_.size(); s++)
+		shapeBoxes_[s] = getShapeBox(*this, s);
+
+	buildBVH(shapeBVH_, shapeBoxes_);
+
+	shapeVisibility_ = std::make_unique<bool[]>(shapes_.size());
+	visibleShapes_.clear();
+
+	casterVisibility_ = std::make_unique<bool[]>(shapes_.size());
+	visibleCasters_.clear();
+}
+
+bool *VKSceneData::cullShapes(const glm::mat4 &viewProj)
+{
+	const CullingFrustum frustum = getCullingFrustum(viewProj);
+
+	for (uint32_t s : visibleShapes_)
+		shapeVisibility_[s] = false;
+
+	cullBVH(shapeBVH_, frustum, visibleShapes_);
+
+	for (uint32_t s : visibleShapes_)
+		shapeVisibility_[s] = true;
+
+	return shapeVisibility_.get();
+}
+
+// The caster volume is found by findShadowCasters(), it only remains to drop the shapes which do not cast shadows
+// and to pull the near plane of the light projection down to the highest of the remaining casters
+glm::mat4 VKSceneData::cullShadowCasters(const glm::mat4 &viewProj, const glm::mat4 &lightView, uint32_t shadowMapSize)
+{
+	for (uint32_t s : visibleCasters_)
+		casterVisibility_[s] = false;
+	visibleCasters_.clear();
+
+	BoundingBox receivers;
+	std::vector<uint32_t> candidates;
+
+	if (!findShadowCasters(shapeBVH_, viewProj, lightView, shadowMapSize, receivers, candidates))
+		return glm::mat4(0.0f);
+
+	// the near plane of the light projection only has to reach the highest caster
+	float castersMaxZ = receivers.max_.z;
+
+	for (uint32_t s : candidates)
+	{
+		if (!(materials_[shapes_[s].materialIndex].flags_ & sMaterialFlags_CastShadow))
+			continue;
+
+		visibleCasters_.push_back(s);
+		casterVisibility_[s] = true;
+		castersMaxZ = std::max(castersMaxZ, shapeBoxes_[s].getTransformed(lightView).max_.z);
+	}
+
+	return glm::ortho(receivers.min_.x, receivers.max_.x, receivers.min_.y, receivers.max_.y, -castersMaxZ, -receivers.min_.z);
+}
+
+bool VKSceneData::selectLODs(const glm::vec3 &cameraPos, float pixelsPerUnit, const LODSelectionConfig &cfg)
+{
+	bool changed = false;
+
+	for (uint32_t s = 0; s != (uint32_t)shapes_.size(); s++)
+	{
+		DrawData &shape = shapes_[s];
+		const Mesh &mesh = meshData_.meshes_[shape.meshIndex];
+
+		if (mesh.lodCount < 2)
+			continue;
+
+		const float errorScale = getLODErrorScale(shapeBoxes_[s], getMaxScale(shapeTransforms_[s]), cameraPos, pixelsPerUnit);
+		const uint32_t lod = selectLOD(mesh, shape.LOD, errorScale, cfg);
+
+		if (lod == shape.LOD)
+			continue;
+
+		// the shaders fetch the indices starting from indexOffset, and the indirect commands take the index count from the LOD
+		shape.LOD = lod;
+		shape.indexOffset = mesh.indexOffset + mesh.lodOffset[lod];
+		changed = true;
+	}
+
+	if (changed)
+		shapesVersion_++;
+
+	return changed;
 }
 
 void VKSceneData::updateMaterial(int matIdx)
@@ -173,6 +319,15 @@ void VKSceneData::convertGlobalToShapeTransforms()
 	size_t i = 0;
 	for (const auto &c : shapes_)
 		shapeTransforms_[i++] = scene_.globalTransform_[c.transformIndex];
+
+	// the BVH does not exist yet while the scene is being loaded
+	if (shapeBVH_.nodes_.empty())
+		return;
+
+	for (uint32_t s = 0; s != (uint32_t)shapes_.size(); s++)
+		shapeBoxes_[s] = getShapeBox(*this, s);
+
+	refitBVH(shapeBVH_, shapeBoxes_);
 }
 
 // recalculates all the global transformations after marking each node as changed:
@@ -180,7 +335,7 @@ void VKSceneData::recalculateAllTransforms()
 {
 	// force recalculation of global transformations
 	markAsChanged(scene_, 0);
-	recalculateGlobalTransforms(scene_);
+	recalculateGlobalTransformsParallel(scene_, executor_);
 }
 
 // fetches global shape transforms from the node transform list and immediately uploads these transforms to the GPU buffer:
@@ -188,6 +343,57 @@ void VKSceneData::uploadGlobalTransforms()
 {
 	convertGlobalToShapeTransforms();
 	uploadBufferData(ctx.vkDev, transforms_.memory, 0, shapeTransforms_.data(), transforms_.size);
+
+	// everything is up to date now
+	dirtyShapeRanges_.clear();
+}
+
+// Only the nodes in the changedAtThisFrame_ lists are recalculated. The lists are consumed by
+// recalculateGlobalTransforms(), so the shapes of these nodes are collected beforehand
+void VKSceneData::recalculateChangedTransforms()
+{
+	std::vector<uint32_t> dirtyShapes;
+
+	for (const auto &changed : scene_.changedAtThisFrame_)
+		for (int node : changed)
+			if (shapeForNode_[node] > -1)
+				dirtyShapes.push_back((uint32_t)shapeForNode_[node]);
+
+	recalculateGlobalTransformsParallel(scene_, executor_);
+
+	if (dirtyShapes.empty())
+		return;
+
+	// markAsChanged() adds every node once, so the shapes are unique and only have to be sorted to be coalesced
+	std::sort(dirtyShapes.begin(), dirtyShapes.end());
+
+	for (uint32_t s : dirtyShapes)
+	{
+		shapeTransforms_[s] = scene_.globalTransform_[shapes_[s].transformIndex];
+		shapeBoxes_[s] = getShapeBox(*this, s);
+	}
+
+	refitBVH(shapeBVH_, shapeBoxes_, dirtyShapes);
+
+	// Neighbouring shapes are coalesced into a single range. Small gaps are uploaded as well,
+	// because a few redundant matrices are cheaper than a separate upload
+	constexpr uint32_t kMaxRangeGap = 4;
+
+	for (uint32_t s : dirtyShapes)
+	{
+		if (!dirtyShapeRanges_.empty() && s >= dirtyShapeRanges_.back().begin_ && s <= dirtyShapeRanges_.back().end_ + kMaxRangeGap)
+			dirtyShapeRanges_.back().end_ = std::max(dirtyShapeRanges_.back().end_, s + 1);
+		else
+			dirtyShapeRanges_.push_back(DirtyRange{.begin_ = s, .end_ = s + 1});
+	}
+}
+
+void VKSceneData::uploadDirtyTransforms()
+{
+	for (const auto &r : dirtyShapeRanges_)
+		uploadBufferData(ctx.vkDev, transforms_.memory, r.begin_ * sizeof(glm::mat4), shapeTransforms_.data() + r.begin_, (r.end_ - r.begin_) * sizeof(glm::mat4));
+
+	dirtyShapeRanges_.clear();
 }
 
 MultiRenderer::MultiRenderer(
@@ -213,6 +419,7 @@ MultiRenderer::MultiRenderer(
 	const size_t imgCount = ctx.vkDev.swapchainImages.size();
 	uniforms_.resize(imgCount);
 	shape_.resize(imgCount);
+	shapesVersion_.assign(imgCount, sceneData_.shapesVersion_);
 	indirect_.resize(imgCount);
 
 	descriptorSets_.resize(imgCount);
@@ -299,13 +506,20 @@ void MultiRenderer::updateBuffers(size_t imageIndex)
 
 void MultiRenderer::updateIndirectBuffers(size_t currentImage, bool *visibility)
 {
-	// The indirect command buffer is updated using a local memory mapping:
-	VkDrawIndirectCommand *data = nullptr;
-	vkMapMemory(ctx_.vkDev.device, indirect_[currentImage].memory, 0, sizeof(VkDrawIndirectCommand), 0, (void **)&data);
+	// the LODs were changed, so the shaders need the new index offsets
+	if (shapesVersion_[currentImage] != sceneData_.shapesVersion_)
+	{
+		uploadBufferData(ctx_.vkDev, shape_[currentImage].memory, 0, sceneData_.shapes_.data(), sceneData_.shapes_.size() * sizeof(DrawData));
+		shapesVersion_[currentImage] = sceneData_.shapesVersion_;
+	}
 
 	// Each of the shapes in a scene gets its own draw command:
 	const uint32_t size = (uint32_t)sceneData_.shapes_.size();
 
+	// The indirect command buffer is updated using a local memory mapping of all the commands:
+	VkDrawIndirectCommand *data = nullptr;
+	vkMapMemory(ctx_.vkDev.device, indirect_[currentImage].memory, 0, size * sizeof(VkDrawIndirectCommand), 0, (void **)&data);
+
 	for (uint32_t i = 0; i != size; i++)
 	{
 		const uint32_t j = sceneData_.shapes_[i].meshIndex;
@@ -344,9 +558,7 @@ bool MultiRenderer::checkLoadedTextures()
 
 	// Once a new image data has been retrieved, we can create a new
 	// texture and update the materials accordingly:
-	this->updateTexture(data.index_, ctx_.resources.addRGBATexture(data.w_, data.h_, const_cast<uint8_t *>(data.img_)));
-
-	stbi_image_free((void *)data.img_);
+	this->updateTexture(data.index_, sceneData_.addLoadedTexture(data));
 
 	return true;
 }
@@ -4,11 +4,14 @@
 
 #include "Renderer.h"
 #include "Scene/Scene.h"
+#include "Scene/BVH.h"
 #include "Scene/Material.h"
 #include "Scene/VtxData.h"
 
 #include <taskflow/taskflow.hpp>
 
+#include <memory>
+
 // A single instance of VKSceneData can be
 // shared between multiple renderers to simplify multipass rendering techniques
 // The input scene contains the linearized scene graph in
@@ -57,6 +60,8 @@ struct VKSceneData
 	BufferAttachment indexBuffer_;
 	BufferAttachment vertexBuffer_;
 
+	// Only meshes_ and boxes_ are kept on the CPU side, the index and vertex data
+	// are uploaded directly from the memory-mapped mesh file in loadMeshes()
 	MeshData meshData_;
 
 	// local CPU-accessible scene, material, and mesh data arrays:
@@ -71,6 +76,36 @@ struct VKSceneData
 
 	std::vector<DrawData> shapes_;
 
+	// incremented whenever shapes_ is modified (i.e. by selectLODs()), so the renderers know their copies are stale
+	uint32_t shapesVersion_ = 0;
+
+	// Index of the shape attached to each scene node (or -1). A node has at most one mesh, hence at most one shape
+	std::vector<int> shapeForNode_;
+
+	// Contiguous ranges [begin_, end_) of shapeTransforms_ which were modified since the last upload
+	struct DirtyRange
+	{
+		uint32_t begin_;
+		uint32_t end_;
+	};
+
+	std::vector<DirtyRange> dirtyShapeRanges_;
+
+	// World-space bounding boxes of the shapes and a BVH over them for CPU frustum culling.
+	// The BVH is built once in loadScene() and refitted whenever the shape transforms change
+	std::vector<BoundingBox> shapeBoxes_;
+	BVH shapeBVH_;
+
+	// Per-shape flags in the format expected by updateIndirectBuffers(). Only the flags of the shapes visible
+	// in the previous call are reset, so the cost of culling depends on the number of visible shapes
+	// and not on the total number of shapes
+	std::unique_ptr<bool[]> shapeVisibility_;
+	std::vector<uint32_t> visibleShapes_;
+
+	// the same for the shapes which may cast shadows into the camera view, see cullShadowCasters()
+	std::unique_ptr<bool[]> casterVisibility_;
+	std::vector<uint32_t> visibleCasters_;
+
 	void loadScene(const char *sceneFile);
 	void loadMeshes(const char *meshFile);
 
@@ -78,8 +113,35 @@ struct VKSceneData
 	void recalculateAllTransforms();
 	void uploadGlobalTransforms();
 
+	// Incremental mode: only the subtrees marked with markAsChanged() are recalculated,
+	// and only the modified ranges of the transforms buffer are uploaded
+	void recalculateChangedTransforms();
+	void uploadDirtyTransforms();
+
 	void updateMaterial(int matIdx);
 
+	// Builds the BVH from scratch. Only loadScene() calls it, the moving shapes merely refit the tree.
+	// That keeps the culling correct, but after large movements the boxes of the tree get loose:
+	// an application moving many shapes far can call it again to make the culling efficient
+	void buildShapeBVH();
+
+	// viewProj must be the full matrix used by the shaders, i.e. including the Y flip of MultiRenderer::setMatrices().
+	// Returns the visibility flags of all the shapes
+	bool *cullShapes(const glm::mat4 &viewProj);
+
+	// Finds the potential shadow casters of a directional light: the shapes with the sMaterialFlags_CastShadow flag
+	// whose extrusion along the light direction intersects the camera frustum. They are marked in casterVisibility_.
+	// Returns an orthographic light projection fitted to the visible part of the scene and to these casters,
+	// or a zero matrix (which disables shadows in the shaders) if the camera does not see the scene at all.
+	// The XY bounds are snapped to the texels of a shadowMapSize x shadowMapSize shadow map, see findShadowCasters()
+	glm::mat4 cullShadowCasters(const glm::mat4 &viewProj, const glm::mat4 &lightView, uint32_t shadowMapSize);
+
+	// Picks the coarsest LOD of every shape whose simplification error (Mesh::lodError), projected onto the screen
+	// at the distance of the shape's bounding sphere, stays within cfg.maxPixelError. cameraPos is in the same
+	// coordinates as the shape boxes, pixelsPerUnit is the size in pixels of a unit-length segment at unit distance.
+	// Updates the LOD and indexOffset fields of shapes_ and returns true if any of them changed
+	bool selectLODs(const glm::vec3 &cameraPos, float pixelsPerUnit, const LODSelectionConfig &cfg);
+
 	/* async loading */
 	struct LoadedImageData
 	{
@@ -87,8 +149,14 @@ struct VKSceneData
 		int w_ = 0;
 		int h_ = 0;
 		const uint8_t *img_ = nullptr;
+		// the .ktx files are uploaded with all their levels instead of img_.
+		// Shared because the entries are copied out of loadedFiles_
+		std::shared_ptr<gli::texture> ktx_;
 	};
 
+	// Creates a texture from the asynchronously loaded data and frees the data
+	VulkanTexture addLoadedTexture(const LoadedImageData &data);
+
 	std::vector<std::string> textureFiles_;
 	std::vector<LoadedImageData> loadedFiles_;
 	std::mutex loadedFilesMutex_;
@@ -153,6 +221,9 @@ private:
 	std::vector<VulkanBuffer> indirect_;
 	std::vector<VulkanBuffer> shape_;
 
+	// the value of VKSceneData::shapesVersion_ uploaded into each of the shape_ buffers
+	std::vector<uint32_t> shapesVersion_;
+
 	struct UBO
 	{
 		mat4 proj_;
@@ -7,11 +7,14 @@
 
 #include <imgui/imgui.h>
 
+#include "Utils/Utils.h"
+
 #include <gli/gli.hpp>
 #include <gli/texture2d.hpp>
 #include <gli/load_ktx.hpp>
 
 #include <algorithm>
+#include <string.h>
 
 glslang_stage_t glslangShaderStageFromFileName(const char *fileName);
 
@@ -105,10 +108,216 @@ VulkanTexture VulkanResources::loadKTX(const char *fileName)
 	return ktx;
 }
 
+static VkFormat getVkFormatFromKTX(gli::format format)
+{
+	switch (format)
+	{
+	case gli::FORMAT_RGB_DXT1_UNORM_BLOCK8:
+		return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8:
+		return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+	case gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16:
+		return VK_FORMAT_BC3_UNORM_BLOCK;
+	case gli::FORMAT_RG_ATI2N_UNORM_BLOCK16:
+		return VK_FORMAT_BC5_UNORM_BLOCK;
+	case gli::FORMAT_RGBA8_UNORM_PACK8:
+		return VK_FORMAT_R8G8B8A8_UNORM;
+	default:
+		break;
+	}
+	return VK_FORMAT_UNDEFINED;
+}
+
+// The decoding of the BCn blocks written by SceneConverter for the devices without textureCompressionBC.
+// See the "S3 Texture Compression" and "RGTC" sections of the Khronos Data Format Specification
+
+// BC3 color blocks always use four colors. The three-color BC1 blocks have black as the fourth one,
+// transparent if the format has alpha
+static void decodeBC1Colors(const uint8_t *block, bool bc3, bool hasAlpha, uint8_t colors[4][4])
+{
+	const uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+	const uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+
+	for (int i = 0; i != 2; i++)
+	{
+		const uint16_t c = i ? c1 : c0;
+		colors[i][0] = (uint8_t)(((c >> 11) & 31) * 255 / 31);
+		colors[i][1] = (uint8_t)(((c >> 5) & 63) * 255 / 63);
+		colors[i][2] = (uint8_t)((c & 31) * 255 / 31);
+		colors[i][3] = 255;
+	}
+
+	const bool fourColors = c0 > c1 || bc3;
+	for (int k = 0; k != 3; k++)
+	{
+		colors[2][k] = fourColors ? (uint8_t)((2 * colors[0][k] + colors[1][k]) / 3) : (uint8_t)((colors[0][k] + colors[1][k]) / 2);
+		colors[3][k] = fourColors ? (uint8_t)((colors[0][k] + 2 * colors[1][k]) / 3) : 0;
+	}
+	colors[2][3] = 255;
+	colors[3][3] = (fourColors || !hasAlpha) ? 255 : 0;
+}
+
+// a BC4 block: 8 values interpolated between two endpoints, or 6 values plus 0 and 255
+static void decodeBC4Values(const uint8_t *block, uint8_t values[16])
+{
+	uint8_t palette[8] = {block[0], block[1]};
+	for (int i = 1; i != 7; i++)
+		palette[i + 1] = block[0] > block[1] ? (uint8_t)(((7 - i) * block[0] + i * block[1]) / 7)
+											 : (i < 5 ? (uint8_t)(((5 - i) * block[0] + i * block[1]) / 5) : (i == 5 ? 0 : 255));
+
+	uint64_t bits = 0;
+	for (int i = 0; i != 6; i++)
+		bits |= (uint64_t)block[2 + i] << (8 * i);
+
+	for (int i = 0; i != 16; i++)
+		values[i] = palette[(bits >> (3 * i)) & 7];
+}
+
+static uint32_t getBlockSize(gli::format format)
+{
+	switch (format)
+	{
+	case gli::FORMAT_RGB_DXT1_UNORM_BLOCK8:
+	case gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8:
+		return 8;
+	case gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16:
+	case gli::FORMAT_RG_ATI2N_UNORM_BLOCK16:
+		return 16;
+	default:
+		break;
+	}
+	return 0;
+}
+
+// Expands all the levels of a BC1, BC3 or BC5 texture into tightly packed RGBA8 levels.
+// The normal maps (BC5) get zero in blue, exactly what sampling the compressed texture returns
+static std::vector<uint8_t> decodeBCTexture(const gli::texture &ktx)
+{
+	const gli::format format = ktx.format();
+	const uint32_t blockSize = getBlockSize(format);
+
+	std::vector<uint8_t> result;
+
+	for (size_t level = 0; level != ktx.levels(); level++)
+	{
+		const glm::tvec3<uint32_t> extent(ktx.extent(level));
+		const uint32_t w = extent.x;
+		const uint32_t h = extent.y;
+		const uint8_t *src = (const uint8_t *)ktx.data(0, 0, level);
+
+		const size_t levelOffset = result.size();
+		result.resize(levelOffset + (size_t)w * h * 4);
+		uint8_t *dst = result.data() + levelOffset;
+
+		for (uint32_t by = 0; by < h; by += 4)
+		{
+			for (uint32_t bx = 0; bx < w; bx += 4, src += blockSize)
+			{
+				uint8_t texels[16][4];
+
+				if (format == gli::FORMAT_RG_ATI2N_UNORM_BLOCK16)
+				{
+					uint8_t r[16], g[16];
+					decodeBC4Values(src, r);
+					decodeBC4Values(src + 8, g);
+					for (int i = 0; i != 16; i++)
+					{
+						texels[i][0] = r[i];
+						texels[i][1] = g[i];
+						texels[i][2] = 0;
+						texels[i][3] = 255;
+					}
+				}
+				else
+				{
+					const uint8_t *colorBlock = blockSize == 16 ? src + 8 : src;
+					uint8_t colors[4][4];
+					decodeBC1Colors(colorBlock, blockSize == 16, format == gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8, colors);
+
+					const uint32_t indices = colorBlock[4] | (colorBlock[5] << 8) | (colorBlock[6] << 16) | ((uint32_t)colorBlock[7] << 24);
+					for (int i = 0; i != 16; i++)
+						memcpy(texels[i], colors[(indices >> (2 * i)) & 3], 4);
+
+					if (blockSize == 16)
+					{
+						uint8_t alpha[16];
+						decodeBC4Values(src, alpha);
+						for (int i = 0; i != 16; i++)
+							texels[i][3] = alpha[i];
+					}
+				}
+
+				// the blocks on the right and bottom edges of small levels are only partially inside the image
+				for (uint32_t y = 0; y != 4 && by + y < h; y++)
+					for (uint32_t x = 0; x != 4 && bx + x < w; x++)
+						memcpy(dst + ((by + y) * w + bx + x) * 4, texels[y * 4 + x], 4);
+			}
+		}
+	}
+
+	return result;
+}
+
+VulkanTexture VulkanResources::addKTXTexture(const gli::texture &ktx)
+{
+	const glm::tvec3<uint32_t> extent(ktx.extent(0));
+	const uint32_t mipLevels = (uint32_t)ktx.levels();
+
+	// without textureCompressionBC the blocks are decoded here and uploaded as RGBA8
+	const bool decodeBC = !vkDev.useTextureCompressionBC && getBlockSize(ktx.format());
+	const std::vector<uint8_t> rgba = decodeBC ? decodeBCTexture(ktx) : std::vector<uint8_t>();
+	const void *data = decodeBC ? (const void *)rgba.data() : ktx.data();
+
+	VulkanTexture tex = {
+		.width = extent.x,
+		.height = extent.y,
+		.depth = 1,
+		.format = decodeBC ? VK_FORMAT_R8G8B8A8_UNORM : getVkFormatFromKTX(ktx.format())};
+
+	if (tex.format == VK_FORMAT_UNDEFINED || ktx.target() != gli::TARGET_2D)
+	{
+		printf("Unsupported KTX texture format\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// gli keeps the levels of a single-layer texture tightly packed, the same way the staging buffer needs them
+	const bool created = bytesPerTexBlock(tex.format) ? createCompressedMIPTextureImageFromData(vkDev, tex.image.image, tex.image.imageMemory,
+																							   data, mipLevels, tex.width, tex.height, tex.format)
+													  : createMIPTextureImageFromData(vkDev, tex.image.image, tex.image.imageMemory,
+																					  data, mipLevels, tex.width, tex.height, tex.format);
+	if (!created)
+	{
+		printf("Cannot create KTX texture\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (!createImageView(vkDev.device, tex.image.image, tex.format, VK_IMAGE_ASPECT_COLOR_BIT, &tex.image.imageView, VK_IMAGE_VIEW_TYPE_2D, 1, mipLevels))
+	{
+		printf("Cannot create image view for KTX texture\n");
+		exit(EXIT_FAILURE);
+	}
+
+	createTextureSampler(vkDev.device, &tex.sampler, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT, mipLevels);
+	allTextures.push_back(tex);
+	return tex;
+}
+
 // we loaded the textures in an ad hoc fashion, as well as created
 // the image and sampler. Here, we will wrap the texture file loading code in a single method
 VulkanTexture VulkanResources::loadTexture2D(const char *filename)
 {
+	// the material textures from SceneConverter with their MIP levels, possibly block-compressed
+	if (endsWith(filename, ".ktx"))
+	{
+		const gli::texture ktx = gli::load_ktx(filename);
+		if (ktx.empty())
+		{
+			printf("Cannot load %s 2D texture file\n", filename);
+			exit(EXIT_FAILURE);
+		}
+		return addKTXTexture(ktx);
+	}
+
 	VulkanTexture tex;
 	if (!createTextureImage(vkDev, filename, tex.image.image, tex.image.imageMemory, &tex.width, &tex.height))
 	{
@@ -123,8 +332,8 @@ VulkanTexture VulkanResources::loadTexture2D(const char *filename)
 	// loaded images are intended to be used as inputs for fragment shaders
 	transitionImageLayout(vkDev, tex.image.image, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-	// A major improvement we could
-	// make to this routine would be to calculate the MIP levels for the loaded image
+	// The images loaded here have a single MIP level. The material textures come with
+	// their MIP levels precalculated by SceneConverter in the .ktx files, see above
 	if (!createImageView(vkDev.device, tex.image.image, format, VK_IMAGE_ASPECT_COLOR_BIT, &tex.image.imageView))
 	{
 		printf("Cannot create image view for 2d texture (%s)\n", filename);
@@ -8,6 +8,11 @@
 #include <map>
 #include <utility>
 
+namespace gli
+{
+	class texture;
+}
+
 /**
 	For more or less abstract descriptor set setup we need to describe individual items ("bindings").
 	These are buffers, textures (samplers, but we call them "textures" here) and arrays of textures.
@@ -169,6 +174,10 @@ struct VulkanResources
 
 	VulkanTexture loadKTX(const char *fileName);
 
+	// Uploads a 2D texture with all its MIP levels as it is stored in a KTX file. SceneConverter generates
+	// the levels, so nothing is computed here, and the block-compressed textures are not decoded on the CPU at all
+	VulkanTexture addKTXTexture(const gli::texture &ktx);
+
 	VulkanTexture createFontTexture(const char *fontFile);
 
 	VulkanTexture addColorTexture(int texWidth = 0, int texHeight = 0, VkFormat colorFormat = VK_FORMAT_B8G8R8A8_UNORM, VkFilter minFilter = VK_FILTER_LINEAR, VkFilter maxFilter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT);
@@ -0,0 +1,362 @@
+#include "BVH.h"
+
+#include <float.h>
+#include <math.h>
+
+#include <algorithm>
+#include <bit>
+
+static BoundingBox emptyBox()
+{
+    BoundingBox b;
+    b.min_ = vec3(FLT_MAX);
+    b.max_ = vec3(-FLT_MAX);
+    return b;
+}
+
+static void growBox(BoundingBox &b, const BoundingBox &other)
+{
+    b.min_ = glm::min(b.min_, other.min_);
+    b.max_ = glm::max(b.max_, other.max_);
+}
+
+// half of the box surface area is enough for the SAH cost comparisons
+static float halfArea(const BoundingBox &b)
+{
+    const vec3 e = glm::max(b.max_ - b.min_, vec3(0.0f));
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+constexpr uint32_t kNumBins = 16;
+// the cost of testing one node box relative to the cost of testing one item box
+constexpr float kTraversalCost = 1.0f;
+
+struct BVHBin
+{
+    BoundingBox box_ = emptyBox();
+    uint32_t count_ = 0;
+};
+
+struct BVHSplit
+{
+    int axis_ = -1;
+    // items with a bin index below this one go to the left child
+    uint32_t bin_ = 0;
+    float cost_ = FLT_MAX;
+};
+
+// Every axis of the centroid bounds is divided into kNumBins bins. Sweeping the bins from both
+// sides gives the box and the item count of every candidate split in linear time
+static BVHSplit findBestSplit(const BVH &bvh, const std::vector<BoundingBox> &boxes, const BVHNode &node, const BoundingBox &centroidBounds)
+{
+    BVHSplit best;
+
+    for (int axis = 0; axis != 3; axis++)
+    {
+        const float minC = centroidBounds.min_[axis];
+        const float extent = centroidBounds.max_[axis] - minC;
+        if (extent <= 0.0f)
+            continue;
+
+        const float scale = kNumBins / extent;
+
+        BVHBin bins[kNumBins];
+        for (uint32_t i = node.firstItem_; i != node.firstItem_ + node.itemCount_; i++)
+        {
+            const BoundingBox &b = boxes[bvh.items_[i]];
+            const uint32_t bin = std::min(kNumBins - 1, (uint32_t)((b.getCenter()[axis] - minC) * scale));
+            bins[bin].count_++;
+            growBox(bins[bin].box_, b);
+        }
+
+        // rightArea[i] and rightCount[i] describe the bins [i + 1, kNumBins)
+        float rightArea[kNumBins - 1];
+        uint32_t rightCount[kNumBins - 1];
+        BoundingBox right = emptyBox();
+        uint32_t count = 0;
+        for (uint32_t i = kNumBins - 1; i > 0; i--)
+        {
+            growBox(right, bins[i].box_);
+            count += bins[i].count_;
+            rightArea[i - 1] = halfArea(right);
+            rightCount[i - 1] = count;
+        }
+
+        BoundingBox left = emptyBox();
+        count = 0;
+        for (uint32_t i = 0; i != kNumBins - 1; i++)
+        {
+            growBox(left, bins[i].box_);
+            count += bins[i].count_;
+
+            if (count == 0 || rightCount[i] == 0)
+                continue;
+
+            const float cost = halfArea(left) * count + rightArea[i] * rightCount[i];
+            if (cost < best.cost_)
+                best = BVHSplit{.axis_ = axis, .bin_ = i + 1, .cost_ = cost};
+        }
+    }
+
+    return best;
+}
+
+void buildBVH(BVH &bvh, const std::vector<BoundingBox> &boxes, uint32_t maxLeafSize)
+{
+    const uint32_t numItems = (uint32_t)boxes.size();
+
+    bvh.nodes_.clear();
+    bvh.items_.resize(numItems);
+    for (uint32_t i = 0; i != numItems; i++)
+        bvh.items_[i] = i;
+
+    if (!numItems)
+    {
+        bvh.parents_.clear();
+        bvh.leafForItem_.clear();
+        bvh.itemBoxes_.resize(0);
+        return;
+    }
+
+    // a binary tree with at least one item per leaf has at most 2N-1 nodes
+    bvh.nodes_.reserve(2 * numItems - 1);
+    bvh.nodes_.push_back(BVHNode{.firstItem_ = 0, .itemCount_ = numItems});
+    bvh.parents_.assign(1, UINT32_MAX);
+
+    // the nodes are split iteratively, so degenerate inputs (long chains of nested boxes) cannot overflow the call stack
+    std::vector<uint32_t> stack = {0};
+
+    while (!stack.empty())
+    {
+        const uint32_t n = stack.back();
+        stack.pop_back();
+
+        BVHNode node = bvh.nodes_[n];
+
+        node.box_ = emptyBox();
+        BoundingBox centroidBounds = emptyBox();
+        for (uint32_t i = node.firstItem_; i != node.firstItem_ + node.itemCount_; i++)
+        {
+            const BoundingBox &b = boxes[bvh.items_[i]];
+            growBox(node.box_, b);
+            centroidBounds.combinePoint(b.getCenter());
+        }
+        bvh.nodes_[n].box_ = node.box_;
+
+        if (node.itemCount_ <= maxLeafSize)
+            continue;
+
+        uint32_t leftCount = 0;
+
+        const BVHSplit split = findBestSplit(bvh, boxes, node, centroidBounds);
+        if (split.axis_ >= 0)
+        {
+            // splitting is not worth it if testing the items directly is cheaper than testing two child boxes first
+            const float leafCost = halfArea(node.box_) * node.itemCount_;
+            const float splitCost = kTraversalCost * halfArea(node.box_) + split.cost_;
+            if (splitCost >= leafCost && node.itemCount_ <= 4 * maxLeafSize)
+                continue;
+
+            const int axis = split.axis_;
+            const float minC = centroidBounds.min_[axis];
+            const float scale = kNumBins / (centroidBounds.max_[axis] - minC);
+
+            auto first = bvh.items_.begin() + node.firstItem_;
+            auto middle = std::partition(first, first + node.itemCount_, [&](uint32_t item)
+                                         { return std::min(kNumBins - 1, (uint32_t)((boxes[item].getCenter()[axis] - minC) * scale)) < split.bin_; });
+            leftCount = (uint32_t)(middle - first);
+        }
+
+        // all the centroids coincide, there is nothing the SAH could separate.
+        // The items are halved anyway to keep the leaves small
+        if (leftCount == 0 || leftCount == node.itemCount_)
+            leftCount = node.itemCount_ / 2;
+
+        const uint32_t left = (uint32_t)bvh.nodes_.size();
+        bvh.nodes_[n].left_ = left;
+
+        bvh.nodes_.push_back(BVHNode{.firstItem_ = node.firstItem_, .itemCount_ = leftCount});
+        bvh.nodes_.push_back(BVHNode{.firstItem_ = node.firstItem_ + leftCount, .itemCount_ = node.itemCount_ - leftCount});
+        bvh.parents_.push_back(n);
+        bvh.parents_.push_back(n);
+
+        stack.push_back(left + 1);
+        stack.push_back(left);
+    }
+
+    bvh.leafForItem_.resize(numItems);
+    for (uint32_t n = 0; n != (uint32_t)bvh.nodes_.size(); n++)
+        if (!bvh.nodes_[n].left_)
+            for (uint32_t i = bvh.nodes_[n].firstItem_; i != bvh.nodes_[n].firstItem_ + bvh.nodes_[n].itemCount_; i++)
+                bvh.leafForItem_[bvh.items_[i]] = n;
+
+    bvh.itemBoxes_.resize(numItems);
+    for (uint32_t i = 0; i != numItems; i++)
+        bvh.itemBoxes_.set(i, boxes[bvh.items_[i]]);
+}
+
+static void refitNode(BVH &bvh, const std::vector<BoundingBox> &boxes, uint32_t n)
+{
+    BVHNode &node = bvh.nodes_[n];
+
+    if (node.left_)
+    {
+        node.box_ = bvh.nodes_[node.left_].box_;
+        growBox(node.box_, bvh.nodes_[node.left_ + 1].box_);
+        return;
+    }
+
+    node.box_ = emptyBox();
+    for (uint32_t i = node.firstItem_; i != node.firstItem_ + node.itemCount_; i++)
+    {
+        growBox(node.box_, boxes[bvh.items_[i]]);
+        bvh.itemBoxes_.set(i, boxes[bvh.items_[i]]);
+    }
+}
+
+void refitBVH(BVH &bvh, const std::vector<BoundingBox> &boxes, const std::vector<uint32_t> &changedItems)
+{
+    if (bvh.nodes_.empty())
+        return;
+
+    // Each changed item costs a walk to the root. Beyond a certain number of items
+    // a single pass over all the nodes is cheaper than the walks with repeated ancestors
+    if (changedItems.empty() || changedItems.size() * 8 > bvh.nodes_.size())
+    {
+        for (uint32_t n = (uint32_t)bvh.nodes_.size(); n-- > 0;)
+            refitNode(bvh, boxes, n);
+        return;
+    }
+
+    for (uint32_t item : changedItems)
+        for (uint32_t n = bvh.leafForItem_[item]; n != UINT32_MAX; n = bvh.parents_[n])
+            refitNode(bvh, boxes, n);
+}
+
+// Classifies the box against the planes whose bits are set in planeMask. The bits of the planes the box
+// is completely inside of are cleared: the children of this box are inside these planes too, so the planes
+// need not be tested again further down the tree. Returns false if the box is completely outside any plane
+static bool classifyBox(const CullingFrustum &frustum, const BoundingBox &box, uint32_t &planeMask)
+{
+    for (int i = 0; i != 6; i++)
+    {
+        if (!(planeMask & (1u << i)))
+            continue;
+
+        const glm::vec4 &p = frustum.planes_[i];
+
+        // the corner furthest along the plane normal, and the opposite one
+        const vec3 pos(p.x >= 0 ? box.max_.x : box.min_.x, p.y >= 0 ? box.max_.y : box.min_.y, p.z >= 0 ? box.max_.z : box.min_.z);
+        const vec3 neg(p.x >= 0 ? box.min_.x : box.max_.x, p.y >= 0 ? box.min_.y : box.max_.y, p.z >= 0 ? box.min_.z : box.max_.z);
+
+        // all the 8 corners are outside, which is the same rejection as in isBoxInFrustum()
+        if (glm::dot(p, glm::vec4(pos, 1.0f)) < 0.0f)
+            return false;
+
+        if (glm::dot(p, glm::vec4(neg, 1.0f)) >= 0.0f)
+            planeMask &= ~(1u << i);
+    }
+
+    return true;
+}
+
+void cullBVH(const BVH &bvh, const CullingFrustum &frustum, std::vector<uint32_t> &visibleItems)
+{
+    visibleItems.clear();
+
+    if (bvh.nodes_.empty())
+        return;
+
+    struct StackEntry
+    {
+        uint32_t node_;
+        uint32_t planeMask_;
+    };
+
+    std::vector<StackEntry> stack;
+    stack.reserve(64);
+    stack.push_back({0, 0x3F});
+
+    while (!stack.empty())
+    {
+        const StackEntry e = stack.back();
+        stack.pop_back();
+
+        const BVHNode &node = bvh.nodes_[e.node_];
+
+        uint32_t planeMask = e.planeMask_;
+        if (!classifyBox(frustum, node.box_, planeMask))
+            continue;
+
+        // completely inside all six planes: everything below is visible
+        if (!planeMask)
+        {
+            visibleItems.insert(visibleItems.end(), bvh.items_.begin() + node.firstItem_, bvh.items_.begin() + node.firstItem_ + node.itemCount_);
+            continue;
+        }
+
+        if (!node.left_)
+        {
+            const uint32_t end = node.firstItem_ + node.itemCount_;
+            for (uint32_t first = node.firstItem_; first < end; first += 32)
+            {
+                uint32_t visible = 0;
+                cullBoxes(frustum, bvh.itemBoxes_, first, std::min(end - first, 32u), &visible);
+                for (; visible; visible &= visible - 1)
+                    visibleItems.push_back(bvh.items_[first + std::countr_zero(visible)]);
+            }
+            continue;
+        }
+
+        stack.push_back({node.left_ + 1, planeMask});
+        stack.push_back({node.left_, planeMask});
+    }
+}
+
+// Rounds the extent up to 1/8 of an octave and snaps the start to the texels of that extent. One texel is added
+// to the extent, which covers the part of [minValue, maxValue] lost by snapping the start down
+static void snapToTexels(float &minValue, float &maxValue, uint32_t shadowMapSize)
+{
+    const float extent = exp2f(ceilf(log2f(std::max(maxValue - minValue, 1e-4f)) * 8.0f) / 8.0f);
+    const float texel = extent / (float)(shadowMapSize - 1);
+
+    minValue = floorf(minValue / texel) * texel;
+    maxValue = minValue + texel * (float)shadowMapSize;
+}
+
+bool findShadowCasters(const BVH &bvh, const glm::mat4 &viewProj, const glm::mat4 &lightView, uint32_t shadowMapSize, BoundingBox &receivers,
+                       std::vector<uint32_t> &candidates)
+{
+    candidates.clear();
+
+    if (bvh.nodes_.empty())
+        return false;
+
+    glm::vec4 corners[8];
+    getFrustumCorners(viewProj, corners);
+
+    BoundingBox frustumBox(vec3(lightView * corners[0]), vec3(lightView * corners[0]));
+    for (int i = 1; i != 8; i++)
+        frustumBox.combinePoint(vec3(lightView * corners[i]));
+
+    const BoundingBox sceneBox = bvh.nodes_[0].box_.getTransformed(lightView);
+
+    // only the receivers visible to the camera need to be covered by the shadow map
+    const vec3 receiversMin = glm::max(frustumBox.min_, sceneBox.min_);
+    const vec3 receiversMax = glm::min(frustumBox.max_, sceneBox.max_);
+
+    if (receiversMin.x > receiversMax.x || receiversMin.y > receiversMax.y || receiversMin.z > receiversMax.z)
+        return false;
+
+    receivers = BoundingBox(receiversMin, receiversMax);
+
+    snapToTexels(receivers.min_.x, receivers.max_.x, shadowMapSize);
+    snapToTexels(receivers.min_.y, receivers.max_.y, shadowMapSize);
+
+    // the caster volume extends from the lowest visible receiver up to the top of the scene
+    const glm::mat4 casterProj = glm::ortho(receivers.min_.x, receivers.max_.x, receivers.min_.y, receivers.max_.y, -sceneBox.max_.z, -receivers.min_.z);
+
+    cullBVH(bvh, getCullingFrustum(casterProj * lightView), candidates);
+
+    return true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Utils/UtilsMath.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+// A bounding volume hierarchy over a list of world-space boxes (in our case, one box per renderable shape).
+// It replaces the linear isBoxInFrustum() loop over all shapes: subtrees outside the frustum are rejected
+// with a single test, and subtrees entirely inside it are accepted without looking at their boxes.
+//
+// The tree is built top-down with a binned surface area heuristic (SAH), see "On fast Construction of
+// SAH-based Bounding Volume Hierarchies" by Ingo Wald, 2007. Moving shapes only refit the boxes of their
+// ancestors, the topology is kept. After large movements the tree becomes loose (it is still correct)
+// and should be rebuilt.
+
+struct BVHNode
+{
+    BoundingBox box_;
+    // Index of the left child, the right child is always stored next to it. Zero means a leaf: the root
+    // is node 0 and it is never anybody's child
+    uint32_t left_ = 0;
+    // The build partitions the item list in place, so the items of any subtree form a contiguous range of BVH::items_
+    uint32_t firstItem_ = 0;
+    uint32_t itemCount_ = 0;
+};
+
+struct BVH
+{
+    // children are always stored after their parents, so a reverse pass over this array is a bottom-up traversal
+    std::vector<BVHNode> nodes_;
+    std::vector<uint32_t> items_;
+    // the boxes of items_, in the same order: the items of a leaf are adjacent, so cullBoxes() tests them 4 at a time
+    BoundingBoxesSoA itemBoxes_;
+
+    // used by the partial refit to walk from a changed item up to the root
+    std::vector<uint32_t> parents_;
+    std::vector<uint32_t> leafForItem_;
+};
+
+void buildBVH(BVH &bvh, const std::vector<BoundingBox> &boxes, uint32_t maxLeafSize = 4);
+
+// Updates the boxes of the leaves containing changedItems (and itemBoxes_) and of all their ancestors.
+// An empty list (or a long one) refits the whole tree in a single bottom-up pass
+void refitBVH(BVH &bvh, const std::vector<BoundingBox> &boxes, const std::vector<uint32_t> &changedItems = {});
+
+// Collects the items visible in the frustum. The result is exactly the set of items for which isBoxInFrustum()
+// returns true: interior nodes are only used to reject or accept whole subtrees, and the items of partially
+// visible leaves are tested with cullBoxes(). The item boxes are the ones of the last build or refit
+void cullBVH(const BVH &bvh, const CullingFrustum &frustum, std::vector<uint32_t> &visibleItems);
+
+// Shadow caster culling for a directional light. Everything happens in light space, where the light looks down the -Z axis.
+// A point shadows everything below it, so an item can only cast a shadow into the camera view if its light-space box
+// overlaps the visible receivers in XY and is not entirely below them in Z.
+//
+// receivers gets the light-space box of the visible part of the scene. Its XY extent is snapped to the texel grid
+// of a shadowMapSize x shadowMapSize shadow map: the size only changes in steps of 1/8 octave and the corner moves
+// by whole texels, so the shadow map texels stay fixed in the world while the camera moves and the shadow edges
+// do not shimmer. candidates gets the items inside the caster volume, i.e. the receivers box extended up to the top
+// of the scene. Returns false (and no candidates) if the camera does not see the scene at all
+bool findShadowCasters(const BVH &bvh, const glm::mat4 &viewProj, const glm::mat4 &lightView, uint32_t shadowMapSize, BoundingBox &receivers,
+                       std::vector<uint32_t> &candidates);
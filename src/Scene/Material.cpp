@@ -1,127 +1,207 @@
 #include "Material.h"
 
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+#include <execution>
+#include <numeric>
 #include <unordered_map>
-#include "Utils/Utils.h"
 
-void saveStringList(FILE *f, const std::vector<std::string> &lines)
-{
-    uint32_t sz = (uint32_t)lines.size();
-    fwrite(&sz, sizeof(uint32_t), 1, f);
-    for (const auto &s : lines)
-    {
-        sz = (uint32_t)s.length();
-        fwrite(&sz, sizeof(uint32_t), 1, f);
-        fwrite(s.c_str(), sz + 1, 1, f);
-    }
-}
+#include "Utils/Utils.h"
+#include "Utils/UtilsChunkFile.h"
+#include "Utils/UtilsHash.h"
+#include "Utils/UtilsMappedFile.h"
 
-void loadStringList(FILE *f, std::vector<std::string> &lines)
-{
-    {
-        uint32_t sz = 0;
-        fread(&sz, sizeof(uint32_t), 1, f);
-        lines.resize(sz);
-    }
-    std::vector<char> inBytes;
-    for (auto &s : lines)
-    {
-        uint32_t sz = 0;
-        fread(&sz, sizeof(uint32_t), 1, f);
-        inBytes.resize(sz + 1);
-        fread(inBytes.data(), sz + 1, 1, f);
-        s = std::string(inBytes.data());
-    }
-}
+// The .materials file is a chunk file (see UtilsChunkFile.h) with the following chunks
+constexpr uint32_t kMaterialFileType = makeFourCC('M', 'A', 'T', 'L');
+constexpr uint32_t kMaterialChunk_Descriptions = makeFourCC('M', 'T', 'R', 'L');
+constexpr uint32_t kMaterialChunk_TextureFiles = makeFourCC('T', 'E', 'X', 'F');
 
 // saves the converted material data in files
 void saveMaterials(const char *fileName, const std::vector<MaterialDescription> &materials, const std::vector<std::string> &files)
 {
-    FILE *f = fopen(fileName, "wb");
-    if (!f)
+    ChunkFileWriter writer;
+    if (!beginChunkFile(writer, fileName, kMaterialFileType))
         return;
 
-    uint32_t sz = (uint32_t)materials.size();
-    fwrite(&sz, 1, sizeof(uint32_t), f);
-    fwrite(materials.data(), sizeof(MaterialDescription), sz, f);
-    // appends a list of strings to an opened binary file
-    saveStringList(f, files);
-    fclose(f);
+    writeChunk(writer, kMaterialChunk_Descriptions, materials, kChunkAlignment_Small);
+    // the texture file names are stored as a packed list of strings
+    writeChunk(writer, kMaterialChunk_TextureFiles, packStringList(files), kChunkAlignment_Small);
+
+    if (!endChunkFile(writer))
+        printf("Error writing material file %s\n", fileName);
 }
 
 // reads a list of materials from file.
 void loadMaterials(const char *fileName, std::vector<MaterialDescription> &materials, std::vector<std::string> &files)
 {
-    FILE *f = fopen(fileName, "rb");
-    if (!f)
+    ChunkFile file;
+    if (!openChunkFile(fileName, kMaterialFileType, file))
     {
         printf("Cannot load file %s\nPlease run SceneConverter tool from Chapter7\n", fileName);
         exit(255);
     }
 
-    uint32_t sz;
-    fread(&sz, 1, sizeof(uint32_t), f);
-    materials.resize(sz);
-    fread(materials.data(), sizeof(MaterialDescription), materials.size(), f);
+    readChunk(file, kMaterialChunk_Descriptions, materials);
     // loads the texture file names into the files container
-    loadStringList(f, files);
-    fclose(f);
+    unpackStringList(getChunkData<uint8_t>(file, kMaterialChunk_TextureFiles), files);
+
+    closeChunkFile(file);
+}
+
+// Groups texture files with identical contents. Returns, for every file, the index of the first file with
+// the same contents. Files which cannot be read are only equal to themselves
+static std::vector<uint32_t> findDuplicateTextureFiles(const std::vector<std::string> &files)
+{
+    // the files are hashed in parallel, texture files are large enough for this to pay off
+    std::vector<uint64_t> hashes(files.size(), 0);
+    std::vector<uint64_t> sizes(files.size(), 0);
+    std::vector<uint32_t> idx(files.size());
+    std::iota(idx.begin(), idx.end(), 0);
+
+    std::for_each(std::execution::par, idx.begin(), idx.end(), [&](uint32_t i)
+                  {
+                      MappedFile f;
+                      if (!mapFile(files[i].c_str(), f, true))
+                          return;
+                      hashes[i] = xxHash64(f.data_, f.size_);
+                      sizes[i] = f.size_;
+                      unmapFile(f); });
+
+    auto sameContents = [&files](uint32_t a, uint32_t b)
+    {
+        MappedFile fa, fb;
+        const bool same = mapFile(files[a].c_str(), fa) && mapFile(files[b].c_str(), fb) &&
+                          fa.size_ == fb.size_ && !memcmp(fa.data_, fb.data_, fa.size_);
+        unmapFile(fa);
+        unmapFile(fb);
+        return same;
+    };
+
+    std::vector<uint32_t> firstCopy(files.size());
+    std::unordered_map<uint64_t, uint32_t> firstWithHash;
+
+    for (uint32_t i = 0; i != files.size(); i++)
+    {
+        firstCopy[i] = i;
+
+        if (!sizes[i])
+            continue;
+
+        // the hash is only a hint, a (very unlikely) collision is caught by comparing the contents
+        const auto [it, inserted] = firstWithHash.try_emplace(hashes[i] ^ sizes[i], i);
+        if (!inserted && sizes[it->second] == sizes[i] && sameContents(it->second, i))
+            firstCopy[i] = it->second;
+    }
+
+    return firstCopy;
 }
 
 // creates a single texture filenames list and a material description list with correct texture indices:
+// Every texture list is converted into a local-to-global index table once, so the whole merge is linear
+// in the number of materials and textures
 void mergeMaterialLists(
     const std::vector<std::vector<MaterialDescription> *> &oldMaterials,
     const std::vector<std::vector<std::string> *> &oldTextures,
     std::vector<MaterialDescription> &allMaterials,
-    std::vector<std::string> &newTextures)
+    std::vector<std::string> &newTextures,
+    const MaterialMergeOptions &options,
+    std::vector<uint32_t> *materialRemap)
 {
-    // map texture names to indices in newTexturesList (calculated as we fill the newTexturesList)
-    std::unordered_map<std::string, int> newTextureNames;
-    std::unordered_map<int, int> materialToTextureList; // direct MaterialDescription usage as a key is impossible, so we use its index in the allMaterials array
+    assert(oldMaterials.size() == oldTextures.size());
+    // without the remap table the caller could not fix the material indices in the scene
+    assert(materialRemap || !options.deduplicateMaterials);
+
+    // 1) Unique file names. Each name is hashed once instead of being searched for in the whole list
+    std::vector<std::string> uniqueFiles;
+    std::unordered_map<std::string, uint32_t> fileIndex;
+    std::vector<std::vector<uint32_t>> localToUnique(oldTextures.size());
 
-    // Create combined material list [no hashing of materials, just straightforward merging of all lists]
-    int midx = 0;
-    for (const std::vector<MaterialDescription> *ml : oldMaterials)
+    for (size_t l = 0; l != oldTextures.size(); l++)
     {
-        for (const MaterialDescription &m : *ml)
+        localToUnique[l].reserve(oldTextures[l]->size());
+        for (const std::string &file : *oldTextures[l])
         {
-            allMaterials.push_back(m);
-            materialToTextureList[allMaterials.size() - 1] = midx;
+            const auto [it, inserted] = fileIndex.try_emplace(file, (uint32_t)uniqueFiles.size());
+            if (inserted)
+                uniqueFiles.push_back(file);
+            localToUnique[l].push_back(it->second);
         }
-
-        midx++;
     }
 
-    // Create one combined texture list
-    // The newTextures global texture array contains only unique filenames. Indices of
-    // texture files are stored in a map to fix the values in material descriptors below them:
-    for (const std::vector<std::string> *tl : oldTextures)
-        for (const std::string &file : *tl)
+    // 2) Unique file contents (optional). Only the first of the identical files is kept
+    std::vector<uint32_t> uniqueToNew(uniqueFiles.size());
+    {
+        const std::vector<uint32_t> firstCopy = options.deduplicateTextureContents ? findDuplicateTextureFiles(uniqueFiles) : std::vector<uint32_t>();
+
+        newTextures.clear();
+        for (uint32_t i = 0; i != uniqueFiles.size(); i++)
         {
-            newTextureNames[file] = addUnique(newTextures, file); // addUnique() is in SceneConverter/MaterialConv.inl
+            if (!firstCopy.empty() && firstCopy[i] != i)
+            {
+                // the first copy always comes first, so it already has its new index
+                uniqueToNew[i] = uniqueToNew[firstCopy[i]];
+                continue;
+            }
+            uniqueToNew[i] = (uint32_t)newTextures.size();
+            newTextures.push_back(uniqueFiles[i]);
         }
+    }
+
+    // 3) Combined material list with the texture indices replaced by the global ones
+    // (the descriptor is packed, so its fields cannot be bound to references)
+    auto replaceTexture = [](const std::vector<uint32_t> &localToGlobal, uint64_t textureID)
+    {
+        return (textureID < INVALID_TEXTURE) ? (uint64_t)localToGlobal[textureID] : textureID;
+    };
 
-    // Lambda to replace textureID by a new "version" (from global list)
-    // The replaceTexture() lambda takes a texture index from a local texture array
-    // and assigns a global texture index from the newTextures array:
-    auto replaceTexture = [&materialToTextureList, &oldTextures, &newTextureNames](int m, uint64_t *textureID)
+    std::vector<MaterialDescription> merged;
+    for (size_t l = 0; l != oldMaterials.size(); l++)
     {
-        if (*textureID < INVALID_TEXTURE)
+        std::vector<uint32_t> localToGlobal(localToUnique[l].size());
+        for (size_t t = 0; t != localToGlobal.size(); t++)
+            localToGlobal[t] = uniqueToNew[localToUnique[l][t]];
+
+        for (MaterialDescription m : *oldMaterials[l])
         {
-            auto listIdx = materialToTextureList[m];
-            auto texList = oldTextures[listIdx];
-            const std::string &texFile = (*texList)[*textureID];
-            *textureID = (uint64_t)(newTextureNames[texFile]);
+            m.ambientOcclusionMap_ = replaceTexture(localToGlobal, m.ambientOcclusionMap_);
+            m.emissiveMap_ = replaceTexture(localToGlobal, m.emissiveMap_);
+            m.albedoMap_ = replaceTexture(localToGlobal, m.albedoMap_);
+            m.metallicRoughnessMap_ = replaceTexture(localToGlobal, m.metallicRoughnessMap_);
+            m.normalMap_ = replaceTexture(localToGlobal, m.normalMap_);
+            merged.push_back(m);
         }
-    };
+    }
+
+    // 4) Bitwise-equal materials (optional). Material descriptors are packed, so comparing the bytes is exact
+    if (materialRemap)
+    {
+        materialRemap->resize(merged.size());
+        std::iota(materialRemap->begin(), materialRemap->end(), 0);
+    }
 
-    // The final loop goes over all materials and adjusts the texture indices accordingly:
-    for (size_t i = 0; i < allMaterials.size(); i++)
+    if (!options.deduplicateMaterials)
     {
-        auto &m = allMaterials[i];
-        replaceTexture(i, &m.ambientOcclusionMap_);
-        replaceTexture(i, &m.emissiveMap_);
-        replaceTexture(i, &m.albedoMap_);
-        replaceTexture(i, &m.metallicRoughnessMap_);
-        replaceTexture(i, &m.normalMap_);
+        allMaterials = std::move(merged);
+        return;
+    }
+
+    allMaterials.clear();
+    std::unordered_map<uint64_t, uint32_t> firstWithHash;
+
+    for (uint32_t i = 0; i != merged.size(); i++)
+    {
+        const uint64_t hash = xxHash64(&merged[i], sizeof(MaterialDescription));
+        const auto [it, inserted] = firstWithHash.try_emplace(hash, (uint32_t)allMaterials.size());
+
+        if (!inserted && !memcmp(&allMaterials[it->second], &merged[i], sizeof(MaterialDescription)))
+        {
+            (*materialRemap)[i] = it->second;
+            continue;
+        }
+
+        (*materialRemap)[i] = (uint32_t)allMaterials.size();
+        allMaterials.push_back(merged[i]);
     }
 }
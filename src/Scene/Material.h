@@ -47,12 +47,23 @@ static_assert(sizeof(MaterialDescription) % 16 == 0, "MaterialDescription should
 void saveMaterials(const char *fileName, const std::vector<MaterialDescription> &materials, const std::vector<std::string> &files);
 void loadMaterials(const char *fileName, std::vector<MaterialDescription> &materials, std::vector<std::string> &files);
 
-// Merge material lists from multiple scenes (follows the logic of merging in mergeScenes)
+struct MaterialMergeOptions
+{
+    // merge the materials which are bitwise equal once their texture indices are remapped
+    bool deduplicateMaterials = false;
+    // merge the texture files with identical contents, not just identical paths
+    bool deduplicateTextureContents = false;
+};
+
+// Merge material lists from multiple scenes (follows the logic of merging in mergeScenes). Both outputs are overwritten.
+// materialRemap receives the new index of every input material (the input lists are concatenated);
+// it is required for deduplicateMaterials to fix the material indices of the scene nodes (see remapSceneMaterials())
 void mergeMaterialLists(
     // Input:
     const std::vector<std::vector<MaterialDescription> *> &oldMaterials, // all materials
     const std::vector<std::vector<std::string> *> &oldTextures,          // all textures from all material lists
     // Output:
     std::vector<MaterialDescription> &allMaterials,
-    std::vector<std::string> &newTextures // all textures (merged from oldTextures, only unique items)
-);
+    std::vector<std::string> &newTextures, // all textures (merged from oldTextures, only unique items)
+    const MaterialMergeOptions &options = {},
+    std::vector<uint32_t> *materialRemap = nullptr);
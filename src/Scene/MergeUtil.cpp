@@ -1,8 +1,11 @@
 #include "Material.h"
 #include "MergeUtil.h"
 
+#include <assert.h>
+#include <math.h>
+
 #include <algorithm>
-#include <map>
+#include <tuple>
 
 // calculating the number of merged indices. We remember the starting vertex offset for all of the
 // meshes. The loop shifts all the indices in individual mesh blocks of the meshData.
@@ -41,8 +44,10 @@ static uint32_t shiftMeshIndices(MeshData &meshData, const std::vector<uint32_t>
 // copies indices for each mesh into the newIndices array:
 // All the meshesToMerge now have the same vertexOffset and individual index values are shifted by appropriate amount
 // Here we move all the indices to appropriate places in the new index array
-static void mergeIndexArray(MeshData &md, const std::vector<uint32_t> &meshesToMerge, std::map<uint32_t, uint32_t> &oldToNew)
+static void mergeIndexArray(MeshData &md, const std::vector<uint32_t> &meshesToMerge, std::vector<uint32_t> &oldToNew)
 {
+    oldToNew.resize(md.meshes_.size());
+
     std::vector<uint32_t> newIndices(md.indexData_.size());
     // Two offsets in the new indices array (one begins at the start, the second one after all the copied indices)
     uint32_t copyOffset = 0,
@@ -126,7 +131,7 @@ void mergeScene(Scene &scene, MeshData &meshData, const std::string &materialNam
 
     // old-to-new mesh indices
     // merges index data and assigns changed mesh indices to scene nodes
-    std::map<uint32_t, uint32_t> oldToNew;
+    std::vector<uint32_t> oldToNew;
 
     // now move all the meshesToMerge to the end of array
     mergeIndexArray(meshData, meshesToMerge, oldToNew);
@@ -135,8 +140,9 @@ void mergeScene(Scene &scene, MeshData &meshData, const std::string &materialNam
     // cut out all the merged meshes and attach a new node containing the merged meshes to the scene graph:
     eraseSelected(meshData.meshes_, meshesToMerge);
 
-    for (auto &n : scene.meshes_)
-        n.second = oldToNew[n.second];
+    // only the values change, so the items can be modified in place
+    for (auto &n : scene.meshes_.items_)
+        n.value_ = oldToNew[n.value_];
 
     // reattach the node with merged meshes [identity transforms are assumed]
     int newNode = addNode(scene, 0, 1);
@@ -145,3 +151,333 @@ void mergeScene(Scene &scene, MeshData &meshData, const std::string &materialNam
 
     deleteSceneNodes(scene, toDelete);
 }
+
+void remapSceneMaterials(Scene &scene, const std::vector<uint32_t> &materialRemap)
+{
+    for (auto &item : scene.materialForNode_.items_)
+        if (item.value_ < materialRemap.size())
+            item.value_ = materialRemap[item.value_];
+
+    if (materialRemap.empty() || scene.materialNames_.size() != materialRemap.size())
+        return;
+
+    std::vector<std::string> names(*std::max_element(materialRemap.begin(), materialRemap.end()) + 1);
+    for (size_t i = materialRemap.size(); i-- > 0;)
+        names[materialRemap[i]] = scene.materialNames_[i];
+
+    scene.materialNames_ = std::move(names);
+}
+
+/* Static batching */
+
+// The only vertex layout produced by SceneConverter: pos(vec3) + uv(vec2) + normal(vec3) in a single stream
+constexpr uint32_t kBatchVertexFloats = 8;
+
+struct BatchItem
+{
+    uint32_t node;
+    uint32_t mesh;
+    uint32_t material;
+    int cell[3];
+    BoundingBox box;
+    uint32_t triangles;
+};
+
+// Global transforms are recalculated here because the ones stored in a scene file are not necessarily up to date.
+// addNode() always creates the parents before their children, so a single linear pass is enough
+static std::vector<glm::mat4> calculateGlobalTransforms(const Scene &scene)
+{
+    std::vector<glm::mat4> global(scene.localTransform_.size());
+
+    for (size_t i = 0; i != global.size(); i++)
+    {
+        const int p = scene.hierarchy_[i].parent_;
+        assert(p < (int)i);
+        global[i] = (p > -1) ? mulMat4(global[p], scene.localTransform_[i]) : scene.localTransform_[i];
+    }
+
+    return global;
+}
+
+// Appends a new mesh with all the vertices of the batch pre-transformed into world space.
+// LOD level l of the batch is the concatenation of the LOD level l (or the coarsest available one) of all the
+// source meshes, so all the LOD levels are preserved without running the simplifier again
+static uint32_t buildBatchMesh(MeshData &md, const std::vector<BatchItem> &batch, const std::vector<glm::mat4> &global)
+{
+    uint32_t lodCount = 1;
+    for (const auto &item : batch)
+        lodCount = std::max(lodCount, md.meshes_[item.mesh].lodCount);
+
+    std::vector<float> vertices;
+    std::vector<std::vector<uint32_t>> lods(lodCount);
+    // the error of a batch LOD is the largest error of its parts, scaled by their transforms
+    float lodErrors[kMaxLODs] = {0};
+
+    for (const auto &item : batch)
+    {
+        const Mesh &src = md.meshes_[item.mesh];
+        const glm::mat4 &m = global[item.node];
+        // normals are transformed by the inverse transpose to stay perpendicular to non-uniformly scaled surfaces
+        const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(m)));
+        // a mirroring transform turns the triangles inside out, so their winding has to be flipped
+        const bool flipWinding = glm::determinant(glm::mat3(m)) < 0.0f;
+        const float maxScale = std::max({glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))});
+
+        const uint32_t baseVertex = (uint32_t)(vertices.size() / kBatchVertexFloats);
+
+        for (uint32_t v = 0; v != src.vertexCount; v++)
+        {
+            const float *vf = &md.vertexData_[((size_t)src.vertexOffset + v) * kBatchVertexFloats];
+
+            const glm::vec4 p = m * glm::vec4(vf[0], vf[1], vf[2], 1.0f);
+            const glm::vec3 n = glm::normalize(normalMatrix * glm::vec3(vf[5], vf[6], vf[7]));
+
+            vertices.insert(vertices.end(), {p.x, p.y, p.z, vf[3], vf[4], n.x, n.y, n.z});
+        }
+
+        for (uint32_t l = 0; l != lodCount; l++)
+        {
+            const uint32_t srcLod = std::min(l, src.lodCount - 1);
+            const uint32_t *idx = &md.indexData_[src.indexOffset + src.lodOffset[srcLod]];
+            const uint32_t count = src.getLODIndicesCount(srcLod);
+
+            lodErrors[l] = std::max(lodErrors[l], src.lodError[srcLod] * maxScale);
+
+            auto &out = lods[l];
+            for (uint32_t i = 0; i + 2 < count; i += 3)
+            {
+                out.push_back(baseVertex + idx[i + 0]);
+                out.push_back(baseVertex + idx[i + (flipWinding ? 2 : 1)]);
+                out.push_back(baseVertex + idx[i + (flipWinding ? 1 : 2)]);
+            }
+        }
+    }
+
+    const uint32_t elementSize = kBatchVertexFloats * sizeof(float);
+
+    Mesh result = {
+        .lodCount = lodCount,
+        .streamCount = 1,
+        .indexOffset = (uint32_t)md.indexData_.size(),
+        .vertexOffset = (uint32_t)(md.vertexData_.size() / kBatchVertexFloats),
+        .vertexCount = (uint32_t)(vertices.size() / kBatchVertexFloats),
+        .streamOffset = {(uint32_t)(md.vertexData_.size() / kBatchVertexFloats) * elementSize},
+        .streamElementSize = {elementSize}};
+
+    uint32_t numIndices = 0;
+    for (uint32_t l = 0; l != lodCount; l++)
+    {
+        result.lodOffset[l] = numIndices;
+        result.lodError[l] = lodErrors[l];
+        md.indexData_.insert(md.indexData_.end(), lods[l].begin(), lods[l].end());
+        numIndices += (uint32_t)lods[l].size();
+    }
+    result.lodOffset[lodCount] = numIndices;
+
+    md.vertexData_.insert(md.vertexData_.end(), vertices.begin(), vertices.end());
+
+    BoundingBox box = batch[0].box;
+    for (const auto &item : batch)
+        box.combinePoint(item.box.min_), box.combinePoint(item.box.max_);
+
+    md.meshes_.push_back(result);
+    md.boxes_.push_back(box);
+
+    return (uint32_t)md.meshes_.size() - 1;
+}
+
+// Drops all the meshes which are not referenced by the scene anymore along with their index and vertex data.
+// The vertex range of a mesh is derived from its indices, so meshes sharing vertices (see shiftMeshIndices()) are handled as well
+static void removeUnusedMeshes(Scene &scene, MeshData &md)
+{
+    const size_t meshCount = md.meshes_.size();
+
+    std::vector<bool> used(meshCount, false);
+    for (const auto &item : scene.meshes_)
+        used[item.value_] = true;
+
+    std::vector<uint32_t> oldToNew(meshCount, 0);
+
+    MeshData out;
+    out.meshes_.reserve(meshCount);
+
+    for (size_t i = 0; i != meshCount; i++)
+    {
+        if (!used[i])
+            continue;
+
+        Mesh mesh = md.meshes_[i];
+        const uint32_t numIndices = mesh.lodOffset[mesh.lodCount];
+        const auto indices = md.indexData_.begin() + mesh.indexOffset;
+
+        uint32_t numVertices = 0;
+        for (uint32_t j = 0; j != numIndices; j++)
+            numVertices = std::max(numVertices, indices[j] + 1);
+
+        const uint32_t elementSize = mesh.streamElementSize[0];
+        const size_t floatsPerVertex = elementSize / sizeof(float);
+        const auto vertices = md.vertexData_.begin() + (size_t)mesh.vertexOffset * floatsPerVertex;
+
+        mesh.indexOffset = (uint32_t)out.indexData_.size();
+        mesh.vertexOffset = (uint32_t)(out.vertexData_.size() / floatsPerVertex);
+        mesh.vertexCount = numVertices;
+        mesh.streamOffset[0] = mesh.vertexOffset * elementSize;
+
+        out.indexData_.insert(out.indexData_.end(), indices, indices + numIndices);
+        out.vertexData_.insert(out.vertexData_.end(), vertices, vertices + numVertices * floatsPerVertex);
+
+        oldToNew[i] = (uint32_t)out.meshes_.size();
+        out.meshes_.push_back(mesh);
+        out.boxes_.push_back(md.boxes_[i]);
+    }
+
+    md = std::move(out);
+
+    for (auto &item : scene.meshes_.items_)
+        item.value_ = oldToNew[item.value_];
+}
+
+uint32_t batchStaticMeshes(Scene &scene, MeshData &meshData, const StaticBatchingConfig &cfg)
+{
+    const size_t nodeCount = scene.hierarchy_.size();
+    if (!nodeCount)
+        return 0;
+
+    if (meshData.boxes_.size() != meshData.meshes_.size())
+        recalculateBoundingBoxes(meshData);
+
+    const std::vector<glm::mat4> global = calculateGlobalTransforms(scene);
+
+    // 1) A dynamic node makes its whole subtree dynamic
+    std::vector<bool> dynamic(nodeCount, false);
+    for (uint32_t n : cfg.dynamicNodes)
+        if (n < nodeCount)
+            dynamic[n] = true;
+    for (size_t i = 0; i != nodeCount; i++)
+        if (scene.hierarchy_[i].parent_ > -1 && dynamic[scene.hierarchy_[i].parent_])
+            dynamic[i] = true;
+
+    // 2) Collect the candidates. Only leaf nodes are batched: a node with children stays in the hierarchy anyway,
+    // as it carries the transform of its subtree
+    std::vector<BatchItem> items;
+
+    for (const auto &m : scene.meshes_)
+    {
+        const uint32_t node = m.node_;
+        const NodeMapItem *material = scene.materialForNode_.find(node);
+        const Mesh &mesh = meshData.meshes_[m.value_];
+
+        if (!material || dynamic[node] || node == 0 || scene.hierarchy_[node].firstChild_ != -1 ||
+            mesh.streamCount != 1 || mesh.streamElementSize[0] != kBatchVertexFloats * sizeof(float))
+            continue;
+
+        BoundingBox box = meshData.boxes_[m.value_];
+        box.transform(global[node]);
+        const glm::vec3 c = box.getCenter();
+
+        items.push_back(BatchItem{
+            .node = node,
+            .mesh = m.value_,
+            .material = material->value_,
+            .cell = {(int)floorf(c.x / cfg.cellSize), (int)floorf(c.y / cfg.cellSize), (int)floorf(c.z / cfg.cellSize)},
+            .box = box,
+            .triangles = mesh.getLODIndicesCount(0) / 3});
+    }
+
+    // 3) Group the candidates by material and cell. The node index makes the order (and the output) deterministic
+    auto groupKey = [](const BatchItem &i)
+    { return std::tuple(i.material, i.cell[0], i.cell[1], i.cell[2]); };
+
+    std::sort(items.begin(), items.end(), [&groupKey](const BatchItem &a, const BatchItem &b)
+              { return std::tuple_cat(groupKey(a), std::tuple(a.node)) < std::tuple_cat(groupKey(b), std::tuple(b.node)); });
+
+    std::vector<uint32_t> batchedNodes;
+    std::vector<std::pair<uint32_t, uint32_t>> newMeshes; // {mesh, material}
+
+    auto flushBatch = [&](std::vector<BatchItem> &batch)
+    {
+        if (batch.size() >= std::max(cfg.minMeshes, 2u))
+        {
+            newMeshes.emplace_back(buildBatchMesh(meshData, batch, global), batch[0].material);
+            for (const auto &item : batch)
+                batchedNodes.push_back(item.node);
+        }
+        batch.clear();
+    };
+
+    std::vector<BatchItem> batch;
+
+    for (auto groupBegin = items.begin(); groupBegin != items.end();)
+    {
+        const auto groupEnd = std::find_if(groupBegin, items.end(), [&](const BatchItem &i)
+                                           { return groupKey(i) != groupKey(*groupBegin); });
+
+        // 4) Split the group to the budgets. Sweeping along the longest axis of the group keeps the batches compact
+        BoundingBox groupBox = groupBegin->box;
+        for (auto i = groupBegin; i != groupEnd; i++)
+            groupBox.combinePoint(i->box.min_), groupBox.combinePoint(i->box.max_);
+
+        const glm::vec3 size = groupBox.getSize();
+        const int axis = (size.x > size.y && size.x > size.z) ? 0 : (size.y > size.z ? 1 : 2);
+
+        std::stable_sort(groupBegin, groupEnd, [axis](const BatchItem &a, const BatchItem &b)
+                         { return a.box.getCenter()[axis] < b.box.getCenter()[axis]; });
+
+        uint32_t triangles = 0;
+        BoundingBox batchBox;
+
+        for (auto i = groupBegin; i != groupEnd; i++)
+        {
+            if (!batch.empty())
+            {
+                BoundingBox box = batchBox;
+                box.combinePoint(i->box.min_), box.combinePoint(i->box.max_);
+                const glm::vec3 extent = box.getSize();
+
+                const bool overBudget = (triangles + i->triangles > cfg.maxTriangles) ||
+                                        (cfg.maxExtent > 0.0f && std::max({extent.x, extent.y, extent.z}) > cfg.maxExtent);
+                if (overBudget)
+                    flushBatch(batch);
+            }
+
+            if (batch.empty())
+            {
+                triangles = 0;
+                batchBox = i->box;
+            }
+
+            batch.push_back(*i);
+            triangles += i->triangles;
+            batchBox.combinePoint(i->box.min_), batchBox.combinePoint(i->box.max_);
+        }
+
+        flushBatch(batch);
+        groupBegin = groupEnd;
+    }
+
+    if (newMeshes.empty())
+        return 0;
+
+    // 5) Attach the batches to the root. The vertices are in world space already, so the local transform
+    // of a batch node cancels out the transform of the root
+    const glm::mat4 rootInverse = glm::inverse(global[0]);
+
+    for (const auto &[mesh, material] : newMeshes)
+    {
+        const int node = addNode(scene, 0, 1);
+        scene.localTransform_[node] = rootInverse;
+        scene.meshes_[node] = mesh;
+        scene.materialForNode_[node] = material;
+
+        const std::string materialName = (material < scene.materialNames_.size()) ? scene.materialNames_[material] : std::to_string(material);
+        setNodeName(scene, node, "StaticBatch_" + materialName);
+    }
+
+    // 6) Remove the source nodes (they are leaves, so no other nodes go with them) and the meshes nobody uses anymore
+    std::sort(batchedNodes.begin(), batchedNodes.end());
+    deleteSceneNodes(scene, batchedNodes);
+
+    removeUnusedMeshes(scene, meshData);
+
+    return (uint32_t)newMeshes.size();
+}
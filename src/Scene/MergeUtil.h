@@ -4,3 +4,27 @@
 #include "VtxData.h"
 
 void mergeScene(Scene &scene, MeshData &meshData, const std::string &materialName);
+
+// Applies the materialRemap table of mergeMaterialLists() to the material indices of the scene nodes
+// and to the debug material names (a merged material keeps the name of its first copy)
+void remapSceneMaterials(Scene &scene, const std::vector<uint32_t> &materialRemap);
+
+struct StaticBatchingConfig
+{
+    // Nodes are grouped by material and by the cell of a uniform grid containing their bounding box center.
+    // A batch never spans several cells, so the batches are still small enough to be culled individually
+    float cellSize = 25.0f;
+    // A batch is closed once it exceeds any of these budgets. Zero maxExtent disables the size check
+    uint32_t maxTriangles = 65536;
+    float maxExtent = 0.0f;
+    // smaller groups are left as is
+    uint32_t minMeshes = 2;
+    // nodes (along with their subtrees) which are moved at runtime and must not be batched
+    std::vector<uint32_t> dynamicNodes;
+};
+
+// A general version of mergeScene(): all static mesh nodes with the same material in the same grid cell
+// are merged into a single mesh. The node global transforms are baked into vertex positions and normals,
+// and every LOD level of the source meshes is carried over to the merged mesh.
+// Returns the number of created batches
+uint32_t batchStaticMeshes(Scene &scene, MeshData &meshData, const StaticBatchingConfig &cfg = {});
@@ -1,11 +1,86 @@
 #include "Scene.h"
 #include "Utils/Utils.h"
+#include "Utils/UtilsChunkFile.h"
+#include "Utils/UtilsHash.h"
+#include "Utils/UtilsMath.h"
 
 #include <algorithm>
 #include <numeric>
 
-void saveStringList(FILE *f, const std::vector<std::string> &lines);
-void loadStringList(FILE *f, std::vector<std::string> &lines);
+#include <taskflow/taskflow.hpp>
+
+// The .scene file is a chunk file (see UtilsChunkFile.h) with the following chunks
+constexpr uint32_t kSceneFileType = makeFourCC('S', 'C', 'N', 'E');
+constexpr uint32_t kSceneChunk_LocalTransforms = makeFourCC('L', 'X', 'F', 'M');
+constexpr uint32_t kSceneChunk_GlobalTransforms = makeFourCC('G', 'X', 'F', 'M');
+constexpr uint32_t kSceneChunk_Hierarchy = makeFourCC('H', 'I', 'E', 'R');
+constexpr uint32_t kSceneChunk_MaterialForNode = makeFourCC('M', 'T', 'N', 'D');
+constexpr uint32_t kSceneChunk_MeshForNode = makeFourCC('M', 'S', 'N', 'D');
+// optional chunks
+constexpr uint32_t kSceneChunk_NameForNode = makeFourCC('N', 'M', 'N', 'D');
+constexpr uint32_t kSceneChunk_Names = makeFourCC('N', 'A', 'M', 'E');
+constexpr uint32_t kSceneChunk_MaterialNames = makeFourCC('M', 'T', 'N', 'M');
+constexpr uint32_t kSceneChunk_OriginalNodeIndex = makeFourCC('N', 'R', 'M', 'P');
+constexpr uint32_t kSceneChunk_NameIndexNodes = makeFourCC('N', 'I', 'D', 'X');
+constexpr uint32_t kSceneChunk_NameIndexTable = makeFourCC('N', 'H', 'S', 'H');
+
+uint32_t &NodeMap::operator[](uint32_t node)
+{
+    // the caller may change the value through the returned reference
+    generation_++;
+
+    if (contains(node))
+        return items_[sparse_[node]].value_;
+
+    if (node >= sparse_.size())
+        sparse_.resize(node + 1, kInvalidNodeItem);
+
+    // the common case: the scene is built (or merged) in ascending node order
+    if (items_.empty() || items_.back().node_ < node)
+    {
+        sparse_[node] = (uint32_t)items_.size();
+        items_.push_back({.node_ = node, .value_ = 0});
+        return items_.back().value_;
+    }
+
+    // otherwise the item is inserted in the middle and the sparse index of all the following items is shifted
+    const auto it = std::lower_bound(items_.begin(), items_.end(), node, [](const NodeMapItem &item, uint32_t n)
+                                     { return item.node_ < n; });
+    const size_t pos = std::distance(items_.begin(), it);
+    items_.insert(it, {.node_ = node, .value_ = 0});
+
+    for (size_t i = pos; i != items_.size(); i++)
+        sparse_[items_[i].node_] = (uint32_t)i;
+
+    return items_[pos].value_;
+}
+
+void rebuildNodeMap(NodeMap &map)
+{
+    auto &items = map.items_;
+
+    if (!std::is_sorted(items.begin(), items.end(), [](const NodeMapItem &a, const NodeMapItem &b)
+                        { return a.node_ < b.node_; }))
+        std::stable_sort(items.begin(), items.end(), [](const NodeMapItem &a, const NodeMapItem &b)
+                         { return a.node_ < b.node_; });
+
+    // keep the last of the equal nodes, as repeated assignments to std::unordered_map would do
+    auto last = items.begin();
+    for (auto i = items.begin(); i != items.end(); i++)
+    {
+        if (last != items.begin() && (last - 1)->node_ == i->node_)
+            *(last - 1) = *i;
+        else
+            *last++ = *i;
+    }
+    items.erase(last, items.end());
+
+    map.sparse_.assign(items.empty() ? 0 : items.back().node_ + 1, kInvalidNodeItem);
+    for (size_t i = 0; i != items.size(); i++)
+        map.sparse_[items[i].node_] = (uint32_t)i;
+
+    map.generation_++;
+}
 
 // allocates a new scene node and adds it to the scene hierarchy
 int addNode(Scene &scene, int parent, int level)
@@ -56,36 +131,332 @@ int addNode(Scene &scene, int parent, int level)
     scene.hierarchy_[node].level_ = level;
     scene.hierarchy_[node].nextSibling_ = -1;
     scene.hierarchy_[node].firstChild_ = -1;
+
+    scene.parents_.push_back(parent);
     return node;
 }
 
-// starts with a given node and recursively descends
-// to each and every child node, adding it to the changedAtLevel_ arrays
+// starts with a given node and descends
+// to each and every child node, adding it to the changedAtLevel_ arrays.
+// An explicit stack replaces the recursion, so arbitrarily deep hierarchies cannot overflow the call stack.
+// Marking a node always marks its whole subtree, so an already marked node means an already marked subtree:
+// overlapping calls (a node and its ancestor, or the same node twice) stay linear in the number of changed nodes
 void markAsChanged(Scene &scene, int node)
 {
-    int level = scene.hierarchy_[node].level_;
-    scene.changedAtThisFrame_[level].push_back(node);
+    auto &stamps = scene.changedGeneration_;
+    const uint32_t generation = scene.changeGeneration_;
+
+    if (stamps.size() < scene.hierarchy_.size())
+        stamps.resize(scene.hierarchy_.size(), 0);
+
+    if (stamps[node] == generation)
+        return;
+
+    std::vector<int> stack;
+    stack.push_back(node);
+    stamps[node] = generation;
+
+    while (!stack.empty())
+    {
+        const int n = stack.back();
+        stack.pop_back();
+
+        const size_t level = (size_t)scene.hierarchy_[n].level_;
+        if (level >= scene.changedAtThisFrame_.size())
+            scene.changedAtThisFrame_.resize(level + 1);
+        scene.changedAtThisFrame_[level].push_back(n);
+
+        for (int s = scene.hierarchy_[n].firstChild_; s != -1; s = scene.hierarchy_[s].nextSibling_)
+            if (stamps[s] != generation)
+            {
+                stamps[s] = generation;
+                stack.push_back(s);
+            }
+    }
+}
+
+// Called once the changed nodes are consumed: all the buckets are empty, and the new generation unmarks all the nodes
+static void nextChangeGeneration(Scene &scene)
+{
+    if (++scene.changeGeneration_ == 0)
+    {
+        // after 2^32 frames the old stamps could match again
+        std::fill(scene.changedGeneration_.begin(), scene.changedGeneration_.end(), 0);
+        scene.changeGeneration_ = 1;
+    }
+}
+
+// The nodes were renumbered, so the stamps are recalculated from the (already remapped) buckets
+static void restampChangedNodes(Scene &scene)
+{
+    scene.changedGeneration_.assign(scene.hierarchy_.size(), 0);
+    scene.changeGeneration_ = 1;
+
+    for (const auto &changed : scene.changedAtThisFrame_)
+        for (int c : changed)
+            scene.changedGeneration_[c] = 1;
+}
+
+/* Name index */
+
+// the name of a node which is known to have one
+static const std::string &nameOf(const Scene &scene, uint32_t node)
+{
+    return scene.names_[scene.nameForNode_.at(node)];
+}
+
+static bool nodeNameLess(const Scene &scene, uint32_t a, uint32_t b)
+{
+    const int cmp = nameOf(scene, a).compare(nameOf(scene, b));
+    return (cmp < 0) || (cmp == 0 && a < b);
+}
+
+// Returns the slot holding the name or the empty slot where the name should go.
+// The table is never full, so the probing always terminates
+static size_t findNameSlot(const Scene &scene, const std::string &name)
+{
+    const auto &table = scene.nameIndex_.table_;
+    const size_t mask = table.size() - 1;
+
+    for (size_t i = xxHash64(name.data(), name.size()) & mask;; i = (i + 1) & mask)
+        if (table[i] == kInvalidNodeItem || nameOf(scene, table[i]) == name)
+            return i;
+}
+
+// The hash table is derived from the sorted node list: the first node of every run of equal names is the smallest one
+static void buildNameTable(Scene &scene)
+{
+    auto &index = scene.nameIndex_;
+    const auto &sorted = index.sortedNodes_;
+
+    auto isFirstOfRun = [&scene, &sorted](size_t i)
+    { return (i == 0) || (nameOf(scene, sorted[i]) != nameOf(scene, sorted[i - 1])); };
+
+    uint32_t distinct = 0;
+    for (size_t i = 0; i != sorted.size(); i++)
+        distinct += isFirstOfRun(i) ? 1 : 0;
+
+    size_t tableSize = 16;
+    while (tableSize < (distinct + 1) * 2)
+        tableSize *= 2;
+
+    index.table_.assign(tableSize, kInvalidNodeItem);
+    index.distinctNames_ = distinct;
+
+    for (size_t i = 0; i != sorted.size(); i++)
+        if (isFirstOfRun(i))
+            index.table_[findNameSlot(scene, nameOf(scene, sorted[i]))] = sorted[i];
+}
+
+void buildNameIndex(Scene &scene)
+{
+    auto &sorted = scene.nameIndex_.sortedNodes_;
+
+    sorted.clear();
+    sorted.reserve(scene.nameForNode_.size());
+    for (const auto &item : scene.nameForNode_)
+        sorted.push_back(item.node_);
+
+    std::sort(sorted.begin(), sorted.end(), [&scene](uint32_t a, uint32_t b)
+              { return nodeNameLess(scene, a, b); });
+
+    buildNameTable(scene);
+    scene.nameIndex_.nameForNodeGeneration_ = scene.nameForNode_.generation_;
+}
+
+bool isNameIndexValid(const Scene &scene)
+{
+    return !scene.nameIndex_.table_.empty() && scene.nameIndex_.nameForNodeGeneration_ == scene.nameForNode_.generation_;
+}
+
+// called before the node loses its current name
+static void removeFromNameIndex(Scene &scene, uint32_t node)
+{
+    auto &index = scene.nameIndex_;
+    auto &sorted = index.sortedNodes_;
+
+    const auto it = std::lower_bound(sorted.begin(), sorted.end(), node, [&scene](uint32_t a, uint32_t b)
+                                     { return nodeNameLess(scene, a, b); });
+    assert(it != sorted.end() && *it == node);
+
+    const std::string &name = nameOf(scene, node);
+    const size_t slot = findNameSlot(scene, name);
+    const auto next = sorted.erase(it);
+
+    if (index.table_[slot] != node)
+        return;
+
+    // the node was the smallest one with this name: either the next node in the run takes its place,
+    // or the name is gone (open addressing does not support plain removal, so the table is rebuilt)
+    if (next != sorted.end() && nameOf(scene, *next) == name)
+        index.table_[slot] = *next;
+    else
+        buildNameTable(scene);
+}
+
+// called after the node gets its new name
+static void addToNameIndex(Scene &scene, uint32_t node)
+{
+    auto &index = scene.nameIndex_;
+    auto &sorted = index.sortedNodes_;
+
+    sorted.insert(std::upper_bound(sorted.begin(), sorted.end(), node, [&scene](uint32_t a, uint32_t b)
+                                   { return nodeNameLess(scene, a, b); }),
+                  node);
+
+    const size_t slot = findNameSlot(scene, nameOf(scene, node));
+
+    if (index.table_[slot] == kInvalidNodeItem)
+    {
+        if ((index.distinctNames_ + 1) * 2 > index.table_.size())
+        {
+            buildNameTable(scene);
+            return;
+        }
+        index.table_[slot] = node;
+        index.distinctNames_++;
+    }
+    else if (node < index.table_[slot])
+    {
+        index.table_[slot] = node;
+    }
+}
+
+void setNodeName(Scene &scene, int node, const std::string &name)
+{
+    // an up-to-date index is updated incrementally
+    const bool indexed = isNameIndexValid(scene);
+
+    if (indexed && scene.nameForNode_.contains(node))
+        removeFromNameIndex(scene, node);
 
-    // TODO: use non-recursive iteration with aux stack
-    for (int s = scene.hierarchy_[node].firstChild_; s != -1; s = scene.hierarchy_[s].nextSibling_)
-        markAsChanged(scene, s);
+    uint32_t stringID = (uint32_t)scene.names_.size();
+    scene.names_.push_back(name);
+    scene.nameForNode_[node] = stringID;
+
+    if (indexed)
+    {
+        addToNameIndex(scene, node);
+        scene.nameIndex_.nameForNodeGeneration_ = scene.nameForNode_.generation_;
+    }
 }
 
 int findNodeByName(const Scene &scene, const std::string &name)
 {
+    if (isNameIndexValid(scene))
+    {
+        const uint32_t node = scene.nameIndex_.table_[findNameSlot(scene, name)];
+        return (node != kInvalidNodeItem) ? (int)node : -1;
+    }
+
     // Extremely simple linear search without any hierarchy reference
     // To support DFS/BFS searches separate traversal routines are needed
 
-    for (size_t i = 0; i < scene.localTransform_.size(); i++)
-        if (scene.nameForNode_.contains(i))
+    // the items are sorted by node, so the first matching node is returned
+    for (const auto &item : scene.nameForNode_)
+        if (scene.names_[item.value_] == name)
+            return (int)item.node_;
+
+    return -1;
+}
+
+// Without a valid index all the named nodes are filtered and sorted, so the results are the same either way
+template <typename Predicate>
+static std::vector<uint32_t> scanNodeNames(const Scene &scene, Predicate pred)
+{
+    std::vector<uint32_t> nodes;
+    for (const auto &item : scene.nameForNode_)
+        if (pred(scene.names_[item.value_]))
+            nodes.push_back(item.node_);
+
+    std::sort(nodes.begin(), nodes.end(), [&scene](uint32_t a, uint32_t b)
+              { return nodeNameLess(scene, a, b); });
+    return nodes;
+}
+
+std::vector<uint32_t> findNodesByName(const Scene &scene, const std::string &name)
+{
+    if (!isNameIndexValid(scene))
+        return scanNodeNames(scene, [&name](const std::string &s)
+                             { return s == name; });
+
+    // the hash table gives the first node of the run, so only the end of the run has to be found
+    const uint32_t first = scene.nameIndex_.table_[findNameSlot(scene, name)];
+    if (first == kInvalidNodeItem)
+        return {};
+
+    const auto &sorted = scene.nameIndex_.sortedNodes_;
+    auto it = std::lower_bound(sorted.begin(), sorted.end(), first, [&scene](uint32_t a, uint32_t b)
+                               { return nodeNameLess(scene, a, b); });
+    auto end = std::partition_point(it, sorted.end(), [&scene, &name](uint32_t n)
+                                    { return nameOf(scene, n) == name; });
+
+    return std::vector<uint32_t>(it, end);
+}
+
+std::vector<uint32_t> findNodesByPrefix(const Scene &scene, const std::string &prefix)
+{
+    auto hasPrefix = [&prefix](const std::string &s)
+    { return s.compare(0, prefix.size(), prefix) == 0; };
+
+    if (!isNameIndexValid(scene))
+        return scanNodeNames(scene, hasPrefix);
+
+    // all the names with a common prefix are adjacent in the sorted list
+    const auto &sorted = scene.nameIndex_.sortedNodes_;
+    auto it = std::partition_point(sorted.begin(), sorted.end(), [&scene, &prefix](uint32_t n)
+                                   { return nameOf(scene, n) < prefix; });
+    auto end = std::partition_point(it, sorted.end(), [&scene, &hasPrefix](uint32_t n)
+                                    { return hasPrefix(nameOf(scene, n)); });
+
+    return std::vector<uint32_t>(it, end);
+}
+
+// '*' and '?' wildcard matching with backtracking to the last '*'
+static bool matchPattern(const char *pattern, const char *str)
+{
+    const char *star = nullptr;
+    const char *retry = nullptr;
+
+    while (*str)
+    {
+        if (*pattern == '*')
         {
-            int strID = scene.nameForNode_.at(i);
-            if (strID > -1)
-                if (scene.names_[strID] == name)
-                    return (int)i;
+            star = pattern++;
+            retry = str;
+        }
+        else if (*pattern == '?' || *pattern == *str)
+        {
+            pattern++;
+            str++;
         }
+        else if (star)
+        {
+            pattern = star + 1;
+            str = ++retry;
+        }
+        else
+        {
+            return false;
+        }
+    }
 
-    return -1;
+    while (*pattern == '*')
+        pattern++;
+
+    return *pattern == 0;
+}
+
+std::vector<uint32_t> findNodesByPattern(const Scene &scene, const std::string &pattern)
+{
+    // the literal part before the first wildcard narrows the search down to a prefix range
+    std::vector<uint32_t> nodes = findNodesByPrefix(scene, pattern.substr(0, pattern.find_first_of("*?")));
+
+    nodes.erase(std::remove_if(nodes.begin(), nodes.end(), [&scene, &pattern](uint32_t n)
+                               { return !matchPattern(pattern.c_str(), nameOf(scene, n).c_str()); }),
+                nodes.end());
+
+    return nodes;
 }
 
 int getNodeLevel(const Scene &scene, int n)
@@ -96,6 +467,16 @@ int getNodeLevel(const Scene &scene, int n)
     return level;
 }
 
+void syncHierarchySoA(Scene &scene)
+{
+    const size_t count = scene.hierarchy_.size();
+
+    scene.parents_.resize(count);
+
+    for (size_t i = 0; i != count; i++)
+        scene.parents_[i] = scene.hierarchy_[i].parent_;
+}
+
 bool mat4IsIdentity(const glm::mat4 &m);
 void fprintfMat4(FILE *f, const glm::mat4 &m);
 
@@ -106,135 +487,220 @@ void fprintfMat4(FILE *f, const glm::mat4 &m);
 // CPU version of global transform update []
 void recalculateGlobalTransforms(Scene &scene)
 {
-    // start from the root layer of the list of changed scene nodes, supposing we have
-    // only one root node. This is because root node global transforms coincide with their
-    // local transforms. The changed nodes list is then cleared
-    if (!scene.changedAtThisFrame_[0].empty())
-    {
-        int c = scene.changedAtThisFrame_[0][0];
+    if (scene.changedAtThisFrame_.empty())
+        return;
+
+    // start from the root layer of the list of changed scene nodes. This is because root
+    // node global transforms coincide with their local transforms. The changed nodes list is then cleared
+    for (int c : scene.changedAtThisFrame_[0])
         scene.globalTransform_[c] = scene.localTransform_[c];
-        scene.changedAtThisFrame_[0].clear();
-    }
+    scene.changedAtThisFrame_[0].clear();
 
     // ensure that we have parents so that the loops are
     // linear and there are no conditions inside. We will start from level 1 because the root
-    // level is already being handled
-    for (int i = 1; i < MAX_NODE_LEVEL && (!scene.changedAtThisFrame_[i].empty()); i++)
+    // level is already being handled.
+    // Empty levels are skipped instead of terminating the loop: when only a deep subtree
+    // was marked as changed, all the levels above it are empty
+    for (size_t i = 1; i < scene.changedAtThisFrame_.size(); i++)
     {
+        if (scene.changedAtThisFrame_[i].empty())
+            continue;
+
         // iterate all the changed nodes at this level
-        for (const int &c : scene.changedAtThisFrame_[i])
+        for (int c : scene.changedAtThisFrame_[i])
+            scene.globalTransform_[c] = mulMat4(scene.globalTransform_[scene.parents_[c]], scene.localTransform_[c]);
+        scene.changedAtThisFrame_[i].clear();
+    }
+
+    nextChangeGeneration(scene);
+}
+
+// All the nodes within a level depend only on the nodes from the previous levels, so every level is
+// embarrassingly parallel once its parent level is done. The levels themselves are processed in order,
+// and the executor's work-stealing scheduler balances the nodes of a level between its threads.
+// Small levels are not worth the scheduling overhead and are processed on the calling thread
+void recalculateGlobalTransformsParallel(Scene &scene, tf::Executor &executor, size_t minParallelNodes)
+{
+    if (scene.changedAtThisFrame_.empty())
+        return;
+
+    for (int c : scene.changedAtThisFrame_[0])
+        scene.globalTransform_[c] = scene.localTransform_[c];
+    scene.changedAtThisFrame_[0].clear();
+
+    for (size_t i = 1; i < scene.changedAtThisFrame_.size(); i++)
+    {
+        std::vector<int> &changed = scene.changedAtThisFrame_[i];
+
+        if (changed.empty())
+            continue;
+
+        auto updateNode = [&scene, &changed](size_t idx)
         {
-            int p = scene.hierarchy_[c].parent_;
-            scene.globalTransform_[c] = scene.globalTransform_[p] * scene.localTransform_[c];
+            const int c = changed[idx];
+            const int p = scene.parents_[c];
+            scene.globalTransform_[c] = mulMat4(scene.globalTransform_[p], scene.localTransform_[c]);
+        };
+
+        if (changed.size() < minParallelNodes)
+        {
+            for (size_t idx = 0; idx != changed.size(); idx++)
+                updateNode(idx);
         }
-        scene.changedAtThisFrame_[i].clear();
+        else
+        {
+            // markAsChanged() never adds a node twice, so no two threads write the same matrix
+            tf::Taskflow taskflow;
+            taskflow.for_each_index(size_t(0), changed.size(), size_t(1), updateNode);
+            executor.run(taskflow).wait();
+        }
+
+        changed.clear();
     }
+
+    nextChangeGeneration(scene);
 }
 
-void loadMap(FILE *f, std::unordered_map<uint32_t, uint32_t> &map)
+void loadMap(const ChunkFile &file, uint32_t chunkId, NodeMap &map)
 {
-    // the count of {key, value} pairs is read from a file
-    std::vector<uint32_t> ms;
+    // the chunk is a flat array of {node, value} pairs sorted by node, i.e. exactly NodeMap::items_
+    readChunk(file, chunkId, map.items_);
 
-    uint32_t sz = 0;
-    fread(&sz, 1, sizeof(sz), f);
+    // only the sparse index has to be built (files written before the items were kept sorted are sorted here)
+    rebuildNodeMap(map);
+}
+
+// validates the name index arrays read from a file
+static bool loadNameIndex(Scene &scene)
+{
+    auto &index = scene.nameIndex_;
+    const size_t tableSize = index.table_.size();
 
-    // all the key-value pairs are loaded with a single fread call:
-    ms.resize(sz);
-    fread(ms.data(), sizeof(int), sz, f);
+    if (index.sortedNodes_.size() != scene.nameForNode_.size() || tableSize < 2 || (tableSize & (tableSize - 1)) != 0)
+        return false;
 
-    // the array is converted into a hash table:
-    for (size_t i = 0; i < (sz / 2); i++)
-        map[ms[i * 2 + 0]] = ms[i * 2 + 1];
+    if (!std::all_of(index.sortedNodes_.begin(), index.sortedNodes_.end(), [&scene](uint32_t n)
+                     { return scene.nameForNode_.contains(n); }))
+        return false;
+
+    index.distinctNames_ = 0;
+    for (uint32_t n : index.table_)
+    {
+        if (n == kInvalidNodeItem)
+            continue;
+        if (!scene.nameForNode_.contains(n))
+            return false;
+        index.distinctNames_++;
+    }
+
+    if (index.distinctNames_ * 2 > tableSize)
+        return false;
+
+    index.nameForNodeGeneration_ = scene.nameForNode_.generation_;
+    return true;
 }
 
 void loadScene(const char *fileName, Scene &scene)
 {
-    FILE *f = fopen(fileName, "rb");
+    ChunkFile file;
 
-    if (!f)
+    if (!openChunkFile(fileName, kSceneFileType, file))
     {
         printf("Cannot open scene file '%s'. Please run SceneConverter or MergeMeshes", fileName);
         return;
     }
 
-    uint32_t sz = 0;
-    fread(&sz, sizeof(sz), 1, f);
+    // all the per-node arrays must have the same size
+    const auto localTransforms = getChunkData<glm::mat4>(file, kSceneChunk_LocalTransforms);
+    const auto globalTransforms = getChunkData<glm::mat4>(file, kSceneChunk_GlobalTransforms);
+    const auto hierarchy = getChunkData<Hierarchy>(file, kSceneChunk_Hierarchy);
+
+    if (localTransforms.size() != hierarchy.size() || globalTransforms.size() != hierarchy.size())
+    {
+        printf("Scene file '%s' is corrupted\n", fileName);
+        closeChunkFile(file);
+        return;
+    }
 
-    scene.hierarchy_.resize(sz);
-    scene.globalTransform_.resize(sz);
-    scene.localTransform_.resize(sz);
     // TODO: check > -1
     // TODO: recalculate changedAtThisLevel() - find max depth of a node [or save scene.maxLevel]
-    // fread() reads the transformations and hierarchical data for all the scene nodes:
-    fread(scene.localTransform_.data(), sizeof(glm::mat4), sz, f);
-    fread(scene.globalTransform_.data(), sizeof(glm::mat4), sz, f);
-    fread(scene.hierarchy_.data(), sizeof(Hierarchy), sz, f);
+    scene.localTransform_.assign(localTransforms.begin(), localTransforms.end());
+    scene.globalTransform_.assign(globalTransforms.begin(), globalTransforms.end());
+    scene.hierarchy_.assign(hierarchy.begin(), hierarchy.end());
 
     // Mesh for node [index to some list of buffers]
     // Node-to-material and node-to-mesh mappings are loaded with the calls to the
     // loadMap() helper routine:
-    loadMap(f, scene.materialForNode_);
-    loadMap(f, scene.meshes_);
+    loadMap(file, kSceneChunk_MaterialForNode, scene.materialForNode_);
+    loadMap(file, kSceneChunk_MeshForNode, scene.meshes_);
 
-    // If there is still some data left, we must read the scene node names and material names:
-    if (!feof(f))
-    {
-        loadMap(f, scene.nameForNode_);
-        loadStringList(f, scene.names_);
+    // Scene node names and material names are optional
+    loadMap(file, kSceneChunk_NameForNode, scene.nameForNode_);
+    unpackStringList(getChunkData<uint8_t>(file, kSceneChunk_Names), scene.names_);
+    unpackStringList(getChunkData<uint8_t>(file, kSceneChunk_MaterialNames), scene.materialNames_);
 
-        loadStringList(f, scene.materialNames_);
+    // present only if the nodes were reordered by reorderNodesByLevel()
+    readChunk(file, kSceneChunk_OriginalNodeIndex, scene.originalNodeIndex_);
+    if (!scene.originalNodeIndex_.empty() && scene.originalNodeIndex_.size() != scene.hierarchy_.size())
+    {
+        printf("Scene file '%s' has an invalid node remap table, ignoring it\n", fileName);
+        scene.originalNodeIndex_.clear();
     }
 
-    fclose(f);
-}
+    // the name index is optional as well. It is rebuilt if it is missing or does not match the names
+    readChunk(file, kSceneChunk_NameIndexNodes, scene.nameIndex_.sortedNodes_);
+    readChunk(file, kSceneChunk_NameIndexTable, scene.nameIndex_.table_);
 
-void saveMap(FILE *f, const std::unordered_map<uint32_t, uint32_t> &map)
-{
-    // A temporary {key, value} pair array is allocated:
-    std::vector<uint32_t> ms;
-    ms.reserve(map.size() * 2);
+    closeChunkFile(file);
 
-    // All the values from std::unordered_map are copied to the array:
-    for (const auto &m : map)
-    {
-        ms.push_back(m.first);
-        ms.push_back(m.second);
-    }
+    if (!loadNameIndex(scene))
+        buildNameIndex(scene);
 
-    const uint32_t sz = static_cast<uint32_t>(ms.size());
-    // The count of {key, value} pairs is written to the file:
-    fwrite(&sz, sizeof(sz), 1, f);
-    // the {key, value} pairs are written with one fwrite() call:
-    fwrite(ms.data(), sizeof(int), ms.size(), f);
+    syncHierarchySoA(scene);
+}
+
+void saveMap(ChunkFileWriter &writer, uint32_t chunkId, const NodeMap &map)
+{
+    // the sorted {node, value} pairs are written as a single chunk:
+    writeChunk(writer, chunkId, map.items_, kChunkAlignment_Small);
 }
 
-// write the count of scene nodes:
 void saveScene(const char *fileName, const Scene &scene)
 {
-    FILE *f = fopen(fileName, "wb");
+    ChunkFileWriter writer;
 
-    const uint32_t sz = (uint32_t)scene.hierarchy_.size();
-    fwrite(&sz, sizeof(sz), 1, f);
+    if (!beginChunkFile(writer, fileName, kSceneFileType))
+        return;
 
-    // Three fwrite() calls save the local and global transformations, followed by the hierarchical information
-    fwrite(scene.localTransform_.data(), sizeof(glm::mat4), sz, f);
-    fwrite(scene.globalTransform_.data(), sizeof(glm::mat4), sz, f);
-    fwrite(scene.hierarchy_.data(), sizeof(Hierarchy), sz, f);
+    // save the local and global transformations, followed by the hierarchical information
+    writeChunk(writer, kSceneChunk_LocalTransforms, scene.localTransform_);
+    writeChunk(writer, kSceneChunk_GlobalTransforms, scene.globalTransform_);
+    writeChunk(writer, kSceneChunk_Hierarchy, scene.hierarchy_, kChunkAlignment_Small);
 
     // Mesh for node [index to some list of buffers]
     // store the node-to-materials and node-to-mesh mappings:
-    saveMap(f, scene.materialForNode_);
-    saveMap(f, scene.meshes_);
+    saveMap(writer, kSceneChunk_MaterialForNode, scene.materialForNode_);
+    saveMap(writer, kSceneChunk_MeshForNode, scene.meshes_);
 
     if (!scene.names_.empty() && !scene.nameForNode_.empty())
     {
-        saveMap(f, scene.nameForNode_);
-        saveStringList(f, scene.names_);
+        saveMap(writer, kSceneChunk_NameForNode, scene.nameForNode_);
+        writeChunk(writer, kSceneChunk_Names, packStringList(scene.names_), kChunkAlignment_Small);
+        writeChunk(writer, kSceneChunk_MaterialNames, packStringList(scene.materialNames_), kChunkAlignment_Small);
 
-        saveStringList(f, scene.materialNames_);
+        // the index is saved as is, so loadScene() does not have to sort all the names again
+        if (isNameIndexValid(scene))
+        {
+            writeChunk(writer, kSceneChunk_NameIndexNodes, scene.nameIndex_.sortedNodes_, kChunkAlignment_Small);
+            writeChunk(writer, kSceneChunk_NameIndexTable, scene.nameIndex_.table_, kChunkAlignment_Small);
+        }
     }
-    fclose(f);
+
+    if (!scene.originalNodeIndex_.empty())
+        writeChunk(writer, kSceneChunk_OriginalNodeIndex, scene.originalNodeIndex_, kChunkAlignment_Small);
+
+    if (!endChunkFile(writer))
+        printf("Error writing scene file '%s'\n", fileName);
 }
 
 bool mat4IsIdentity(const glm::mat4 &m)
@@ -279,9 +745,12 @@ void dumpTransforms(const char *fileName, const Scene &scene)
 
 void printChangedNodes(const Scene &scene)
 {
-    for (int i = 0; i < MAX_NODE_LEVEL && (!scene.changedAtThisFrame_[i].empty()); i++)
+    for (size_t i = 0; i < scene.changedAtThisFrame_.size(); i++)
     {
-        printf("Changed at level(%d):\n", i);
+        if (scene.changedAtThisFrame_[i].empty())
+            continue;
+
+        printf("Changed at level(%d):\n", (int)i);
 
         for (const int &c : scene.changedAtThisFrame_[i])
         {
@@ -325,14 +794,13 @@ void shiftNodes(Scene &scene, int startOffset, int nodeCount, int shiftAmount)
         shiftNode(scene.hierarchy_[i + startOffset]);
 }
 
-using ItemMap = std::unordered_map<uint32_t, uint32_t>;
-
 // Add the items from otherMap shifting indices and values along the way
 // adds the otherMap collection to the m output map and shifts item indices by specified amounts:
-void mergeMaps(ItemMap &m, const ItemMap &otherMap, int indexOffset, int itemOffset)
+void mergeMaps(NodeMap &m, const NodeMap &otherMap, int indexOffset, int itemOffset)
 {
+    // the scenes are appended one after another, so the shifted nodes always go to the end of the items array
     for (const auto &i : otherMap)
-        m[i.first + indexOffset] = i.second + itemOffset;
+        m[i.node_ + indexOffset] = i.value_ + itemOffset;
 }
 
 /**
@@ -368,7 +836,10 @@ void mergeScenes(Scene &scene, const std::vector<Scene *> &scenes,
     scene.globalTransform_.push_back(glm::mat4(1.f));
 
     if (scenes.empty())
+    {
+        syncHierarchySoA(scene);
         return;
+    }
 
     // While iterating the scenes, we merge and shift all the arrays and maps. The next few
     // variables keep track of item counts in the output scene:
@@ -446,6 +917,11 @@ void mergeScenes(Scene &scene, const std::vector<Scene *> &scenes,
     // now shift levels of all nodes below the root
     for (auto i = scene.hierarchy_.begin() + 1; i != scene.hierarchy_.end(); i++)
         i->level_++;
+
+    // the merged scene is in a new node order, so the remap tables of the source scenes do not apply to it
+    scene.originalNodeIndex_.clear();
+    syncHierarchySoA(scene);
+    buildNameIndex(scene);
 }
 
 void dumpSceneToDot(const char *fileName, const Scene &scene, int *visited)
@@ -478,122 +954,263 @@ void dumpSceneToDot(const char *fileName, const Scene &scene, int *visited)
     fclose(f);
 }
 
-/** A rather long algorithm (and the auxiliary routines) to delete a number of scene nodes from the hierarchy */
-/* */
+/** Deleting a number of scene nodes from the hierarchy */
 
-// Add an index to a sorted index array, avoids adding items twice:
-// One subtle requirement here is that the array is sorted. When all the children come
-// strictly after their parents, this is not a problem. Otherwise, std::find() should
-// be used, which naturally increases the runtime cost of the algorithm.
-static void addUniqueIdx(std::vector<uint32_t> &v, uint32_t index)
+// replaces the pair::second value in each map's item:
+void shiftMapIndices(NodeMap &items, const std::vector<int> &newIndices)
 {
-    if (!std::binary_search(v.begin(), v.end(), index))
-        v.push_back(index);
+    // the items of the deleted nodes are dropped, the rest get their new node indices
+    auto last = items.items_.begin();
+    for (const auto &m : items.items_)
+    {
+        const int newIndex = newIndices[m.node_];
+        if (newIndex != -1)
+            *last++ = NodeMapItem{.node_ = (uint32_t)newIndex, .value_ = m.value_};
+    }
+    items.items_.erase(last, items.items_.end());
+
+    // deleteSceneNodes() keeps the relative order of the nodes, while reorderNodesByLevel() does not
+    rebuildNodeMap(items);
 }
 
-// Recurse down from a node and collect all nodes which are already marked for deletion
-// When we want to delete one node, all its children
-// must also be marked for deletion. We collect all the nodes to be deleted with the
-// following recursive routine. To do this, we iterate all the children,, while traversing a scene graph.
-// Each iterated index is added to the array:
-static void collectNodesToDelete(const Scene &scene, int node, std::vector<uint32_t> &nodes)
+// The deleteSceneNodes() routine allows us to compress and optimize a scene graph
+// while merging multiple meshes with the same material.
+// A mark-and-compact algorithm, O(N) for N = scene.size regardless of how many nodes are deleted:
+//   1) mark the nodes and their subtrees in a flag array (iterative walk with an explicit stack)
+//   2) an exclusive prefix sum over the surviving nodes gives the newIndices[oldIndex] table
+//   3) relink the children of every surviving node, skipping the deleted ones
+//   4) move the surviving nodes and their components down to their new positions in a single pass
+void deleteSceneNodes(Scene &scene, const std::vector<uint32_t> &nodesToDelete)
 {
-    for (int n = scene.hierarchy_[node].firstChild_; n != -1; n = scene.hierarchy_[n].nextSibling_)
+    const size_t nodeCount = scene.hierarchy_.size();
+    const bool nameIndexed = isNameIndexValid(scene);
+
+    // 1) Mark the nodes. Deleting a node deletes its whole subtree, and already marked subtrees are not walked twice
+    std::vector<uint8_t> deleted(nodeCount, 0);
+    std::vector<int> stack;
+
+    for (uint32_t n : nodesToDelete)
     {
-        addUniqueIdx(nodes, n);
-        collectNodesToDelete(scene, n, nodes);
+        if (n >= nodeCount || deleted[n])
+            continue;
+
+        deleted[n] = 1;
+        stack.push_back((int)n);
+
+        while (!stack.empty())
+        {
+            const int node = stack.back();
+            stack.pop_back();
+
+            for (int c = scene.hierarchy_[node].firstChild_; c != -1; c = scene.hierarchy_[c].nextSibling_)
+                if (!deleted[c])
+                {
+                    deleted[c] = 1;
+                    stack.push_back(c);
+                }
+        }
     }
-}
 
-// returns a deleted node replacement index:
-// If the input is empty, no replacement is necessary. If we have no replacement for the
-// node, we recurse to the next sibling of the deleted node.
-int findLastNonDeletedItem(const Scene &scene, const std::vector<int> &newIndices, int node)
-{
-    // we have to be more subtle:
-    //   if the (newIndices[firstChild_] == -1), we should follow the link and extract the last non-removed item
-    //   ..
-    if (node == -1)
-        return -1;
+    // 2) Make a newIndices[oldIndex] mapping table
+    std::vector<int> newIndices(nodeCount, -1);
+    int newCount = 0;
+    for (size_t i = 0; i != nodeCount; i++)
+        if (!deleted[i])
+            newIndices[i] = newCount++;
 
-    return (newIndices[node] == -1) ? findLastNonDeletedItem(scene, newIndices, scene.hierarchy_[node].nextSibling_) : newIndices[node];
-}
+    if (newCount == (int)nodeCount)
+        return;
 
-// replaces the pair::second value in each map's item:
-void shiftMapIndices(std::unordered_map<uint32_t, uint32_t> &items, const std::vector<int> &newIndices)
-{
-    std::unordered_map<uint32_t, uint32_t> newItems;
-    for (const auto &m : items)
+    // 3) Relink the children of the surviving nodes. Every node is visited once as a child of its parent.
+    // A surviving node never has a deleted parent, so only the sibling lists have gaps.
+    // The first child caches the last sibling (see addNode()), the other children do not
+    auto remap = [&newIndices](int node)
+    { return (node > -1) ? newIndices[node] : -1; };
+
+    std::vector<Hierarchy> &h = scene.hierarchy_;
+    std::vector<int> firstChild(nodeCount, -1);
+    std::vector<int> nextSibling(nodeCount, -1);
+    std::vector<int> lastSibling(nodeCount, -1);
+
+    for (size_t p = 0; p != nodeCount; p++)
     {
-        int newIndex = newIndices[m.first];
-        if (newIndex != -1)
-            newItems[newIndex] = m.second;
+        if (deleted[p])
+            continue;
+
+        int prev = -1;
+        for (int c = h[p].firstChild_; c != -1; c = h[c].nextSibling_)
+        {
+            if (deleted[c])
+                continue;
+            (prev == -1 ? firstChild[p] : nextSibling[prev]) = c;
+            prev = c;
+        }
+
+        if (prev != -1)
+            lastSibling[firstChild[p]] = prev;
+    }
+
+    // the roots are not anyone's children, so their sibling links just skip the deleted roots
+    for (size_t r = 0; r != nodeCount; r++)
+        if (!deleted[r] && h[r].parent_ == -1)
+        {
+            int next = h[r].nextSibling_;
+            while (next != -1 && deleted[next])
+                next = h[next].nextSibling_;
+            nextSibling[r] = next;
+            lastSibling[r] = (h[r].lastSibling_ != -1 && !deleted[h[r].lastSibling_]) ? h[r].lastSibling_ : -1;
+        }
+
+    // 4) Compaction. newIndices[i] <= i, so the items can be moved down in place
+    const bool hasOriginalIndices = !scene.originalNodeIndex_.empty();
+
+    for (size_t i = 0; i != nodeCount; i++)
+    {
+        const int dst = newIndices[i];
+        if (dst == -1)
+            continue;
+
+        h[dst] = Hierarchy{
+            .parent_ = remap(h[i].parent_),
+            .firstChild_ = remap(firstChild[i]),
+            .nextSibling_ = remap(nextSibling[i]),
+            .lastSibling_ = remap(lastSibling[i]),
+            .level_ = h[i].level_};
+
+        scene.localTransform_[dst] = scene.localTransform_[i];
+        scene.globalTransform_[dst] = scene.globalTransform_[i];
+
+        if (hasOriginalIndices)
+            scene.originalNodeIndex_[dst] = scene.originalNodeIndex_[i];
+    }
+
+    h.resize(newCount);
+    scene.localTransform_.resize(newCount);
+    scene.globalTransform_.resize(newCount);
+    if (hasOriginalIndices)
+        scene.originalNodeIndex_.resize(newCount);
+
+    // 5) All the components change their keys with the newIndices[] array. They are sorted by node,
+    // and the remap keeps the order, so no sorting is needed
+    shiftMapIndices(scene.meshes_, newIndices);
+    shiftMapIndices(scene.materialForNode_, newIndices);
+    shiftMapIndices(scene.nameForNode_, newIndices);
+
+    for (auto &changed : scene.changedAtThisFrame_)
+    {
+        auto last = changed.begin();
+        for (int c : changed)
+            if (newIndices[c] != -1)
+                *last++ = newIndices[c];
+        changed.erase(last, changed.end());
     }
-    items = newItems;
+    restampChangedNodes(scene);
+
+    // 6) The remaining nodes keep their relative order and their names, so the sorted name list stays sorted
+    // once the deleted nodes are dropped and the rest are renumbered. Only the hash table has to be rebuilt
+    if (nameIndexed)
+    {
+        auto &sorted = scene.nameIndex_.sortedNodes_;
+        auto last = sorted.begin();
+        for (uint32_t n : sorted)
+            if (newIndices[n] != -1)
+                *last++ = (uint32_t)newIndices[n];
+        sorted.erase(last, sorted.end());
+
+        buildNameTable(scene);
+        scene.nameIndex_.nameForNodeGeneration_ = scene.nameForNode_.generation_;
+    }
+    else
+    {
+        scene.nameIndex_ = NodeNameIndex();
+    }
+
+    syncHierarchySoA(scene);
+
+    // 7) scene node names list is not modified, but in principle it can be (remove all non-used items and adjust the nameForNode_ map)
+    // 8) Material names list is not modified also, but if some materials fell out of use
 }
 
-// The deleteSceneNodes() routine allows us to compress and optimize a scene graph
-// while merging multiple meshes with the same material.
-// Approximately an O ( N * Log(N) * Log(M)) algorithm (N = scene.size, M = nodesToDelete.size) to delete a collection of nodes from scene graph
-void deleteSceneNodes(Scene &scene, const std::vector<uint32_t> &nodesToDelete)
+// The nodes are created by a depth-first traversal of the source scene, so a single level of the hierarchy is
+// scattered all over the transform arrays and the level-by-level update jumps around in memory. A breadth-first
+// order fixes this: the nodes of every level form a contiguous range, and the children of each node are adjacent.
+// This is an optional compaction pass - the node indices change, so it has to be done before anything
+// (e.g. the renderer's shape list) references the nodes by index
+void reorderNodesByLevel(Scene &scene)
 {
-    // 0) Add all the nodes down below in the hierarchy
-    // starts by adding all child nodes to the deleted nodes list.
-    // To keep track of moved nodes, we create a nodes linear list of indices, starting at 0:
-    auto indicesToDelete = nodesToDelete;
-    for (auto i : indicesToDelete)
-        collectNodesToDelete(scene, i, indicesToDelete);
-
-    // aux array with node indices to keep track of the moved ones [moved = [](node) { return (node != nodes[node]); ]
-    std::vector<int> nodes(scene.hierarchy_.size());
-    std::iota(nodes.begin(), nodes.end(), 0);
-
-    // 1.a) Move all the indicesToDelete to the end of 'nodes' array (and cut them off, a variation of swap'n'pop for multiple elements)
-    // Afterward, we remember the source node count and remove all the indices from
-    // our linear index list. To fix the child node indices, we create a linear mapping table
-    // from old node indices to the new ones:
-    auto oldSize = nodes.size();
-    eraseSelected(nodes, indicesToDelete);
-
-    // 1.b) Make a newIndices[oldIndex] mapping table
-    std::vector<int> newIndices(oldSize, -1);
-    for (int i = 0; i < nodes.size(); i++)
-        newIndices[nodes[i]] = i;
-
-    // 2) Replace all non-null parent/firstChild/nextSibling pointers in all the nodes by new positions
-    // Before deleting nodes from the hierarchy array, we remap all node indices. The
-    // following lambda modifies a single Hierarchy item by finding the non-null node
-    // in the newIndices container:
-    auto nodeMover = [&scene, &newIndices](Hierarchy &h)
-    {
-        return Hierarchy{
-            .parent_ = (h.parent_ != -1) ? newIndices[h.parent_] : -1,
-            .firstChild_ = findLastNonDeletedItem(scene, newIndices, h.firstChild_),
-            .nextSibling_ = findLastNonDeletedItem(scene, newIndices, h.nextSibling_),
-            .lastSibling_ = findLastNonDeletedItem(scene, newIndices, h.lastSibling_)};
-    };
+    const size_t nodeCount = scene.hierarchy_.size();
+    if (!nodeCount)
+        return;
+
+    const bool nameIndexed = isNameIndexValid(scene);
+
+    // 1) Breadth-first traversal starting from all the roots. The 'order' array is both the BFS queue
+    // and the resulting newIndex -> oldIndex mapping
+    std::vector<int> order;
+    order.reserve(nodeCount);
 
-    // The std::transform() algorithm modifies all the nodes in the hierarchy.
-    // After fixing node indices, we are ready to actually delete data. Three calls to
-    // eraseSelected() throw away the unused hierarchy and transformation items:
-    std::transform(scene.hierarchy_.begin(), scene.hierarchy_.end(), scene.hierarchy_.begin(), nodeMover);
+    for (size_t i = 0; i != nodeCount; i++)
+        if (scene.hierarchy_[i].parent_ == -1)
+            order.push_back((int)i);
 
-    // 3) Finally throw away the hierarchy items
-    eraseSelected(scene.hierarchy_, indicesToDelete);
+    for (size_t head = 0; head != order.size() && order.size() <= nodeCount; head++)
+        for (int s = scene.hierarchy_[order[head]].firstChild_; s != -1; s = scene.hierarchy_[s].nextSibling_)
+            order.push_back(s);
+
+    if (order.size() != nodeCount)
+    {
+        printf("reorderNodesByLevel(): the scene hierarchy is inconsistent, the nodes are left as is\n");
+        return;
+    }
 
-    // 4) As in mergeScenes() routine we also have to adjust all the "components" (i.e., meshes, materials, names and transformations)
+    // 2) The inverse oldIndex -> newIndex mapping is used to fix all the node references
+    std::vector<int> newIndices(nodeCount);
+    for (size_t i = 0; i != nodeCount; i++)
+        newIndices[order[i]] = (int)i;
 
-    // 4a) Transformations are stored in arrays, so we just erase the items as we did with the scene.hierarchy_
-    eraseSelected(scene.localTransform_, indicesToDelete);
-    eraseSelected(scene.globalTransform_, indicesToDelete);
+    auto remap = [&newIndices](int node)
+    { return (node > -1) ? newIndices[node] : -1; };
 
-    // 4b) All the maps should change the key values with the newIndices[] array
-    // Finally, we need to adjust the indices in mesh, material, and name maps. For this,
-    // we use the shiftMapIndices() function shown here:
+    std::vector<Hierarchy> hierarchy(nodeCount);
+    std::vector<mat4> localTransform(nodeCount);
+    std::vector<mat4> globalTransform(nodeCount);
+
+    for (size_t i = 0; i != nodeCount; i++)
+    {
+        const Hierarchy &h = scene.hierarchy_[order[i]];
+        hierarchy[i] = Hierarchy{
+            .parent_ = remap(h.parent_),
+            .firstChild_ = remap(h.firstChild_),
+            .nextSibling_ = remap(h.nextSibling_),
+            .lastSibling_ = remap(h.lastSibling_),
+            .level_ = h.level_};
+        localTransform[i] = scene.localTransform_[order[i]];
+        globalTransform[i] = scene.globalTransform_[order[i]];
+    }
+
+    scene.hierarchy_ = std::move(hierarchy);
+    scene.localTransform_ = std::move(localTransform);
+    scene.globalTransform_ = std::move(globalTransform);
+
+    // 3) The components are keyed by node index
     shiftMapIndices(scene.meshes_, newIndices);
     shiftMapIndices(scene.materialForNode_, newIndices);
     shiftMapIndices(scene.nameForNode_, newIndices);
 
-    // 5) scene node names list is not modified, but in principle it can be (remove all non-used items and adjust the nameForNode_ map)
-    // 6) Material names list is not modified also, but if some materials fell out of use
+    for (auto &changed : scene.changedAtThisFrame_)
+        for (int &c : changed)
+            c = newIndices[c];
+    restampChangedNodes(scene);
+
+    // 4) Compose with the previous remap, so that originalNodeIndex_ always refers to the order of the source scene
+    std::vector<uint32_t> originalNodeIndex(nodeCount);
+    for (size_t i = 0; i != nodeCount; i++)
+        originalNodeIndex[i] = scene.originalNodeIndex_.empty() ? (uint32_t)order[i] : scene.originalNodeIndex_[order[i]];
+    scene.originalNodeIndex_ = std::move(originalNodeIndex);
+
+    syncHierarchySoA(scene);
+
+    // nodes with equal names may change their relative order, so the index is rebuilt
+    if (nameIndexed)
+        buildNameIndex(scene);
 }
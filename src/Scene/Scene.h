@@ -1,7 +1,9 @@
 #pragma once
 
+#include <assert.h>
+#include <stdint.h>
+
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 #include <glm/glm.hpp>
@@ -9,9 +11,12 @@
 
 using glm::mat4;
 
-// we do not define std::vector<Node*> Children - this is already present in the aiNode from assimp
-constexpr const int MAX_NODE_LEVEL = 16;
+namespace tf
+{
+    class Executor;
+}
 
+// we do not define std::vector<Node*> Children - this is already present in the aiNode from assimp
 // Left Child – Right Sibling tree representation
 // The local and global transforms are also stored in separate arrays and can be easily
 // mapped to a GPU buffer without conversion, making them directly accessible from GLSL shaders
@@ -29,6 +34,76 @@ struct Hierarchy
     int level_;
 };
 
+constexpr uint32_t kInvalidNodeItem = ~0u;
+
+struct NodeMapItem
+{
+    uint32_t node_;
+    uint32_t value_;
+};
+
+// A node component (mesh, material or name index of a node).
+// Only some of the nodes have a component, so the items are stored as a dense array of {node, value}
+// pairs sorted by the node index, plus a sparse node -> item index for O(1) lookups.
+// Iteration is linear and deterministic, and the items array is exactly the on-disk layout, so a whole
+// component is loaded with a single copy and no rehashing
+struct NodeMap
+{
+    std::vector<NodeMapItem> items_;
+    // indexed by node, kInvalidNodeItem for the nodes without the component
+    std::vector<uint32_t> sparse_;
+    // Incremented by operator[], clear() and rebuildNodeMap(), i.e. by every change made through the NodeMap interface,
+    // so the data derived from the map (see NodeNameIndex) can tell whether it is still up to date
+    uint32_t generation_ = 0;
+
+    inline bool contains(uint32_t node) const { return node < sparse_.size() && sparse_[node] != kInvalidNodeItem; }
+
+    inline const NodeMapItem *find(uint32_t node) const { return contains(node) ? &items_[sparse_[node]] : nullptr; }
+
+    inline uint32_t at(uint32_t node) const
+    {
+        assert(contains(node));
+        return items_[sparse_[node]].value_;
+    }
+
+    // adds the component to the node if it is missing. Adding nodes in ascending order is an O(1) append
+    uint32_t &operator[](uint32_t node);
+
+    inline size_t size() const { return items_.size(); }
+    inline bool empty() const { return items_.empty(); }
+
+    inline std::vector<NodeMapItem>::const_iterator begin() const { return items_.begin(); }
+    inline std::vector<NodeMapItem>::const_iterator end() const { return items_.end(); }
+
+    inline void clear()
+    {
+        items_.clear();
+        sparse_.clear();
+        generation_++;
+    }
+};
+
+// Sorts the items by node (the last item wins for duplicate nodes) and rebuilds the sparse index.
+// Must be called after editing items_ directly
+void rebuildNodeMap(NodeMap &map);
+
+// Name index for the node lookups by name, prefix or wildcard pattern.
+// All the named nodes are sorted by {name, node}, so the nodes with equal names (or with a common prefix)
+// form a contiguous range. A hash table on top of it answers exact-name queries in O(1). Both arrays are flat
+// and are stored in the scene file as they are
+struct NodeNameIndex
+{
+    // nodes with names, sorted by name and then by node index
+    std::vector<uint32_t> sortedNodes_;
+    // open addressing (linear probing) over the name hashes. A slot holds the smallest node with a given name,
+    // kInvalidNodeItem marks an empty slot. The size is a power of two
+    std::vector<uint32_t> table_;
+    // number of occupied slots, the table is kept at most half full
+    uint32_t distinctNames_ = 0;
+    // Scene::nameForNode_.generation_ at the time the index was last brought up to date
+    uint32_t nameForNodeGeneration_ = 0;
+};
+
 /* This scene is converted into a descriptorSet(s) in MultiRenderer class
    This structure is also used as a storage type in SceneExporter tool
  */
@@ -39,51 +114,93 @@ struct Scene
     std::vector<mat4> localTransform_;
     std::vector<mat4> globalTransform_;
 
-    // list of nodes whose global transform must be recalculated
-    std::vector<int> changedAtThisFrame_[MAX_NODE_LEVEL];
+    // list of nodes whose global transform must be recalculated, one bucket per hierarchy level.
+    // There is no depth limit: the buckets are added as deeper nodes get marked
+    std::vector<std::vector<int>> changedAtThisFrame_;
+
+    // A node is already in changedAtThisFrame_ if its stamp equals changeGeneration_. The recalculation
+    // bumps the generation, which clears all the flags at once without touching the array
+    std::vector<uint32_t> changedGeneration_;
+    uint32_t changeGeneration_ = 1;
 
     // Hierarchy component
     std::vector<Hierarchy> hierarchy_;
 
+    // SoA copy of Hierarchy::parent_. The transform updates only need the parent index, so they read
+    // 4 bytes per node instead of the whole 20-byte Hierarchy item. Every routine which restructures the
+    // hierarchy (addNode(), loadScene(), mergeScenes(), deleteSceneNodes() and reorderNodesByLevel()) keeps it
+    // in sync; code editing hierarchy_ directly must call syncHierarchySoA() before the next transform update
+    std::vector<int> parents_;
+
+    // Index of each node before reorderNodesByLevel() was applied (empty if the scene was never reordered).
+    // It is saved along with the scene, so the original node indices can always be recovered
+    std::vector<uint32_t> originalNodeIndex_;
+
     // Mesh component: Which node corresponds to which node
-    std::unordered_map<uint32_t, uint32_t> meshes_;
+    NodeMap meshes_;
 
     // Material component: Which material belongs to which node
-    std::unordered_map<uint32_t, uint32_t> materialForNode_;
+    NodeMap materialForNode_;
 
     // Node name component: Which name is assigned to the node
-    std::unordered_map<uint32_t, uint32_t> nameForNode_;
+    NodeMap nameForNode_;
 
     // List of scene node names
     std::vector<std::string> names_;
 
     // Debug list of material names
     std::vector<std::string> materialNames_;
+
+    // Maintained by setNodeName(), mergeScenes(), deleteSceneNodes() and reorderNodesByLevel().
+    // Any other change of nameForNode_ invalidates the index (the lookups fall back to linear scans) until buildNameIndex()
+    // is called. The strings of names_ must not be edited in place, setNodeName() adds a new string instead
+    NodeNameIndex nameIndex_;
 };
 
 int addNode(Scene &scene, int parent, int level);
 
+// Marks the node and its subtree for recalculation. Each node is added at most once per frame
 void markAsChanged(Scene &scene, int node);
 
+// (Re)builds the name index from scratch
+void buildNameIndex(Scene &scene);
+
+// The index is used only if nameForNode_ has not changed behind its back, otherwise the lookups fall back to linear scans
+bool isNameIndexValid(const Scene &scene);
+
+// returns the smallest node with the given name or -1
 int findNodeByName(const Scene &scene, const std::string &name);
 
+// The nodes are returned in {name, node} order
+std::vector<uint32_t> findNodesByName(const Scene &scene, const std::string &name);
+std::vector<uint32_t> findNodesByPrefix(const Scene &scene, const std::string &prefix);
+// '*' matches any sequence of characters and '?' matches any single character
+std::vector<uint32_t> findNodesByPattern(const Scene &scene, const std::string &pattern);
+
 inline std::string getNodeName(const Scene &scene, int node)
 {
-    int strID = scene.nameForNode_.contains(node) ? scene.nameForNode_.at(node) : -1;
-    return (strID > -1) ? scene.names_[strID] : std::string();
+    const NodeMapItem *item = scene.nameForNode_.find(node);
+    return item ? scene.names_[item->value_] : std::string();
 }
 
-inline void setNodeName(Scene &scene, int node, const std::string &name)
-{
-    uint32_t stringID = (uint32_t)scene.names_.size();
-    scene.names_.push_back(name);
-    scene.nameForNode_[node] = stringID;
-}
+void setNodeName(Scene &scene, int node, const std::string &name);
 
 int getNodeLevel(const Scene &scene, int n);
 
+// Rebuilds the parents_ array from the hierarchy_
+void syncHierarchySoA(Scene &scene);
+
+// Reorders all the nodes breadth-first, i.e. by level, and remaps all the node components.
+// After that every level is a contiguous range of nodes, the children of a node are adjacent and all of them
+// come after their parent, so the level-by-level transform update streams through the arrays linearly
+void reorderNodesByLevel(Scene &scene);
+
 void recalculateGlobalTransforms(Scene &scene);
 
+// Same as recalculateGlobalTransforms(), but the changed nodes of each level are distributed between
+// the executor's worker threads. Levels with fewer than minParallelNodes changed nodes are processed serially
+void recalculateGlobalTransformsParallel(Scene &scene, tf::Executor &executor, size_t minParallelNodes = 4096);
+
 void loadScene(const char *fileName, Scene &scene);
 void saveScene(const char *fileName, const Scene &scene);
 
@@ -2,73 +2,308 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <limits>
+#include <math.h>
 #include <stdio.h>
+#include <string.h>
 
-MeshFileHeader loadMeshData(const char *meshFile, MeshData &out)
+#include <glm/gtc/packing.hpp>
+
+// floats per vertex of the in-memory MeshData: pos, uv, normal
+constexpr uint32_t kFloatVertexSize = 8;
+
+static uint32_t getVertexStride(VertexFormat format)
 {
-	MeshFileHeader header;
+	switch (format)
+	{
+	case VertexFormat_Packed:
+		return 5;
+	case VertexFormat_Quantized:
+		return 4;
+	default:
+		return kFloatVertexSize;
+	}
+}
 
-	FILE *f = fopen(meshFile, "rb");
+// Octahedral normal encoding: the unit sphere is projected onto the octahedron |x| + |y| + |z| = 1, and its lower
+// half is folded over the upper one. Two 16-bit components keep the angular error well below a hundredth of a degree
+static glm::vec2 encodeOctahedral(glm::vec3 n)
+{
+	const float sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if (sum == 0.0f)
+		return glm::vec2(0.0f);
 
-	assert(f);
-	if (!f)
+	n /= sum;
+
+	if (n.z >= 0.0f)
+		return glm::vec2(n.x, n.y);
+
+	return glm::vec2((1.0f - fabsf(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f), (1.0f - fabsf(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+// the same as octDecode() in data/shaders/07/VK01_VertCommon.h
+static glm::vec3 decodeOctahedral(glm::vec2 e)
+{
+	glm::vec3 n(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+	const float t = std::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return glm::normalize(n);
+}
+
+static uint32_t floatBits(float f)
+{
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+static float bitsToFloat(uint32_t u)
+{
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+// The quantization range covers all the vertices of the file, so the shaders do not need any per-mesh data
+static VertexStreamHeader getVertexStreamHeader(const std::vector<float> &vertices, VertexFormat format)
+{
+	VertexStreamHeader header = {.format = format, .stride = getVertexStride(format)};
+
+	if (format != VertexFormat_Quantized || vertices.empty())
+		return header;
+
+	glm::vec3 vmin(std::numeric_limits<float>::max());
+	glm::vec3 vmax(std::numeric_limits<float>::lowest());
+
+	for (size_t i = 0; i < vertices.size(); i += kFloatVertexSize)
+	{
+		const glm::vec3 p(vertices[i + 0], vertices[i + 1], vertices[i + 2]);
+		vmin = glm::min(vmin, p);
+		vmax = glm::max(vmax, p);
+	}
+
+	for (int c = 0; c != 3; c++)
+	{
+		header.posOffset[c] = vmin[c];
+		// a flat scene must not cause a division by zero
+		header.posScale[c] = std::max(vmax[c] - vmin[c], std::numeric_limits<float>::min());
+	}
+
+	return header;
+}
+
+static std::vector<uint32_t> encodeVertices(const std::vector<float> &vertices, const VertexStreamHeader &header)
+{
+	const size_t numVertices = vertices.size() / kFloatVertexSize;
+
+	std::vector<uint32_t> out(numVertices * header.stride);
+
+	for (size_t i = 0; i != numVertices; i++)
+	{
+		const float *v = &vertices[i * kFloatVertexSize];
+		uint32_t *o = &out[i * header.stride];
+
+		if (header.format == VertexFormat_Float)
+		{
+			memcpy(o, v, kFloatVertexSize * sizeof(float));
+			continue;
+		}
+
+		const uint32_t uv = glm::packHalf2x16(glm::vec2(v[3], v[4]));
+		const uint32_t normal = glm::packSnorm2x16(encodeOctahedral(glm::vec3(v[5], v[6], v[7])));
+
+		if (header.format == VertexFormat_Packed)
+		{
+			o[0] = floatBits(v[0]);
+			o[1] = floatBits(v[1]);
+			o[2] = floatBits(v[2]);
+			o[3] = uv;
+			o[4] = normal;
+		}
+		else
+		{
+			const glm::vec3 q = (glm::vec3(v[0], v[1], v[2]) - glm::vec3(header.posOffset[0], header.posOffset[1], header.posOffset[2])) /
+								glm::vec3(header.posScale[0], header.posScale[1], header.posScale[2]);
+			o[0] = glm::packUnorm2x16(glm::vec2(q.x, q.y));
+			o[1] = glm::packUnorm2x16(glm::vec2(q.z, 0.0f));
+			o[2] = uv;
+			o[3] = normal;
+		}
+	}
+
+	return out;
+}
+
+static void decodeVertices(std::span<const float> data, const VertexStreamHeader &header, std::vector<float> &out)
+{
+	const size_t numVertices = data.size() / header.stride;
+	const uint32_t *words = reinterpret_cast<const uint32_t *>(data.data());
+
+	out.resize(numVertices * kFloatVertexSize);
+
+	for (size_t i = 0; i != numVertices; i++)
+	{
+		const uint32_t *w = &words[i * header.stride];
+		float *v = &out[i * kFloatVertexSize];
+
+		if (header.format == VertexFormat_Float)
+		{
+			memcpy(v, w, kFloatVertexSize * sizeof(float));
+			continue;
+		}
+
+		glm::vec3 pos;
+		if (header.format == VertexFormat_Packed)
+		{
+			pos = glm::vec3(bitsToFloat(w[0]), bitsToFloat(w[1]), bitsToFloat(w[2]));
+		}
+		else
+		{
+			const glm::vec2 xy = glm::unpackUnorm2x16(w[0]);
+			const glm::vec2 z = glm::unpackUnorm2x16(w[1]);
+			pos = glm::vec3(header.posOffset[0], header.posOffset[1], header.posOffset[2]) +
+				  glm::vec3(xy.x, xy.y, z.x) * glm::vec3(header.posScale[0], header.posScale[1], header.posScale[2]);
+		}
+
+		const uint32_t *attribs = w + header.stride - 2;
+		const glm::vec2 uv = glm::unpackHalf2x16(attribs[0]);
+		const glm::vec3 n = decodeOctahedral(glm::unpackSnorm2x16(attribs[1]));
+
+		v[0] = pos.x;
+		v[1] = pos.y;
+		v[2] = pos.z;
+		v[3] = uv.x;
+		v[4] = uv.y;
+		v[5] = n.x;
+		v[6] = n.y;
+		v[7] = n.z;
+	}
+}
+
+// Opens the chunk file, checks that all the chunks are consistent with the header and sets up the view spans.
+// The payloads are aligned inside the file and the mapping itself is page-aligned, so all the spans are
+// properly aligned for their element types
+MeshFileHeader loadMeshDataView(const char *meshFile, MeshDataView &out)
+{
+	if (!openChunkFile(meshFile, kMeshFileType, out.file_))
 	{
 		printf("Cannot open %s. Did you forget to run \"MeshConverter\"?\n", meshFile);
 		exit(EXIT_FAILURE);
 	}
 
-	if (fread(&header, 1, sizeof(header), f) != sizeof(header))
+	const auto headerChunk = getChunkData<MeshFileHeader>(out.file_, kMeshChunk_Header);
+
+	if (headerChunk.size() != 1 || headerChunk[0].magicValue != 0x12345678)
 	{
 		printf("Unable to read mesh file header\n");
 		exit(EXIT_FAILURE);
 	}
 
-	out.meshes_.resize(header.meshCount);
-	if (fread(out.meshes_.data(), sizeof(Mesh), header.meshCount, f) != header.meshCount)
+	const MeshFileHeader header = headerChunk[0];
+
+	out.meshes_ = getChunkData<Mesh>(out.file_, kMeshChunk_Meshes);
+	out.boxes_ = getChunkData<BoundingBox>(out.file_, kMeshChunk_Boxes);
+	out.indexData_ = getChunkData<uint32_t>(out.file_, kMeshChunk_Indices);
+	out.vertexData_ = getChunkData<float>(out.file_, kMeshChunk_Vertices);
+
+	const auto streamChunk = getChunkData<VertexStreamHeader>(out.file_, kMeshChunk_VertexFormat);
+	out.vertexStream_ = streamChunk.empty() ? VertexStreamHeader{} : streamChunk[0];
+
+	if (out.meshes_.size() != header.meshCount || out.boxes_.size() != header.meshCount ||
+		out.indexData_.size_bytes() != header.indexDataSize || out.vertexData_.size_bytes() != header.vertexDataSize ||
+		out.vertexStream_.stride != getVertexStride((VertexFormat)out.vertexStream_.format) || out.vertexData_.size() % out.vertexStream_.stride != 0)
 	{
-		printf("Could not read mesh descriptors\n");
+		printf("Mesh file %s is inconsistent with its header\n", meshFile);
 		exit(EXIT_FAILURE);
 	}
-	out.boxes_.resize(header.meshCount);
-	if (fread(out.boxes_.data(), sizeof(BoundingBox), header.meshCount, f) != header.meshCount)
-	{
-		printf("Could not read bounding boxes\n");
-		exit(255);
-	}
 
-	out.indexData_.resize(header.indexDataSize / sizeof(uint32_t));
-	out.vertexData_.resize(header.vertexDataSize / sizeof(float));
+	return header;
+}
+
+void releaseMeshDataView(MeshDataView &view)
+{
+	closeChunkFile(view.file_);
+	view = MeshDataView();
+}
+
+// The packed vertex formats are decoded, so the returned data always has 8 floats per vertex
+MeshFileHeader loadMeshData(const char *meshFile, MeshData &out, VertexFormat *format)
+{
+	MeshDataView view;
+	MeshFileHeader header = loadMeshDataView(meshFile, view);
+
+	out.meshes_.assign(view.meshes_.begin(), view.meshes_.end());
+	out.boxes_.assign(view.boxes_.begin(), view.boxes_.end());
+	out.indexData_.assign(view.indexData_.begin(), view.indexData_.end());
+	decodeVertices(view.vertexData_, view.vertexStream_, out.vertexData_);
 
-	if ((fread(out.indexData_.data(), 1, header.indexDataSize, f) != header.indexDataSize) ||
-		(fread(out.vertexData_.data(), 1, header.vertexDataSize, f) != header.vertexDataSize))
+	if (format)
+		*format = (VertexFormat)view.vertexStream_.format;
+
+	releaseMeshDataView(view);
+
+	const uint32_t elementSize = kFloatVertexSize * sizeof(float);
+	for (auto &mesh : out.meshes_)
 	{
-		printf("Unable to read index/vertex data\n");
-		exit(255);
+		mesh.streamElementSize[0] = elementSize;
+		mesh.streamOffset[0] = mesh.vertexOffset * elementSize;
 	}
 
-	fclose(f);
+	header.vertexDataSize = out.vertexData_.size() * sizeof(float);
 
 	return header;
 }
 
-void saveMeshData(const char *fileName, const MeshData &m)
+// The bulk index and vertex data go into 64-byte aligned chunks, the small descriptor arrays are 16-byte aligned
+void saveMeshData(const char *fileName, const MeshData &m, VertexFormat format)
 {
-	FILE *f = fopen(fileName, "wb");
+	for (const auto &mesh : m.meshes_)
+	{
+		if (mesh.streamCount != 1 || mesh.streamElementSize[0] != kFloatVertexSize * sizeof(float))
+		{
+			printf("Cannot save %s: only meshes with a single stream of 8 floats per vertex are supported\n", fileName);
+			exit(255);
+		}
+	}
+
+	const VertexStreamHeader stream = getVertexStreamHeader(m.vertexData_, format);
+	const std::vector<uint32_t> vertices = encodeVertices(m.vertexData_, stream);
 
+	// the mesh descriptors refer to the stored stream
+	std::vector<Mesh> meshes = m.meshes_;
+	for (auto &mesh : meshes)
+	{
+		mesh.streamElementSize[0] = stream.stride * sizeof(uint32_t);
+		mesh.streamOffset[0] = mesh.vertexOffset * mesh.streamElementSize[0];
+	}
+
+	ChunkFileWriter writer;
+
+	if (!beginChunkFile(writer, fileName, kMeshFileType))
+		exit(255);
+
+	writeChunk(writer, kMeshChunk_Meshes, meshes, kChunkAlignment_Small);
+	writeChunk(writer, kMeshChunk_Boxes, m.boxes_, kChunkAlignment_Small);
+	writeChunk(writer, kMeshChunk_Indices, m.indexData_);
+	writeChunk(writer, kMeshChunk_Vertices, vertices);
+	writeChunk(writer, kMeshChunk_VertexFormat, &stream, sizeof(stream), kChunkAlignment_Small);
+
+	// chunks are located through the table, so the header can go last once the data offset is known
 	const MeshFileHeader header = {
 		.magicValue = 0x12345678,
 		.meshCount = (uint32_t)m.meshes_.size(),
-		.dataBlockStartOffset = (uint32_t)(sizeof(MeshFileHeader) + m.meshes_.size() * sizeof(Mesh)),
-		.indexDataSize = (uint32_t)(m.indexData_.size() * sizeof(uint32_t)),
-		.vertexDataSize = (uint32_t)(m.vertexData_.size() * sizeof(float))};
+		.dataBlockStartOffset = writer.chunks_[2].offset_,
+		.indexDataSize = m.indexData_.size() * sizeof(uint32_t),
+		.vertexDataSize = vertices.size() * sizeof(uint32_t)};
 
-	fwrite(&header, 1, sizeof(header), f);
-	fwrite(m.meshes_.data(), sizeof(Mesh), header.meshCount, f);
-	fwrite(m.boxes_.data(), sizeof(BoundingBox), header.meshCount, f);
-	fwrite(m.indexData_.data(), 1, header.indexDataSize, f);
-	fwrite(m.vertexData_.data(), 1, header.vertexDataSize, f);
+	writeChunk(writer, kMeshChunk_Header, &header, sizeof(header), kChunkAlignment_Small);
 
-	fclose(f);
+	if (!endChunkFile(writer))
+	{
+		printf("Error writing mesh file %s\n", fileName);
+		exit(255);
+	}
 }
 
 void saveBoundingBoxes(const char *fileName, const std::vector<BoundingBox> &boxes)
@@ -117,8 +352,8 @@ void loadBoundingBoxes(const char *fileName, std::vector<BoundingBox> &boxes)
 // a new file header while simultaneously copying all the indices and vertices to the output object:
 MeshFileHeader mergeMeshData(MeshData &m, const std::vector<MeshData *> md)
 {
-	uint32_t totalVertexDataSize = 0;
-	uint32_t totalIndexDataSize = 0;
+	uint64_t totalVertexDataSize = 0;
+	uint64_t totalIndexDataSize = 0;
 
 	uint32_t offs = 0;
 	for (const MeshData *i : md)
@@ -132,14 +367,14 @@ MeshFileHeader mergeMeshData(MeshData &m, const std::vector<MeshData *> md)
 		// "magic" number—8—here is the sum of 3 vertex position components, 3 normal
 		// vector components, and 2 texture coordinates:
 
-		uint32_t vtxOffset = totalVertexDataSize / 8;
+		const uint32_t vtxOffset = (uint32_t)(totalVertexDataSize / 8);
 
 		// After merging the index and vertex data along with the auxiliary precalculated
 		// bounding boxes, shift each index by the total size of the merged index array:
 		for (size_t j = 0; j < (uint32_t)i->meshes_.size(); j++)
 			// m.vertexCount, m.lodCount and m.streamCount do not change
 			// m.vertexOffset also does not change, because vertex offsets are local (i.e., baked into the indices)
-			m.meshes_[offs + j].indexOffset += totalIndexDataSize;
+			m.meshes_[offs + j].indexOffset += (uint32_t)totalIndexDataSize;
 
 		// shift individual indices
 		for (size_t j = 0; j < i->indexData_.size(); j++)
@@ -148,17 +383,17 @@ MeshFileHeader mergeMeshData(MeshData &m, const std::vector<MeshData *> md)
 		// At each iteration, increment global offsets in the mesh, index, and vertex arrays:
 		offs += (uint32_t)i->meshes_.size();
 
-		totalIndexDataSize += (uint32_t)i->indexData_.size();
-		totalVertexDataSize += (uint32_t)i->vertexData_.size();
+		totalIndexDataSize += i->indexData_.size();
+		totalVertexDataSize += i->vertexData_.size();
 	}
 
 	// The resulting mesh file header contains the total size of index and vertex data arrays:
 	return MeshFileHeader{
 		.magicValue = 0x12345678,
 		.meshCount = (uint32_t)offs,
-		.dataBlockStartOffset = (uint32_t)(sizeof(MeshFileHeader) + offs * sizeof(Mesh)),
-		.indexDataSize = static_cast<uint32_t>(totalIndexDataSize * sizeof(uint32_t)),
-		.vertexDataSize = static_cast<uint32_t>(totalVertexDataSize * sizeof(float))};
+		.dataBlockStartOffset = 0,
+		.indexDataSize = totalIndexDataSize * sizeof(uint32_t),
+		.vertexDataSize = totalVertexDataSize * sizeof(float)};
 }
 
 void recalculateBoundingBoxes(MeshData &m)
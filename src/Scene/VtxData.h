@@ -16,10 +16,14 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <span>
+
 #include <glm/glm.hpp>
 
 #include "Utils/Utils.h"
 #include "Utils/UtilsMath.h"
+#include "Utils/UtilsChunkFile.h"
 
 constexpr const uint32_t kMaxLODs = 8;
 constexpr const uint32_t kMaxStreams = 8;
@@ -50,12 +54,16 @@ struct Mesh final
     uint32_t streamOffset[kMaxStreams] = {0};
 
     /* Information about stream element (size pretty much defines everything else, the "semantics" is defined by the shader) */
-    // might want to store the element type, such as byte, or float. This information is important for performance reasons
+    // The element type of the single interleaved stream of our mesh files is stored once per file, see VertexStreamHeader
     uint32_t streamElementSize[kMaxStreams] = {0};
 
     /* We could have included the streamStride[] array here to allow interleaved storage of attributes.
        For this book we assume tightly-packed (non-interleaved) vertex attribute streams */
 
+    /* Object-space simplification error of each LOD, i.e. how far its surface may deviate from the original one.
+       Zero for LOD 0. The runtime LOD selection projects it onto the screen (see VKSceneData::selectLODs()) */
+    float lodError[kMaxLODs] = {0};
+
     /* Additional information, like mesh name, can be added here */
 };
 
@@ -68,18 +76,54 @@ struct MeshFileHeader
     /* Number of mesh descriptors following this header */
     uint32_t meshCount;
 
-    /* The offset to combined mesh data (this is the base from which the offsets in individual meshes start) */
-    uint32_t dataBlockStartOffset;
+    /* The offset of the index data chunk inside the file (zero for meshes which were never saved) */
+    uint64_t dataBlockStartOffset;
 
-    /* How much space index data takes */
-    uint32_t indexDataSize;
+    /* How much space index data takes. 64-bit sizes allow merged scenes larger than 4 GB */
+    uint64_t indexDataSize;
 
     /* How much space vertex data takes */
-    uint32_t vertexDataSize;
+    uint64_t vertexDataSize;
 
     /* According to your needs, you may add additional metadata fields */
 };
 
+// Encodings of the interleaved (pos, uv, normal) vertex stream of a mesh file. In memory MeshData always keeps
+// 8 floats per vertex: the stream is packed by saveMeshData() and decoded by loadMeshData() on the CPU side,
+// while the renderers upload the packed data as is and decode it in the vertex-pulling shaders
+enum VertexFormat : uint32_t
+{
+    // float pos[3], float uv[2], float normal[3]: 32 bytes
+    VertexFormat_Float = 0,
+    // float pos[3], half uv[2], snorm16 normal[2] (octahedral encoding): 20 bytes
+    VertexFormat_Packed = 1,
+    // unorm16 pos[3] relative to the bounds of all the vertices in the file, 16 bits of padding,
+    // half uv[2], snorm16 normal[2] (octahedral encoding): 16 bytes
+    VertexFormat_Quantized = 2,
+};
+
+// Stored in its own chunk and uploaded in front of the vertex data, so the shaders can decode the stream
+// without any additional bindings. Must match VertexStreamHeader in data/shaders/07/VK01_VertCommon.h
+struct VertexStreamHeader
+{
+    uint32_t format = VertexFormat_Float;
+    // the size of a vertex in 32-bit words
+    uint32_t stride = 8;
+    // quantized positions are decoded as posOffset + q * posScale, where q is in [0, 1]
+    float posOffset[3] = {0.0f, 0.0f, 0.0f};
+    float posScale[3] = {1.0f, 1.0f, 1.0f};
+};
+
+// The .meshes file is a chunk file (see UtilsChunkFile.h) with the following chunks
+constexpr uint32_t kMeshFileType = makeFourCC('M', 'E', 'S', 'H');
+constexpr uint32_t kMeshChunk_Header = makeFourCC('H', 'E', 'A', 'D');
+constexpr uint32_t kMeshChunk_Meshes = makeFourCC('M', 'S', 'H', 'S');
+constexpr uint32_t kMeshChunk_Boxes = makeFourCC('B', 'B', 'O', 'X');
+constexpr uint32_t kMeshChunk_Indices = makeFourCC('I', 'D', 'X', ' ');
+constexpr uint32_t kMeshChunk_Vertices = makeFourCC('V', 'T', 'X', ' ');
+// optional, files without it store VertexFormat_Float
+constexpr uint32_t kMeshChunk_VertexFormat = makeFourCC('V', 'F', 'M', 'T');
+
 struct DrawData
 {
     uint32_t meshIndex;
@@ -100,11 +144,79 @@ struct MeshData
     std::vector<BoundingBox> boxes_;
 };
 
+// A read-only view of a memory-mapped mesh file. The spans point directly into the mapped file
+// pages, so the index and vertex data can be handed to the GPU uploader without being copied
+// into intermediate std::vector containers first. All chunks are at least 16-byte aligned
+struct MeshDataView
+{
+    std::span<const Mesh> meshes_;
+    std::span<const BoundingBox> boxes_;
+    std::span<const uint32_t> indexData_;
+    // the packed stream described by vertexStream_
+    std::span<const float> vertexData_;
+    VertexStreamHeader vertexStream_;
+
+    ChunkFile file_;
+};
+
+// Parameters of the screen-space error LOD selection, see selectLOD() and VKSceneData::selectLODs()
+struct LODSelectionConfig
+{
+    // the largest allowed deviation of a simplified surface from the original one, in pixels
+    float maxPixelError = 1.0f;
+    // A shape switches to a coarser LOD only when its error drops below (1 - hysteresis) * maxPixelError,
+    // so a camera hovering around the threshold does not make the shape flicker between two LODs
+    float hysteresis = 0.25f;
+};
+
+// The largest scaling factor of a transformation, which turns an object-space error into a world-space one
+inline float getMaxScale(const glm::mat4 &m)
+{
+    return std::max({glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))});
+}
+
+// The size in pixels of a unit of object-space error of a shape: maxScale (see getMaxScale()) turns it into a world-space
+// error, which is projected at the distance of the bounding sphere of the world-space box.
+// Inside the sphere the distance is clamped, which makes any non-zero error too large and selects the finest LOD.
+// cameraPos is in the same coordinates as the box, pixelsPerUnit is the size in pixels of a unit-length segment at unit distance
+inline float getLODErrorScale(const BoundingBox &box, float maxScale, const glm::vec3 &cameraPos, float pixelsPerUnit)
+{
+    const float radius = 0.5f * glm::length(box.max_ - box.min_);
+    const float distance = std::max(glm::length(cameraPos - box.getCenter()) - radius, 1e-4f);
+
+    return maxScale * pixelsPerUnit / distance;
+}
+
+// The coarsest LOD of the mesh whose error, multiplied by errorScale, stays within cfg.maxPixelError.
+// The search starts from the current LOD of the shape, which is where the hysteresis comes from
+inline uint32_t selectLOD(const Mesh &mesh, uint32_t currentLOD, float errorScale, const LODSelectionConfig &cfg)
+{
+    if (mesh.lodCount < 2)
+        return 0;
+
+    uint32_t lod = std::min(currentLOD, mesh.lodCount - 1);
+
+    while (lod > 0 && mesh.lodError[lod] * errorScale > cfg.maxPixelError)
+        lod--;
+
+    while (lod + 1 < mesh.lodCount && mesh.lodError[lod + 1] * errorScale <= cfg.maxPixelError * (1.0f - cfg.hysteresis))
+        lod++;
+
+    return lod;
+}
+
 static_assert(sizeof(DrawData) == sizeof(uint32_t) * 6);
 static_assert(sizeof(BoundingBox) == sizeof(float) * 6);
+static_assert(sizeof(VertexStreamHeader) == sizeof(uint32_t) * 8);
+
+// Always returns 8 floats per vertex. The format the vertices were stored in is returned in the optional format parameter
+MeshFileHeader loadMeshData(const char *meshFile, MeshData &out, VertexFormat *format = nullptr);
 
-MeshFileHeader loadMeshData(const char *meshFile, MeshData &out);
-void saveMeshData(const char *fileName, const MeshData &m);
+// Map the mesh file into memory and set up the view spans. The view stays valid until releaseMeshDataView()
+MeshFileHeader loadMeshDataView(const char *meshFile, MeshDataView &out);
+void releaseMeshDataView(MeshDataView &view);
+// The vertices of all the meshes must be 8 floats (pos, uv, normal), they are stored in the given format
+void saveMeshData(const char *fileName, const MeshData &m, VertexFormat format = VertexFormat_Float);
 
 void recalculateBoundingBoxes(MeshData &m);
 
@@ -25,6 +25,8 @@ struct MyApp : public CameraApp
 		onScreenRenderers_.emplace_back(imgui, false);
 
 		sceneData.scene_.localTransform_[0] = glm::rotate(glm::mat4(1.f), (float)(M_PI / 2.f), glm::vec3(1.f, 0.f, 0.0f));
+		// VKSceneData has already computed the global transforms, only the changed nodes are recalculated
+		markAsChanged(sceneData.scene_, 0);
 	}
 
 	// no need to override the destructor because all our Vulkan objects are
@@ -61,9 +63,9 @@ struct MyApp : public CameraApp
 	{
 		CameraApp::update(deltaSeconds);
 
-		// update/upload matrices for individual scene nodes
-		sceneData.recalculateAllTransforms();
-		sceneData.uploadGlobalTransforms();
+		// update/upload matrices only for the scene nodes which were edited
+		sceneData.recalculateChangedTransforms();
+		sceneData.uploadDirtyTransforms();
 	}
 
 private:
@@ -104,9 +106,13 @@ private:
 		ImGuizmo::SetID(1);
 
 		editTransform(cameraView, cameraProjection, globalTransform);
-		glm::mat4 deltaTransform = glm::inverse(srcTransform) * globalTransform;  // calculate delta for edited global transform
-		sceneData.scene_.localTransform_[node] = localTransform * deltaTransform; // modify local transform
-		markAsChanged(sceneData.scene_, node);
+		// only an actual edit dirties the subtree of this node
+		if (globalTransform != srcTransform)
+		{
+			glm::mat4 deltaTransform = glm::inverse(srcTransform) * globalTransform;  // calculate delta for edited global transform
+			sceneData.scene_.localTransform_[node] = localTransform * deltaTransform; // modify local transform
+			markAsChanged(sceneData.scene_, node);
+		}
 
 		ImGui::Separator();
 		ImGui::Text("%s", "Material");
@@ -0,0 +1,211 @@
+#include "UtilsChunkFile.h"
+#include "UtilsHash.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+#include <execution>
+
+static void writePadding(ChunkFileWriter &writer, uint32_t alignment)
+{
+    static const uint8_t zeros[kChunkAlignment_Default] = {0};
+
+    const uint64_t padding = (alignment - (writer.offset_ % alignment)) % alignment;
+    fwrite(zeros, 1, (size_t)padding, writer.file_);
+    writer.offset_ += padding;
+}
+
+bool beginChunkFile(ChunkFileWriter &writer, const char *fileName, uint32_t fileType)
+{
+    writer = ChunkFileWriter();
+    writer.file_ = fopen(fileName, "wb");
+
+    if (!writer.file_)
+    {
+        printf("Cannot open '%s' for writing\n", fileName);
+        return false;
+    }
+
+    writer.header_.fileType_ = fileType;
+
+    // the header is written twice: now as a placeholder and in endChunkFile() with the final offsets
+    fwrite(&writer.header_, sizeof(ChunkFileHeader), 1, writer.file_);
+    writer.offset_ = sizeof(ChunkFileHeader);
+
+    return true;
+}
+
+void writeChunk(ChunkFileWriter &writer, uint32_t id, const void *data, uint64_t size, uint32_t alignment)
+{
+    assert(alignment > 0 && alignment <= kChunkAlignment_Default);
+
+    writePadding(writer, alignment);
+
+    writer.chunks_.push_back(ChunkDesc{
+        .id_ = id,
+        .alignment_ = alignment,
+        .offset_ = writer.offset_,
+        .size_ = size,
+        .checksum_ = xxHash64(data, (size_t)size)});
+
+    if (size)
+        fwrite(data, 1, (size_t)size, writer.file_);
+
+    writer.offset_ += size;
+}
+
+bool endChunkFile(ChunkFileWriter &writer)
+{
+    if (!writer.file_)
+        return false;
+
+    writePadding(writer, kChunkAlignment_Small);
+
+    writer.header_.chunkCount_ = (uint32_t)writer.chunks_.size();
+    writer.header_.chunkTableOffset_ = writer.offset_;
+    writer.header_.fileSize_ = writer.offset_ + writer.chunks_.size() * sizeof(ChunkDesc);
+
+    fwrite(writer.chunks_.data(), sizeof(ChunkDesc), writer.chunks_.size(), writer.file_);
+
+    fseek(writer.file_, 0, SEEK_SET);
+    fwrite(&writer.header_, sizeof(ChunkFileHeader), 1, writer.file_);
+
+    const bool ok = !ferror(writer.file_);
+    fclose(writer.file_);
+    writer.file_ = nullptr;
+
+    return ok;
+}
+
+bool openChunkFile(const char *fileName, uint32_t fileType, ChunkFile &out, bool verifyChecksums)
+{
+    out = ChunkFile();
+
+    if (!mapFile(fileName, out.file_))
+        return false;
+
+    const uint8_t *data = out.file_.data_;
+    const uint64_t fileSize = out.file_.size_;
+
+    bool valid = fileSize >= sizeof(ChunkFileHeader);
+    if (valid)
+    {
+        memcpy(&out.header_, data, sizeof(ChunkFileHeader));
+
+        if (out.header_.magic_ != kChunkFileMagic || out.header_.version_ != kChunkFileVersion)
+        {
+            printf("'%s' is not a valid asset file (or was written by an older tool version)\n", fileName);
+            valid = false;
+        }
+        else if (out.header_.fileType_ != fileType)
+        {
+            printf("'%s' has unexpected contents\n", fileName);
+            valid = false;
+        }
+        else if (out.header_.fileSize_ != fileSize ||
+                 out.header_.chunkTableOffset_ + out.header_.chunkCount_ * sizeof(ChunkDesc) > fileSize ||
+                 out.header_.chunkTableOffset_ % alignof(ChunkDesc) != 0)
+        {
+            printf("'%s' is truncated\n", fileName);
+            valid = false;
+        }
+    }
+
+    if (valid)
+    {
+        out.chunks_ = std::span(reinterpret_cast<const ChunkDesc *>(data + out.header_.chunkTableOffset_), out.header_.chunkCount_);
+
+        valid = std::all_of(out.chunks_.begin(), out.chunks_.end(), [fileSize](const ChunkDesc &c)
+                            { return (c.alignment_ > 0) && (c.offset_ % c.alignment_ == 0) && (c.offset_ + c.size_ <= fileSize); });
+
+        if (!valid)
+            printf("'%s' has a corrupted chunk table\n", fileName);
+    }
+
+    // chunks are independent, so their checksums are verified in parallel
+    if (valid && verifyChecksums)
+    {
+        valid = std::all_of(std::execution::par, out.chunks_.begin(), out.chunks_.end(), [data](const ChunkDesc &c)
+                            { return xxHash64(data + c.offset_, (size_t)c.size_) == c.checksum_; });
+
+        if (!valid)
+            printf("Checksum mismatch in '%s'\n", fileName);
+    }
+
+    if (!valid)
+        closeChunkFile(out);
+
+    return valid;
+}
+
+void closeChunkFile(ChunkFile &file)
+{
+    unmapFile(file.file_);
+    file = ChunkFile();
+}
+
+const ChunkDesc *findChunk(const ChunkFile &file, uint32_t id)
+{
+    for (const auto &c : file.chunks_)
+        if (c.id_ == id)
+            return &c;
+
+    return nullptr;
+}
+
+std::vector<uint8_t> packStringList(const std::vector<std::string> &lines)
+{
+    size_t totalSize = sizeof(uint32_t);
+    for (const auto &s : lines)
+        totalSize += sizeof(uint32_t) + s.length() + 1;
+
+    std::vector<uint8_t> out(totalSize);
+    uint8_t *p = out.data();
+
+    const uint32_t count = (uint32_t)lines.size();
+    memcpy(p, &count, sizeof(count));
+    p += sizeof(count);
+
+    for (const auto &s : lines)
+    {
+        const uint32_t len = (uint32_t)s.length();
+        memcpy(p, &len, sizeof(len));
+        p += sizeof(len);
+        // copy the terminating zero as well
+        memcpy(p, s.c_str(), len + 1);
+        p += len + 1;
+    }
+
+    return out;
+}
+
+void unpackStringList(std::span<const uint8_t> data, std::vector<std::string> &lines)
+{
+    lines.clear();
+
+    const uint8_t *p = data.data();
+    const uint8_t *end = p + data.size();
+
+    if (data.size() < sizeof(uint32_t))
+        return;
+
+    uint32_t count = 0;
+    memcpy(&count, p, sizeof(count));
+    p += sizeof(count);
+
+    lines.reserve(count);
+
+    for (uint32_t i = 0; i != count && p + sizeof(uint32_t) <= end; i++)
+    {
+        uint32_t len = 0;
+        memcpy(&len, p, sizeof(len));
+        p += sizeof(len);
+
+        if (p + len + 1 > end)
+            break;
+
+        lines.emplace_back(reinterpret_cast<const char *>(p), len);
+        p += len + 1;
+    }
+}
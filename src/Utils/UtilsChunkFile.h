@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include "UtilsMappedFile.h"
+
+// A simple chunked container used by all our binary asset files (meshes, scenes and materials).
+//
+//   [ChunkFileHeader] [chunk 0 payload] [pad] [chunk 1 payload] [pad] ... [ChunkDesc table]
+//
+// Every payload starts at an offset aligned to the chunk's alignment (16 or 64 bytes), so a memory-mapped
+// file can be accessed through typed spans directly. All offsets and sizes are 64-bit, which lifts the 4 GB
+// limit of the old flat formats. Each chunk carries an XXH64 checksum of its payload, and since the chunks
+// are independent they can be validated (and consumed) in parallel.
+
+constexpr uint32_t makeFourCC(char a, char b, char c, char d)
+{
+    return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+}
+
+constexpr uint32_t kChunkFileMagic = makeFourCC('M', 'G', 'C', 'F');
+constexpr uint32_t kChunkFileVersion = 1;
+
+constexpr uint32_t kChunkAlignment_Default = 64;
+constexpr uint32_t kChunkAlignment_Small = 16;
+
+struct ChunkFileHeader
+{
+    uint32_t magic_ = kChunkFileMagic;
+    uint32_t version_ = kChunkFileVersion;
+    // FourCC of the file contents, i.e. 'MESH', 'SCNE' or 'MATL'
+    uint32_t fileType_ = 0;
+    uint32_t chunkCount_ = 0;
+    uint64_t chunkTableOffset_ = 0;
+    uint64_t fileSize_ = 0;
+};
+
+struct ChunkDesc
+{
+    uint32_t id_;
+    uint32_t alignment_;
+    uint64_t offset_;
+    uint64_t size_;
+    uint64_t checksum_;
+};
+
+static_assert(sizeof(ChunkFileHeader) == 32);
+static_assert(sizeof(ChunkDesc) == 32);
+
+/* Writing */
+
+struct ChunkFileWriter
+{
+    FILE *file_ = nullptr;
+    // we track the offset ourselves because ftell() is 32-bit on some platforms
+    uint64_t offset_ = 0;
+    ChunkFileHeader header_;
+    std::vector<ChunkDesc> chunks_;
+};
+
+bool beginChunkFile(ChunkFileWriter &writer, const char *fileName, uint32_t fileType);
+void writeChunk(ChunkFileWriter &writer, uint32_t id, const void *data, uint64_t size, uint32_t alignment = kChunkAlignment_Default);
+bool endChunkFile(ChunkFileWriter &writer);
+
+template <typename T>
+inline void writeChunk(ChunkFileWriter &writer, uint32_t id, const std::vector<T> &items, uint32_t alignment = kChunkAlignment_Default)
+{
+    writeChunk(writer, id, items.data(), items.size() * sizeof(T), alignment);
+}
+
+/* Reading */
+
+struct ChunkFile
+{
+    MappedFile file_;
+    ChunkFileHeader header_;
+    std::span<const ChunkDesc> chunks_;
+};
+
+// Maps the file, checks the header and the chunk table and (optionally) verifies all checksums in parallel
+bool openChunkFile(const char *fileName, uint32_t fileType, ChunkFile &out, bool verifyChecksums = true);
+void closeChunkFile(ChunkFile &file);
+
+const ChunkDesc *findChunk(const ChunkFile &file, uint32_t id);
+
+// Returns an empty span if the chunk is missing
+template <typename T>
+inline std::span<const T> getChunkData(const ChunkFile &file, uint32_t id)
+{
+    const ChunkDesc *c = findChunk(file, id);
+    if (!c)
+        return {};
+    return std::span<const T>(reinterpret_cast<const T *>(file.file_.data_ + c->offset_), c->size_ / sizeof(T));
+}
+
+template <typename T>
+inline void readChunk(const ChunkFile &file, uint32_t id, std::vector<T> &out)
+{
+    const auto data = getChunkData<T>(file, id);
+    out.assign(data.begin(), data.end());
+}
+
+/* String lists are stored as [count] followed by [length, characters, '\0'] for every string */
+
+std::vector<uint8_t> packStringList(const std::vector<std::string> &lines);
+void unpackStringList(std::span<const uint8_t> data, std::vector<std::string> &lines);
@@ -1,6 +1,11 @@
 ﻿#include "UtilsMath.h"
 #include "UtilsCubemap.h"
 
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <vector>
+
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
@@ -199,3 +204,212 @@ Bitmap convertVerticalCrossToCubeMapFaces(const Bitmap &b)
 
 	return cubemap;
 }
+
+/* Direct conversion into the cube map faces */
+
+// convertEquirectangularMapToVerticalCross() followed by convertVerticalCrossToCubeMapFaces() walks the whole image twice,
+// single-threaded, with two atan2() calls and four indirect getPixel() calls per texel. Here every texel of
+// the cube map faces is sampled only once, straight into its place, and the rows of all six faces are independent.
+// Each cube map face is a face of the vertical cross, copied either as it is or rotated by 180 degrees:
+// kCrossFaces[] and kCrossFlipped[] compose the two functions
+
+static const int kCrossFaces[6] = {1, 3, 4, 5, 0, 2};
+static const bool kCrossFlipped[6] = {false, false, true, true, true, false};
+
+// exactly the lookup of convertEquirectangularMapToVerticalCross()
+static vec4 sampleEquirectangularMap(const Bitmap &b, const vec3 &P, int faceSize)
+{
+	const float R = hypot(P.x, P.y);
+	const float theta = atan2(P.y, P.x);
+	const float phi = atan2(P.z, R);
+
+	const float Uf = float(2.0f * faceSize * (theta + M_PI) / M_PI);
+	const float Vf = float(2.0f * faceSize * (M_PI / 2.0f - phi) / M_PI);
+
+	const int U1 = clamp(int(floor(Uf)), 0, b.w_ - 1);
+	const int V1 = clamp(int(floor(Vf)), 0, b.h_ - 1);
+	const int U2 = clamp(U1 + 1, 0, b.w_ - 1);
+	const int V2 = clamp(V1 + 1, 0, b.h_ - 1);
+
+	const float s = Uf - U1;
+	const float t = Vf - V1;
+
+	const vec4 A = b.getPixel(U1, V1);
+	const vec4 B = b.getPixel(U2, V1);
+	const vec4 C = b.getPixel(U1, V2);
+	const vec4 D = b.getPixel(U2, V2);
+
+	return A * (1 - s) * (1 - t) + B * (s) * (1 - t) + C * (1 - s) * t + D * (s) * (t);
+}
+
+#if USE_SSE_MATH
+static inline __m128 select4(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// atan() on [0, 1], the polynomial 4.4.49 from Abramowitz and Stegun. The absolute error is below 2e-8,
+// a thousand times less than a texel of a 16K equirectangular map
+static inline __m128 atanUnit4(__m128 x)
+{
+	const __m128 x2 = _mm_mul_ps(x, x);
+
+	__m128 p = _mm_set1_ps(-0.0040540580f);
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(0.0218612288f));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-0.0559098861f));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(0.0964200441f));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-0.1390853351f));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(0.1994653599f));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-0.3332985605f));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(0.9999993329f));
+
+	return _mm_mul_ps(p, x);
+}
+
+// The octant is reduced to [0, 1] and restored with exact comparisons, so the seam of the equirectangular map
+// (y = +0, x < 0 gives +pi) stays where atan2() puts it
+static inline __m128 atan2_4(__m128 y, __m128 x)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	const __m128 ax = _mm_andnot_ps(signMask, x);
+	const __m128 ay = _mm_andnot_ps(signMask, y);
+	const __m128 mx = _mm_max_ps(ax, ay);
+	const __m128 mn = _mm_min_ps(ax, ay);
+
+	// atan2(0, 0) is zero, the division gives NaN there
+	__m128 r = atanUnit4(_mm_and_ps(_mm_div_ps(mn, mx), _mm_cmpgt_ps(mx, zero)));
+
+	r = select4(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(Math::PI * 0.5f), r), r);
+	r = select4(_mm_cmplt_ps(x, zero), _mm_sub_ps(_mm_set1_ps(Math::PI), r), r);
+
+	return _mm_xor_ps(r, _mm_and_ps(_mm_cmplt_ps(y, zero), signMask));
+}
+
+// faceCoordsToXYZ() for 4 texels of a row: the same arithmetic, so P is bitwise identical
+static inline void faceCoordsToXYZ4(__m128 A, float B, int faceID, __m128 &x, __m128 &y, __m128 &z)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 Am1 = _mm_sub_ps(A, one);
+
+	switch (faceID)
+	{
+	case 0:
+		x = _mm_set1_ps(-1.0f), y = Am1, z = _mm_set1_ps(B - 1.0f);
+		break;
+	case 1:
+		x = Am1, y = _mm_set1_ps(-1.0f), z = _mm_set1_ps(1.0f - B);
+		break;
+	case 2:
+		x = one, y = Am1, z = _mm_set1_ps(1.0f - B);
+		break;
+	case 3:
+		x = _mm_sub_ps(one, A), y = one, z = _mm_set1_ps(1.0f - B);
+		break;
+	case 4:
+		x = _mm_set1_ps(B - 1.0f), y = Am1, z = one;
+		break;
+	default:
+		x = _mm_set1_ps(1.0f - B), y = Am1, z = _mm_set1_ps(-1.0f);
+		break;
+	}
+}
+
+// RGBA float bitmaps, 4 texels at a time: the angles in SSE registers, the bilinear lookup with whole texels in SSE registers.
+// Returns the number of texels converted, the rest of the row is left to the scalar code
+static int convertRowFloat4(const Bitmap &b, int face, int j, int faceSize, float *dst)
+{
+	const int crossFace = kCrossFaces[face];
+	const bool flipped = kCrossFlipped[face];
+
+	const float B = 2.0f * float(flipped ? faceSize - 1 - j : j) / faceSize;
+	const float *src = reinterpret_cast<const float *>(b.data_.data());
+
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 size = _mm_set1_ps(float(faceSize));
+	const __m128 toTexels = _mm_set1_ps(2.0f * faceSize / Math::PI);
+
+	int i = 0;
+	for (; i + 4 <= faceSize; i += 4)
+	{
+		__m128 ci = _mm_setr_ps(float(i), float(i + 1), float(i + 2), float(i + 3));
+		if (flipped)
+			ci = _mm_sub_ps(_mm_set1_ps(float(faceSize - 1)), ci);
+
+		__m128 x, y, z;
+		faceCoordsToXYZ4(_mm_div_ps(_mm_mul_ps(two, ci), size), B, crossFace, x, y, z);
+
+		const __m128 R = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+		const __m128 theta = atan2_4(y, x);
+		const __m128 phi = atan2_4(z, R);
+
+		alignas(16) float Uf[4], Vf[4];
+		_mm_store_ps(Uf, _mm_mul_ps(_mm_add_ps(theta, _mm_set1_ps(Math::PI)), toTexels));
+		_mm_store_ps(Vf, _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(Math::PI * 0.5f), phi), toTexels));
+
+		for (int k = 0; k != 4; k++)
+		{
+			const int U1 = clamp(int(floorf(Uf[k])), 0, b.w_ - 1);
+			const int V1 = clamp(int(floorf(Vf[k])), 0, b.h_ - 1);
+			const int U2 = clamp(U1 + 1, 0, b.w_ - 1);
+			const int V2 = clamp(V1 + 1, 0, b.h_ - 1);
+
+			const float s = Uf[k] - U1;
+			const float t = Vf[k] - V1;
+
+			const __m128 A = _mm_loadu_ps(src + (V1 * b.w_ + U1) * 4);
+			const __m128 B = _mm_loadu_ps(src + (V1 * b.w_ + U2) * 4);
+			const __m128 C = _mm_loadu_ps(src + (V2 * b.w_ + U1) * 4);
+			const __m128 D = _mm_loadu_ps(src + (V2 * b.w_ + U2) * 4);
+
+			__m128 color = _mm_mul_ps(A, _mm_set1_ps((1 - s) * (1 - t)));
+			color = _mm_add_ps(color, _mm_mul_ps(B, _mm_set1_ps(s * (1 - t))));
+			color = _mm_add_ps(color, _mm_mul_ps(C, _mm_set1_ps((1 - s) * t)));
+			color = _mm_add_ps(color, _mm_mul_ps(D, _mm_set1_ps(s * t)));
+
+			_mm_storeu_ps(dst + (i + k) * 4, color);
+		}
+	}
+
+	return i;
+}
+#endif
+
+static void convertRow(const Bitmap &b, int face, int j, int faceSize, Bitmap &cubemap)
+{
+	int i = 0;
+
+#if USE_SSE_MATH
+	if (b.fmt_ == eBitmapFormat_Float && b.comp_ == 4)
+		i = convertRowFloat4(b, face, j, faceSize, reinterpret_cast<float *>(cubemap.data_.data()) + (face * faceSize + j) * faceSize * 4);
+#endif
+
+	const int crossFace = kCrossFaces[face];
+	const bool flipped = kCrossFlipped[face];
+
+	for (; i != faceSize; i++)
+	{
+		const vec3 P = flipped ? faceCoordsToXYZ(faceSize - 1 - i, faceSize - 1 - j, crossFace, faceSize) : faceCoordsToXYZ(i, j, crossFace, faceSize);
+		cubemap.setPixel(i, face * faceSize + j, sampleEquirectangularMap(b, P, faceSize));
+	}
+}
+
+Bitmap convertEquirectangularMapToCubeMapFaces(const Bitmap &b)
+{
+	if (b.type_ != eBitmapType_2D)
+		return Bitmap();
+
+	const int faceSize = b.w_ / 4;
+
+	Bitmap cubemap(faceSize, faceSize, 6, b.comp_, b.fmt_);
+	cubemap.type_ = eBitmapType_Cube;
+
+	std::vector<int> rows(6 * faceSize);
+	std::iota(rows.begin(), rows.end(), 0);
+
+	std::for_each(std::execution::par, rows.begin(), rows.end(), [&](int row)
+				  { convertRow(b, row / faceSize, row % faceSize, faceSize, cubemap); });
+
+	return cubemap;
+}
@@ -4,3 +4,7 @@
 
 Bitmap convertEquirectangularMapToVerticalCross(const Bitmap& b);
 Bitmap convertVerticalCrossToCubeMapFaces(const Bitmap& b);
+
+// The same cube map faces as the two functions above, in a single multithreaded pass
+// without the intermediate cross. RGBA float bitmaps use SSE
+Bitmap convertEquirectangularMapToCubeMapFaces(const Bitmap& b);
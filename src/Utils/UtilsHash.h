@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 64-bit xxHash (XXH64). It is fast enough to checksum multi-gigabyte mesh blobs while loading
+// and good enough to be used as a content key for caches and deduplication
+uint64_t xxHash64(const void *data, size_t size, uint64_t seed = 0);
+
+// Streaming variant for inputs which are hashed piece by piece (e.g. a file plus a few config values).
+// Note that the streaming result is NOT equal to the one-shot hash of the concatenated input
+struct HashCombiner
+{
+    uint64_t value_ = 0x9E3779B97F4A7C15ull;
+
+    inline HashCombiner &add(const void *data, size_t size)
+    {
+        value_ = xxHash64(data, size, value_);
+        return *this;
+    }
+
+    template <typename T>
+    inline HashCombiner &add(const T &v) { return add(&v, sizeof(T)); }
+};
@@ -0,0 +1,113 @@
+#include "UtilsMappedFile.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+bool mapFile(const char *fileName, MappedFile &out, bool sequentialAccess)
+{
+    out = MappedFile();
+
+    HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | (sequentialAccess ? FILE_FLAG_SEQUENTIAL_SCAN : 0), nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    const void *ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!ptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    out.data_ = static_cast<const uint8_t *>(ptr);
+    out.size_ = static_cast<size_t>(size.QuadPart);
+    out.fileHandle_ = file;
+    out.mappingHandle_ = mapping;
+
+    return true;
+}
+
+void unmapFile(MappedFile &file)
+{
+    if (file.data_)
+        UnmapViewOfFile(file.data_);
+    if (file.mappingHandle_)
+        CloseHandle((HANDLE)file.mappingHandle_);
+    if (file.fileHandle_)
+        CloseHandle((HANDLE)file.fileHandle_);
+
+    file = MappedFile();
+}
+
+#else
+
+bool mapFile(const char *fileName, MappedFile &out, bool sequentialAccess)
+{
+    out = MappedFile();
+
+    const int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void *ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // the mapping keeps its own reference to the file, so the descriptor is not needed anymore
+    close(fd);
+
+    if (ptr == MAP_FAILED)
+        return false;
+
+    // madvise() advice values are not flags, so they are passed one at a time
+    if (sequentialAccess)
+    {
+        madvise(ptr, (size_t)st.st_size, MADV_SEQUENTIAL);
+        madvise(ptr, (size_t)st.st_size, MADV_WILLNEED);
+    }
+
+    out.data_ = static_cast<const uint8_t *>(ptr);
+    out.size_ = (size_t)st.st_size;
+
+    return true;
+}
+
+void unmapFile(MappedFile &file)
+{
+    if (file.data_)
+        munmap(const_cast<uint8_t *>(file.data_), file.size_);
+
+    file = MappedFile();
+}
+
+#endif
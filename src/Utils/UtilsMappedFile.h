@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A read-only memory mapping of an entire file. The OS brings the pages in on first access, so
+// large binary blobs (mesh and scene files) can be consumed directly from the page cache, for example
+// copied straight into a GPU buffer, without first being fread() into a temporary heap array
+struct MappedFile
+{
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+
+    // platform-specific handles (HANDLEs on Windows, unused on POSIX)
+    void *fileHandle_ = nullptr;
+    void *mappingHandle_ = nullptr;
+};
+
+// sequentialAccess hints the OS to read ahead aggressively, which is what uploaders want
+bool mapFile(const char *fileName, MappedFile &out, bool sequentialAccess = true);
+void unmapFile(MappedFile &file);
@@ -5,8 +5,17 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#include <stdint.h>
 #include <vector>
 
+// SSE is part of every x64 target, for 32-bit x86 it has to be enabled explicitly
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define USE_SSE_MATH 1
+#include <xmmintrin.h>
+#else
+#define USE_SSE_MATH 0
+#endif
+
 using glm::vec3;
 using glm::vec4;
 
@@ -16,6 +25,45 @@ namespace Math
 	static constexpr float TWOPI = 6.28318530718f;
 }
 
+// The hot loops of the scene graph multiply matrices one pair at a time. mulMat4() keeps whole
+// matrix columns in SSE registers. The multiplication performs exactly the same operations in the same
+// order as glm's scalar operator*, so the results are bitwise identical to the glm path
+inline glm::mat4 mulMat4(const glm::mat4 &a, const glm::mat4 &b)
+{
+#if USE_SSE_MATH
+	const float *pa = glm::value_ptr(a);
+	const float *pb = glm::value_ptr(b);
+
+	const __m128 a0 = _mm_loadu_ps(pa + 0);
+	const __m128 a1 = _mm_loadu_ps(pa + 4);
+	const __m128 a2 = _mm_loadu_ps(pa + 8);
+	const __m128 a3 = _mm_loadu_ps(pa + 12);
+
+	glm::mat4 r;
+	float *pr = glm::value_ptr(r);
+
+	for (int j = 0; j != 4; j++)
+	{
+		// r[j] = a[0] * b[j][0] + a[1] * b[j][1] + a[2] * b[j][2] + a[3] * b[j][3]
+		const float *bj = pb + j * 4;
+		__m128 c = _mm_mul_ps(a0, _mm_set1_ps(bj[0]));
+		c = _mm_add_ps(c, _mm_mul_ps(a1, _mm_set1_ps(bj[1])));
+		c = _mm_add_ps(c, _mm_mul_ps(a2, _mm_set1_ps(bj[2])));
+		c = _mm_add_ps(c, _mm_mul_ps(a3, _mm_set1_ps(bj[3])));
+		_mm_storeu_ps(pr + j * 4, c);
+	}
+	return r;
+#else
+	return a * b;
+#endif
+}
+
+// A matrix is affine if its last row is (0, 0, 0, 1)
+inline bool isAffine(const glm::mat4 &m)
+{
+	return m[0][3] == 0.0f && m[1][3] == 0.0f && m[2][3] == 0.0f && m[3][3] == 1.0f;
+}
+
 struct BoundingBox
 {
 	vec3 min_;
@@ -37,7 +85,59 @@ struct BoundingBox
 	}
 	vec3 getSize() const { return vec3(max_[0] - min_[0], max_[1] - min_[1], max_[2] - min_[2]); }
 	vec3 getCenter() const { return 0.5f * vec3(max_[0] + min_[0], max_[1] + min_[1], max_[2] + min_[2]); }
+	// Arvo's method ("Transforming Axis-Aligned Bounding Boxes", Graphics Gems, 1990): for an affine
+	// transformation each output extent is the translation plus the sum of the smaller (for min_) or the
+	// larger (for max_) of the two products of a matrix element with the old extents. This replaces the
+	// 8 corner transforms by 9 min/max pairs. The results may differ from transformCorners() by a few ULPs
+	// because the additions are performed in a different order.
+	// Non-affine matrices fall back to the corner path
 	void transform(const glm::mat4 &t)
+	{
+		if (!isAffine(t))
+		{
+			transformCorners(t);
+			return;
+		}
+
+#if USE_SSE_MATH
+		const float *pt = glm::value_ptr(t);
+
+		__m128 lo = _mm_loadu_ps(pt + 12);
+		__m128 hi = lo;
+
+		for (int j = 0; j != 3; j++)
+		{
+			const __m128 col = _mm_loadu_ps(pt + j * 4);
+			const __m128 a = _mm_mul_ps(col, _mm_set1_ps(min_[j]));
+			const __m128 b = _mm_mul_ps(col, _mm_set1_ps(max_[j]));
+			lo = _mm_add_ps(lo, _mm_min_ps(a, b));
+			hi = _mm_add_ps(hi, _mm_max_ps(a, b));
+		}
+
+		float outMin[4], outMax[4];
+		_mm_storeu_ps(outMin, lo);
+		_mm_storeu_ps(outMax, hi);
+
+		min_ = vec3(outMin[0], outMin[1], outMin[2]);
+		max_ = vec3(outMax[0], outMax[1], outMax[2]);
+#else
+		vec3 newMin = vec3(t[3]);
+		vec3 newMax = newMin;
+
+		for (int j = 0; j != 3; j++)
+		{
+			const vec3 a = vec3(t[j]) * min_[j];
+			const vec3 b = vec3(t[j]) * max_[j];
+			newMin += glm::min(a, b);
+			newMax += glm::max(a, b);
+		}
+
+		min_ = newMin;
+		max_ = newMax;
+#endif
+	}
+	// transforms all 8 corners and builds a new box around them
+	void transformCorners(const glm::mat4 &t)
 	{
 		vec3 corners[] = {
 			vec3(min_.x, min_.y, min_.z),
@@ -192,6 +292,151 @@ inline bool isBoxInFrustum(glm::vec4 *frustumPlanes, glm::vec4 *frustumCorners,
 	return true;
 }
 
+// Everything isBoxInFrustum() needs, extracted once per frame. The "all 8 frustum corners are on one side
+// of the box" tests only depend on the extreme corner coordinates, so the corners are reduced to their bounds
+struct CullingFrustum
+{
+	glm::vec4 planes_[6];
+	vec3 cornersMin_;
+	vec3 cornersMax_;
+};
+
+inline CullingFrustum getCullingFrustum(const glm::mat4 &mvp)
+{
+	CullingFrustum f;
+	getFrustumPlanes(mvp, f.planes_);
+
+	glm::vec4 corners[8];
+	getFrustumCorners(mvp, corners);
+
+	f.cornersMin_ = vec3(corners[0]);
+	f.cornersMax_ = vec3(corners[0]);
+	for (int i = 1; i != 8; i++)
+	{
+		f.cornersMin_ = glm::min(f.cornersMin_, vec3(corners[i]));
+		f.cornersMax_ = glm::max(f.cornersMax_, vec3(corners[i]));
+	}
+
+	return f;
+}
+
+// The same test as isBoxInFrustum(), and with exactly the same results. Instead of all 8 box corners only the one
+// furthest along the plane normal is checked: rounding is monotonic, so its (rounded) distance is the largest of the 8.
+// The distance is summed in the same order as glm::dot() does it
+inline bool isBoxInFrustum(const CullingFrustum &f, const BoundingBox &box)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		const glm::vec4 &p = f.planes_[i];
+		const float x = (p.x >= 0.0f) ? box.max_.x : box.min_.x;
+		const float y = (p.y >= 0.0f) ? box.max_.y : box.min_.y;
+		const float z = (p.z >= 0.0f) ? box.max_.z : box.min_.z;
+		if ((p.x * x + p.y * y) + (p.z * z + p.w) < 0.0f)
+			return false;
+	}
+
+	return !(f.cornersMin_.x > box.max_.x || f.cornersMax_.x < box.min_.x ||
+			 f.cornersMin_.y > box.max_.y || f.cornersMax_.y < box.min_.y ||
+			 f.cornersMin_.z > box.max_.z || f.cornersMax_.z < box.min_.z);
+}
+
+// Boxes stored as separate arrays of coordinates, so that several boxes can be loaded into one SIMD register
+struct BoundingBoxesSoA
+{
+	std::vector<float> minX_, minY_, minZ_;
+	std::vector<float> maxX_, maxY_, maxZ_;
+
+	size_t size() const { return minX_.size(); }
+
+	void resize(size_t count)
+	{
+		for (auto *v : {&minX_, &minY_, &minZ_, &maxX_, &maxY_, &maxZ_})
+			v->resize(count);
+	}
+
+	void set(size_t i, const BoundingBox &b)
+	{
+		minX_[i] = b.min_.x;
+		minY_[i] = b.min_.y;
+		minZ_[i] = b.min_.z;
+		maxX_[i] = b.max_.x;
+		maxY_[i] = b.max_.y;
+		maxZ_[i] = b.max_.z;
+	}
+};
+
+// Batched isBoxInFrustum() over the boxes [first, first + count): bit (i % 32) of visibility[i / 32] is set
+// if the box first + i is visible, with exactly the same results. The array must have (count + 31) / 32 elements.
+// The SSE path tests 4 boxes at a time, the plane signs are the same for all the boxes, so choosing the furthest
+// corner is a pointer selection per plane
+inline void cullBoxes(const CullingFrustum &f, const BoundingBoxesSoA &boxes, size_t first, size_t count, uint32_t *visibility)
+{
+	for (size_t w = 0; w != (count + 31) / 32; w++)
+		visibility[w] = 0;
+
+	const float *minX = boxes.minX_.data() + first, *minY = boxes.minY_.data() + first, *minZ = boxes.minZ_.data() + first;
+	const float *maxX = boxes.maxX_.data() + first, *maxY = boxes.maxY_.data() + first, *maxZ = boxes.maxZ_.data() + first;
+
+	const float *px[6], *py[6], *pz[6];
+	for (int i = 0; i != 6; i++)
+	{
+		px[i] = (f.planes_[i].x >= 0.0f) ? maxX : minX;
+		py[i] = (f.planes_[i].y >= 0.0f) ? maxY : minY;
+		pz[i] = (f.planes_[i].z >= 0.0f) ? maxZ : minZ;
+	}
+
+	size_t b = 0;
+
+#if USE_SSE_MATH
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 cornersMinX = _mm_set1_ps(f.cornersMin_.x), cornersMaxX = _mm_set1_ps(f.cornersMax_.x);
+	const __m128 cornersMinY = _mm_set1_ps(f.cornersMin_.y), cornersMaxY = _mm_set1_ps(f.cornersMax_.y);
+	const __m128 cornersMinZ = _mm_set1_ps(f.cornersMin_.z), cornersMaxZ = _mm_set1_ps(f.cornersMax_.z);
+
+	for (; b + 4 <= count; b += 4)
+	{
+		// the comparisons are all "true means outside", so a single OR accumulates them
+		__m128 outside = _mm_or_ps(
+			_mm_or_ps(_mm_cmpgt_ps(cornersMinX, _mm_loadu_ps(maxX + b)), _mm_cmplt_ps(cornersMaxX, _mm_loadu_ps(minX + b))),
+			_mm_or_ps(_mm_cmpgt_ps(cornersMinY, _mm_loadu_ps(maxY + b)), _mm_cmplt_ps(cornersMaxY, _mm_loadu_ps(minY + b))));
+		outside = _mm_or_ps(outside,
+							_mm_or_ps(_mm_cmpgt_ps(cornersMinZ, _mm_loadu_ps(maxZ + b)), _mm_cmplt_ps(cornersMaxZ, _mm_loadu_ps(minZ + b))));
+
+		for (int i = 0; i != 6; i++)
+		{
+			const glm::vec4 &p = f.planes_[i];
+			const __m128 xy = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x), _mm_loadu_ps(px[i] + b)), _mm_mul_ps(_mm_set1_ps(p.y), _mm_loadu_ps(py[i] + b)));
+			const __m128 zw = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.z), _mm_loadu_ps(pz[i] + b)), _mm_set1_ps(p.w));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(xy, zw), zero));
+		}
+
+		const uint32_t visible = ~(uint32_t)_mm_movemask_ps(outside) & 0xF;
+		visibility[b / 32] |= visible << (b % 32);
+	}
+#endif
+
+	for (; b != count; b++)
+	{
+		bool outside = f.cornersMin_.x > maxX[b] || f.cornersMax_.x < minX[b] ||
+					   f.cornersMin_.y > maxY[b] || f.cornersMax_.y < minY[b] ||
+					   f.cornersMin_.z > maxZ[b] || f.cornersMax_.z < minZ[b];
+
+		for (int i = 0; i != 6 && !outside; i++)
+		{
+			const glm::vec4 &p = f.planes_[i];
+			outside = (p.x * px[i][b] + p.y * py[i][b]) + (p.z * pz[i][b] + p.w) < 0.0f;
+		}
+
+		if (!outside)
+			visibility[b / 32] |= 1u << (b % 32);
+	}
+}
+
+inline void cullBoxes(const CullingFrustum &f, const BoundingBoxesSoA &boxes, uint32_t *visibility)
+{
+	cullBoxes(f, boxes, 0, boxes.size(), visibility);
+}
+
 inline BoundingBox combineBoxes(const std::vector<BoundingBox> &boxes)
 {
 	std::vector<vec3> allPoints;
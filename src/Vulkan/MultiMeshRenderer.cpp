@@ -205,8 +205,8 @@ MultiMeshRenderer::MultiMeshRenderer(
     }
 
     // To allocate a descriptor set, we need to save the sizes of the index and vertex buffers:
-    maxVertexBufferSize_ = header.vertexDataSize;
-    maxIndexBufferSize_ = header.indexDataSize;
+    maxVertexBufferSize_ = (uint32_t)header.vertexDataSize;
+    maxIndexBufferSize_ = (uint32_t)header.indexDataSize;
 
     // Now, we want to store arbitrary arrays of mesh vertices and face indices,
     // so this forces us to support arbitrary offsets of GPU sub-buffers. Our descriptor set for
@@ -237,7 +237,7 @@ MultiMeshRenderer::MultiMeshRenderer(
     }
 
     // only update the geometry data once, during the initialization stage
-    updateGeometryBuffers(vkDev, header.vertexDataSize, header.indexDataSize,
+    updateGeometryBuffers(vkDev, (uint32_t)header.vertexDataSize, (uint32_t)header.indexDataSize,
                           meshData_.vertexData_.data(), meshData_.indexData_.data());
 
     // One swapchain image corresponds to one instance buffer or indirect draw data buffer:
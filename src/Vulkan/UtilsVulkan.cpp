@@ -980,7 +980,7 @@ bool createImage(VkDevice device, VkPhysicalDevice physicalDevice,
 }
 
 // create a sampler that allows our fragment shaders to fetch texels from the image
-bool createTextureSampler(VkDevice device, VkSampler *sampler, VkFilter minFilter, VkFilter maxFilter, VkSamplerAddressMode addressMode)
+bool createTextureSampler(VkDevice device, VkSampler *sampler, VkFilter minFilter, VkFilter maxFilter, VkSamplerAddressMode addressMode, uint32_t mipLevels)
 {
 	const VkSamplerCreateInfo samplerInfo = {
 		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
@@ -998,7 +998,7 @@ bool createTextureSampler(VkDevice device, VkSampler *sampler, VkFilter minFilte
 		.compareEnable = VK_FALSE,
 		.compareOp = VK_COMPARE_OP_ALWAYS,
 		.minLod = 0.0f,
-		.maxLod = 0.0f,
+		.maxLod = (float)(mipLevels - 1),
 		.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
 		.unnormalizedCoordinates = VK_FALSE};
 
@@ -1436,6 +1436,24 @@ uint32_t bytesPerTexFormat(VkFormat fmt)
 	return 0;
 }
 
+uint32_t bytesPerTexBlock(VkFormat fmt)
+{
+	switch (fmt)
+	{
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+		return 8;
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+		return 16;
+	default:
+		break;
+	}
+	return 0;
+}
+
 // ============================ mesh geometry data ====================================
 
 // loads a mesh via Assimp from a file into a Vulkan shader storage buffer.
@@ -2295,9 +2313,7 @@ bool createCubeTextureImage(VulkanRenderDevice &vkDev, const char *filename, VkI
 	stbi_image_free((void *)img);
 
 	Bitmap in(w, h, 4, eBitmapFormat_Float, img32.data());
-	Bitmap out = convertEquirectangularMapToVerticalCross(in);
-
-	Bitmap cube = convertVerticalCrossToCubeMapFaces(out);
+	Bitmap cube = convertEquirectangularMapToCubeMapFaces(in);
 
 	if (width && height)
 	{
@@ -2368,14 +2384,13 @@ bool createMIPCubeTextureImage(VulkanRenderDevice &vkDev, const char *filename,
 	uint32_t faceSize = w / 4;
 	for (uint32_t i = 0; i < mipLevels; i++)
 	{
+		// every MIP level is converted straight into the cube map faces, see convertEquirectangularMapToCubeMapFaces()
 		Bitmap in(w, h, 4, eBitmapFormat_Float, src);
-		Bitmap out = convertEquirectangularMapToVerticalCross(in);
-		Bitmap cube = convertVerticalCrossToCubeMapFaces(out);
-
-		imageSize = faceSize * faceSize * 4;
+		Bitmap cube = convertEquirectangularMapToCubeMapFaces(in);
 
-		memcpy(mip, cube.data_.data(), 6 * imageSize * sizeof(float));
-		mip += imageSize * 6;
+		// the faces of every level are half the size of the previous ones
+		memcpy(mip, cube.data_.data(), cube.data_.size());
+		mip += cube.data_.size() / sizeof(float);
 
 		src += w * h * 4;
 		w >>= 1;
@@ -2399,7 +2414,7 @@ bool createMIPCubeTextureImage(VulkanRenderDevice &vkDev, const char *filename,
 
 bool createMIPTextureImageFromData(VulkanRenderDevice &vkDev,
 								   VkImage &textureImage, VkDeviceMemory &textureImageMemory,
-								   void *mipData, uint32_t mipLevels, uint32_t texWidth, uint32_t texHeight,
+								   const void *mipData, uint32_t mipLevels, uint32_t texWidth, uint32_t texHeight,
 								   VkFormat texFormat,
 								   uint32_t layerCount, VkImageCreateFlags flags)
 {
@@ -2411,11 +2426,12 @@ bool createMIPTextureImageFromData(VulkanRenderDevice &vkDev,
 	VkDeviceSize layerSize = texWidth * texHeight * bytesPerPixel;
 	VkDeviceSize imageSize = layerSize * layerCount;
 
+	// the levels of non-square textures stop at one texel in the shorter dimension
 	uint32_t w = texWidth, h = texHeight;
 	for (uint32_t i = 1; i < mipLevels; i++)
 	{
-		w >>= 1;
-		h >>= 1;
+		w = std::max(w >> 1, 1u);
+		h = std::max(h >> 1, 1u);
 		imageSize += w * h * bytesPerPixel * layerCount;
 	}
 
@@ -2461,8 +2477,8 @@ void copyMIPBufferToImage(VulkanRenderDevice &vkDev, VkBuffer buffer, VkImage im
 
 		regions[i] = region;
 
-		w >>= 1;
-		h >>= 1;
+		w = std::max(w >> 1, 1u);
+		h = std::max(h >> 1, 1u);
 	}
 
 	vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)regions.size(), regions.data());
@@ -2470,6 +2486,63 @@ void copyMIPBufferToImage(VulkanRenderDevice &vkDev, VkBuffer buffer, VkImage im
 	endSingleTimeCommands(vkDev, commandBuffer);
 }
 
+// The same as createMIPTextureImageFromData(), but the size of every level is counted in 4x4 blocks.
+// The levels which are not a multiple of 4 texels are padded to whole blocks, while the copy regions use the real size
+bool createCompressedMIPTextureImageFromData(VulkanRenderDevice &vkDev,
+											 VkImage &textureImage, VkDeviceMemory &textureImageMemory,
+											 const void *mipData, uint32_t mipLevels, uint32_t texWidth, uint32_t texHeight,
+											 VkFormat texFormat)
+{
+	const uint32_t bytesPerBlock = bytesPerTexBlock(texFormat);
+	if (!bytesPerBlock)
+		return false;
+
+	std::vector<VkBufferImageCopy> regions(mipLevels);
+	VkDeviceSize imageSize = 0;
+
+	for (uint32_t i = 0; i < mipLevels; i++)
+	{
+		const uint32_t w = std::max(texWidth >> i, 1u);
+		const uint32_t h = std::max(texHeight >> i, 1u);
+
+		regions[i] = VkBufferImageCopy{
+			.bufferOffset = imageSize,
+			.bufferRowLength = 0,
+			.bufferImageHeight = 0,
+			.imageSubresource = VkImageSubresourceLayers{
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.mipLevel = i,
+				.baseArrayLayer = 0,
+				.layerCount = 1},
+			.imageOffset = VkOffset3D{.x = 0, .y = 0, .z = 0},
+			.imageExtent = VkExtent3D{.width = w, .height = h, .depth = 1}};
+
+		imageSize += ((w + 3) / 4) * ((h + 3) / 4) * bytesPerBlock;
+	}
+
+	if (!createImage(vkDev.device, vkDev.physicalDevice, texWidth, texHeight, texFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory, 0, mipLevels))
+		return false;
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	createBuffer(vkDev.device, vkDev.physicalDevice, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	uploadBufferData(vkDev, stagingBufferMemory, 0, mipData, imageSize);
+
+	transitionImageLayout(vkDev, textureImage, texFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, mipLevels);
+
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkDev);
+	vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)regions.size(), regions.data());
+	endSingleTimeCommands(vkDev, commandBuffer);
+
+	transitionImageLayout(vkDev, textureImage, texFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1, mipLevels);
+
+	vkDestroyBuffer(vkDev.device, stagingBuffer, nullptr);
+	vkFreeMemory(vkDev.device, stagingBufferMemory, nullptr);
+
+	return true;
+}
+
 bool createPBRVertexBuffer(VulkanRenderDevice &vkDev, const char *filename, VkBuffer *storageBuffer, VkDeviceMemory *storageBufferMemory, size_t *vertexBufferSize, size_t *indexBufferSize)
 {
 	const aiScene *scene = aiImportFile(filename, aiProcess_Triangulate);
@@ -2610,6 +2683,13 @@ bool initVulkanRenderDevice2WithCompute(VulkanInstance &vk, VulkanRenderDevice &
 	//	VK_CHECK(createDevice2(vkDev.physicalDevice, deviceFeatures2, vkDev.graphicsFamily, &vkDev.device));
 	//	VK_CHECK(vkGetBestComputeQueue(vkDev.physicalDevice, &vkDev.computeFamily));
 	vkDev.computeFamily = findQueueFamilies(vkDev.physicalDevice, VK_QUEUE_COMPUTE_BIT);
+
+	// the block-compressed textures are optional: the feature is only requested if the device has it
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(vkDev.physicalDevice, &supportedFeatures);
+	deviceFeatures2.features.textureCompressionBC &= supportedFeatures.textureCompressionBC;
+	vkDev.useTextureCompressionBC = deviceFeatures2.features.textureCompressionBC == VK_TRUE;
+
 	VK_CHECK(createDevice2WithCompute(vkDev.physicalDevice, deviceFeatures2, vkDev.graphicsFamily, vkDev.computeFamily, &vkDev.device));
 
 	vkGetDeviceQueue(vkDev.device, vkDev.graphicsFamily, 0, &vkDev.graphicsQueue);
@@ -2696,6 +2776,8 @@ bool initVulkanRenderDevice3(VulkanInstance &vk, VulkanRenderDevice &vkDev, uint
 		/* for indirect instanced rendering */
 		.multiDrawIndirect = VK_TRUE,
 		.drawIndirectFirstInstance = VK_TRUE,
+		/* for the block-compressed material textures written by SceneConverter, dropped if not supported */
+		.textureCompressionBC = VK_TRUE,
 		/* for OIT and general atomic operations */
 		.vertexPipelineStoresAndAtomics = (VkBool32)(ctxFeatures.vertexPipelineStoresAndAtomics_ ? VK_TRUE : VK_FALSE),
 		.fragmentStoresAndAtomics = (VkBool32)(ctxFeatures.fragmentStoresAndAtomics_ ? VK_TRUE : VK_FALSE),
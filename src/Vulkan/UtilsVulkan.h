@@ -51,6 +51,9 @@ struct VulkanRenderDevice final
 	// Were we initialized with compute capabilities
 	bool useCompute = false;
 
+	// Can the BCn textures be sampled. If not, they are decoded into RGBA8 on load
+	bool useTextureCompressionBC = false;
+
 	// may coincide with graphicsFamily
 	// If the device does not support a dedicated compute queue, the
 	// values of the computeFamily and the graphicsFamily fields are equal
@@ -213,7 +216,7 @@ void downloadBufferData(VulkanRenderDevice &vkDev, const VkDeviceMemory &bufferM
 
 bool createImage(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &imageMemory, VkImageCreateFlags flags = 0, uint32_t mipLevels = 1);
 bool createTextureImage(VulkanRenderDevice &vkDev, const char *filename, VkImage &textureImage, VkDeviceMemory &textureImageMemory, uint32_t *outTexWidth = nullptr, uint32_t *outTexHeight = nullptr);
-bool createTextureSampler(VkDevice device, VkSampler *sampler, VkFilter minFilter = VK_FILTER_LINEAR, VkFilter maxFilter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT);
+bool createTextureSampler(VkDevice device, VkSampler *sampler, VkFilter minFilter = VK_FILTER_LINEAR, VkFilter maxFilter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT, uint32_t mipLevels = 1);
 bool createTextureImageFromData(VulkanRenderDevice &vkDev,
 								VkImage &textureImage, VkDeviceMemory &textureImageMemory,
 								void *imageData, uint32_t texWidth, uint32_t texHeight,
@@ -262,6 +265,8 @@ bool executeComputeShader(VulkanRenderDevice &vkDev,
 bool createComputeDescriptorSetLayout(VkDevice device, VkDescriptorSetLayout *descriptorSetLayout);
 
 uint32_t bytesPerTexFormat(VkFormat fmt);
+// The block-compressed formats store 4x4 texel blocks, bytesPerTexFormat() is zero for them
+uint32_t bytesPerTexBlock(VkFormat fmt);
 VkFormat findDepthFormat(VkPhysicalDevice device);
 bool hasStencilComponent(VkFormat format);
 void destroyVulkanImage(VkDevice device, VulkanImage &image);
@@ -282,11 +287,17 @@ bool createDepthSampler(VkDevice device, VkSampler *sampler);
 
 bool createMIPTextureImageFromData(VulkanRenderDevice &vkDev,
 								   VkImage &textureImage, VkDeviceMemory &textureImageMemory,
-								   void *mipData, uint32_t mipLevels, uint32_t texWidth, uint32_t texHeight,
+								   const void *mipData, uint32_t mipLevels, uint32_t texWidth, uint32_t texHeight,
 								   VkFormat texFormat,
 								   uint32_t layerCount = 1, VkImageCreateFlags flags = 0);
 void copyMIPBufferToImage(VulkanRenderDevice &vkDev, VkBuffer buffer, VkImage image, uint32_t mipLevels, uint32_t width, uint32_t height, uint32_t bytesPP, uint32_t layerCount = 1);
 
+// mipData contains all the MIP levels of a block-compressed 2D texture, tightly packed one after another
+bool createCompressedMIPTextureImageFromData(VulkanRenderDevice &vkDev,
+											 VkImage &textureImage, VkDeviceMemory &textureImageMemory,
+											 const void *mipData, uint32_t mipLevels, uint32_t texWidth, uint32_t texHeight,
+											 VkFormat texFormat);
+
 VkShaderStageFlagBits glslangShaderStageToVulkan(glslang_stage_t sh);
 
 inline VkPipelineShaderStageCreateInfo shaderStageInfo(VkShaderStageFlagBits shaderStage, ShaderModule &module, const char *entryPoint)